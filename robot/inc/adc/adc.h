@@ -0,0 +1,71 @@
+/* Header file for the analog to digital converter */
+
+#ifndef _ADC_H_
+#define _ADC_H_
+
+/* ------------------------ INCLUDES ---------------------------------------- */
+#include "common/utils.h"
+
+/* ------------------------ MACROS AND DEFINES ------------------------------ */
+
+/*!
+ * Single-ended input channels ADC0 to ADC15. Channels 8 to 15 are on PORTK.
+ */
+#define ADC_NUM_CHANNELS    (16)
+
+/*!
+ * Full-scale result of a conversion, referenced to AVCC
+ */
+#define ADC_FULL_SCALE      (1024)
+
+/*!
+ * The ADC is clocked at F_CPU / 16 (1 MHz at 16 MHz), above the 200 kHz
+ * needed for the full 10 bits but good for about 8, so that a conversion
+ * takes 13 us and two fit in a 20 kHz carrier period. The ADC is left
+ * enabled, so every conversion after adcInit takes 13 ADC clocks and
+ * samples its input 1.5 ADC clocks after it starts.
+ */
+#define ADC_CONVERSION_US   (13)
+
+/* ------------------------ TYPEDEFS ---------------------------------------- */
+
+/*!
+ * Type definition for the handler of a finished conversion
+ *
+ * @param[in]     result    Result of the conversion (0 to ADC_FULL_SCALE - 1)
+ * @param[in/out] pArg      Argument registered along with the handler
+ *
+ * @note Handlers run in interrupt context with interrupts disabled. The ADC
+ *       is free again before the handler runs, so a handler may start the
+ *       next conversion.
+ */
+typedef void AdcHandler(uint16_t result, void *pArg);
+
+/*!
+ * Powers up and enables the ADC, referenced to AVCC, and runs the longer
+ * first conversion
+ *
+ * @note Pins used as analog inputs should have their digital input buffers
+ *       disabled (DIDR0 and DIDR2) by their users
+ */
+typedef void AdcInit(void);
+
+/*!
+ * Starts a conversion, whose result is passed to a handler
+ *
+ * @param[in]     channel   Input channel (0 to ADC_NUM_CHANNELS - 1)
+ * @param[in]     pHandler  Handler of the result
+ * @param[in/out] pArg      Argument passed to pHandler
+ *
+ * @return STATUS_OK if the conversion was started
+ * @return STATUS_ERR_INVALID_PTR if pHandler is NULL
+ * @return STATUS_ERR_GENERAL if channel is invalid or a conversion is
+ *         already running
+ */
+typedef STATUS AdcStart(uint8_t channel, AdcHandler *pHandler, void *pArg);
+
+/* ------------------------ FUNCTION PROTOTYPES ----------------------------- */
+AdcInit  adcInit;
+AdcStart adcStart;
+
+#endif // _ADC_H_
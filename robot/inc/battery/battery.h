@@ -0,0 +1,58 @@
+/* Header file for the battery voltage monitor */
+
+#ifndef _BATTERY_H_
+#define _BATTERY_H_
+
+/* ------------------------ INCLUDES ---------------------------------------- */
+#include "adc/adc.h"
+#include "common/utils.h"
+
+/* ------------------------ MACROS AND DEFINES ------------------------------ */
+
+/*!
+ * The battery is divided down onto ADC0 (PF0), and reads
+ * BATTERY_FULL_SCALE_MV at full scale: the 5 V reference behind a 3:1
+ * divider
+ */
+#define BATTERY_CHANNEL          (0)
+#define BATTERY_FULL_SCALE_MV    (15000)
+
+/*!
+ * The battery is sampled every BATTERY_PERIOD_MS, and the samples are
+ * filtered by a first-order IIR filter giving each new sample
+ * 1/2^BATTERY_FILTER_SHIFT of the estimate, a time constant of about 80 ms
+ * that follows the sag under load but not the motors' current ripple
+ */
+#define BATTERY_PERIOD_MS        (10)
+#define BATTERY_FILTER_SHIFT     (3)
+#define BATTERY_FILTER_FRAC_BITS (4)
+
+/* ------------------------ TYPEDEFS ---------------------------------------- */
+
+/*!
+ * Initializes the battery input and the ADC
+ */
+typedef void BatteryInit(void);
+
+/*!
+ * Starts a battery sample every BATTERY_PERIOD_MS. A sample the ADC is too
+ * busy to take, i.e. while sampling back-EMF (@ref bemf.h), is retried on
+ * the next call.
+ *
+ * @note Must be run on every control tick
+ */
+typedef void BatteryUpdate(void);
+
+/*!
+ * Gets the filtered battery voltage
+ *
+ * @return the battery voltage (mV), or 0 before the first sample
+ */
+typedef uint16_t BatteryVoltageGet(void);
+
+/* ------------------------ FUNCTION PROTOTYPES ----------------------------- */
+BatteryInit       batteryInit;
+BatteryUpdate     batteryUpdate;
+BatteryVoltageGet batteryVoltageGet;
+
+#endif // _BATTERY_H_
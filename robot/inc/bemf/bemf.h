@@ -0,0 +1,98 @@
+/* Header file for the sensorless back-EMF speed estimates */
+
+#ifndef _BEMF_H_
+#define _BEMF_H_
+
+/* ------------------------ INCLUDES ---------------------------------------- */
+#include "pwm/pfcpwm.h"
+#include "adc/adc.h"
+#include "common/utils.h"
+
+/* ------------------------ MACROS AND DEFINES ------------------------------ */
+
+/*!
+ * Back-EMF inputs, for chassis without encoders. Motor n has its terminals
+ * divided down onto ADC(8+2n) (PK(2n), the side its PWM drives forward) and
+ * ADC(9+2n) (PK(2n+1)), the pins the encoders use otherwise, leaving
+ * ADC0 to ADC7 free.
+ */
+#define BEMF_NUM                (4)
+#define BEMF_CHANNEL_A(n)       (8 + 2*(n))
+#define BEMF_CHANNEL_B(n)       (9 + 2*(n))
+
+/*!
+ * Terminal voltage read at full scale (mV): the 5 V reference behind a 3:1
+ * divider
+ */
+#define BEMF_FULL_SCALE_MV      (15000)
+
+/*!
+ * Carrier periods each motor coasts for a sample. The terminals are sampled
+ * at TOP of the last one, by which time the winding current has had half a
+ * period to decay through the H-bridge's diodes; motors with more
+ * inductance may need 2.
+ */
+#define BEMF_COAST_PERIODS      (1)
+
+/*!
+ * Samples are filtered by a first-order IIR filter, giving each new sample
+ * 1/2^BEMF_FILTER_SHIFT of the estimate, which is kept with
+ * BEMF_FILTER_FRAC_BITS extra fractional bits
+ */
+#define BEMF_FILTER_SHIFT       (2)
+#define BEMF_FILTER_FRAC_BITS   (4)
+
+/* ------------------------ TYPEDEFS ---------------------------------------- */
+
+/*!
+ * Initializes the back-EMF inputs and the ADC
+ *
+ * @param[in] pPwms     array of pointers to the motors' PWM objects, where
+ *                      motor n is sampled on BEMF_CHANNEL_A(n) and
+ *                      BEMF_CHANNEL_B(n)
+ * @param[in] numPwms   number of PWM objects in pPwms (up to BEMF_NUM)
+ *
+ * @return STATUS_OK if the inputs were initialized
+ * @return STATUS_ERR_INVALID_PTR if pPwms is NULL
+ * @return STATUS_ERR_GENERAL if numPwms is invalid
+ */
+typedef STATUS BemfInit(PWM *const pPwms[], uint8_t numPwms);
+
+/*!
+ * Samples the back-EMF of one motor, in turn. The motor's PWM is released
+ * for a coast window (@ref pwmCoastWindow) of BEMF_COAST_PERIODS carrier
+ * periods, at the end of which both its terminals are converted, back to
+ * back, before it is driven again. Each motor is sampled once per
+ * numPwms calls, so at 20 kHz and a 1 kHz tick, four motors each lose one
+ * 50 us period of drive in 4 ms, or 1.25% of their torque, which their
+ * speed loops make up.
+ *
+ * @note Must be run on every control tick, just after the PWMs' duty cycles
+ *       are committed (@ref pwmCommit)
+ */
+typedef void BemfUpdate(void);
+
+/*!
+ * Gets the filtered back-EMF of a motor
+ *
+ * @param[in] idx   Index of the motor
+ *
+ * @return the signed back-EMF (mV, + forward), or 0 for an invalid index
+ */
+typedef int16_t BemfGet(uint8_t idx);
+
+/*!
+ * Gets which motor was sampled last. Its sample is taken within the tick
+ * bemfUpdate starts it on, so it is fresh until the next call.
+ *
+ * @return the index of the motor
+ */
+typedef uint8_t BemfFreshGet(void);
+
+/* ------------------------ FUNCTION PROTOTYPES ----------------------------- */
+BemfInit     bemfInit;
+BemfUpdate   bemfUpdate;
+BemfGet      bemfGet;
+BemfFreshGet bemfFreshGet;
+
+#endif // _BEMF_H_
@@ -19,6 +19,40 @@
  */
 #define BLE_CMD_EMPTY_PAYLOAD           (&bleCmdEmptyPayload[0])
 
+/*!
+ * Values of the RobotDriveService command characteristic that trip the
+ * e-stop, and that clear it (@ref estop.h), rather than drive
+ */
+#define BLE_CMD_ESTOP_TRIGGER           "ESTOP"
+#define BLE_CMD_ESTOP_CLEAR             "CLEAR"
+
+/*!
+ * Link quality monitor configuration. RSSI is kept in dBm scaled by
+ * 2^BLE_RSSI_FRAC_BITS and smoothed with an exponential moving average of
+ * weight 2^-BLE_RSSI_EMA_SHIFT. TX power is raised while the smoothed RSSI is
+ * below BLE_RSSI_RAISE_DBM and lowered while it is above BLE_RSSI_LOWER_DBM;
+ * the gap between the two provides hysteresis.
+ */
+#define BLE_LINK_MONITOR_PERIOD_MS      (500)
+#define BLE_RSSI_FRAC_BITS              (4)
+#define BLE_RSSI_EMA_SHIFT              (2)
+#define BLE_RSSI_RAISE_DBM              (-75)
+#define BLE_RSSI_LOWER_DBM              (-55)
+
+#define BLE_RSSI_FIXED(dbm)             ((int16_t)(dbm)*(1 << BLE_RSSI_FRAC_BITS))
+
+/*!
+ * RSSI (dBm) at and below which link quality is 0, and at and above which
+ * link quality is 100
+ */
+#define BLE_RSSI_QUALITY_MIN_DBM        (-95)
+#define BLE_RSSI_QUALITY_MAX_DBM        (-50)
+
+/*!
+ * Index into the module's TX power level table used at start-up (0 dBm)
+ */
+#define BLE_TX_POWER_DEFAULT_IDX        (6)
+
 /* ------------------------ TYPEDEFS ---------------------------------------- */
 
 /*!
@@ -63,13 +97,36 @@ typedef void BleConnect(BLE *pBLE);
 typedef void BleServicesConfigure(BLE *pBLE);
 
 /*!
- * Updates a BLE GATT characteristic configured for the BLE object
+ * Updates a BLE GATT characteristic configured for the BLE object, calling
+ * its handler if the value changed. While connected, an unchanged legacy
+ * speed or direction characteristic renews the Car's held command instead
+ * (@ref CAR_FAILSAFE_MS).
  *
  * @param[in/out] pBLE  Pointer to the Bluetooth LE object
  * @param[in/out] pChar Pointer to BLE GATT characteristic to update
  */
 typedef void BleCharacteristicUpdate(BLE *pBLE, BLE_GATT_CHAR *pChar);
 
+/*!
+ * Reads the current value of a BLE GATT characteristic from the BLE module
+ *
+ * @param[in/out] pBLE  Pointer to the Bluetooth LE object
+ * @param[in/out] pChar Pointer to BLE GATT characteristic to read
+ * @param[in/out] value Value read from the BLE module
+ */
+typedef void BleCharacteristicRead(BLE *pBLE, BLE_GATT_CHAR *pChar,
+                                   ble_char_value value);
+
+/*!
+ * Writes a new value of a BLE GATT characteristic to the BLE module
+ *
+ * @param[in/out] pBLE  Pointer to the Bluetooth LE object
+ * @param[in/out] pChar Pointer to BLE GATT characteristic to write
+ * @param[in]     value Value to write to the BLE module
+ */
+typedef void BleCharacteristicWrite(BLE *pBLE, BLE_GATT_CHAR *pChar,
+                                    ble_char_value value);
+
 /*!
  * Pings BLE module to check if in command mode
  *
@@ -88,6 +145,18 @@ typedef uint8_t BlePing(BLE *pBLE);
  */
 typedef void BleInfo(BLE *pBLE, char info[], uint8_t infoLen);
 
+/*!
+ * Samples the RSSI of the current connection, updates the smoothed RSSI and
+ * link quality, and steps the TX power level up or down as needed
+ *
+ * @param[in/out] pBLE     Pointer to BLE object
+ *
+ * @note This issues AT-commands, so it must be called from the main loop at a
+ *       low rate (every BLE_LINK_MONITOR_PERIOD_MS) and never from an ISR;
+ *       main.c schedules it so
+ */
+typedef void BleLinkMonitor(BLE *pBLE);
+
 /* ------------------------ STRUCT DEFINITION ------------------------------- */
 
 /*!
@@ -98,6 +167,22 @@ struct BLE
     // BLE services
     BLE_GATT_SERVICE         services[BLE_GATT_MAX_SERVICES];
 
+    // Smoothed RSSI of the connection (dBm, scaled by 2^BLE_RSSI_FRAC_BITS)
+    int16_t                  rssi;
+
+    // Index of the current TX power level in the module's power level table
+    uint8_t                  txPowerIdx;
+
+    // Link quality from 0 (lost) to 100 (excellent), derived from rssi
+    uint8_t                  linkQuality;
+
+    //
+    // Whether a central is connected, as of bleConnect or the last run of
+    // the link monitor
+    //
+    bool                     bConnected;
+
+#if METHOD_POINTERS
     // BLE generic methods
     BleInitialize           *bleInitialize;
     BleConnect              *bleConnect;
@@ -107,10 +192,14 @@ struct BLE
 
     // BLE Characteristics methods
     BleCharacteristicUpdate *bleCharacteristicUpdate;
+    BleCharacteristicRead   *bleCharacteristicRead;
+    BleCharacteristicWrite  *bleCharacteristicWrite;
 
     // BLE Utilities
     BlePing                 *blePing;
     BleInfo                 *bleInfo;
+    BleLinkMonitor          *bleLinkMonitor;
+#endif
 };
 
 /* ------------------------ FUNCTION PROTOTYPES ----------------------------- */
@@ -125,9 +214,12 @@ BleServicesConfigure    bleServicesConfigure;
 
 // BLE Characteristics methods
 BleCharacteristicUpdate bleCharacteristicUpdate;
+BleCharacteristicRead   bleCharacteristicRead;
+BleCharacteristicWrite  bleCharacteristicWrite;
 
 // BLE Utilities
 BlePing                 blePing;
 BleInfo                 bleInfo;
+BleLinkMonitor          bleLinkMonitor;
 
 #endif // _BLE_H_
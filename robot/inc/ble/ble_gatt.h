@@ -11,7 +11,7 @@
 #define BLE_GATT_MAX_CCDS                    (16)
 
 // NOTE: This is set somewhat arbitrarily, and does not reflect a requirement
-#define BLE_GATT_NUM_CHAR_PER_SERVICE        (3)
+#define BLE_GATT_NUM_CHAR_PER_SERVICE        (4)
 
 #define BLE_GATT_CHAR_UUID_LEN               (7)
 #define BLE_GATT_CHAR_PROPERTIES_LEN         (5)
@@ -5,6 +5,7 @@
 
 /* ------------------------ INCLUDES ---------------------------------------- */
 #include "motor/motor.h"
+#include "tick/tick.h"
 #include "common/utils.h"
 
 /* ------------------------ MACROS AND DEFINES ------------------------------ */
@@ -22,6 +23,171 @@
  */
 #define DRIVE_TURN_SPEED (0x05)
 
+/*!
+ * BLE link quality (0-100) below which the Car's top speed is derated, and
+ * the top speed (as % of total speed) allowed once the link is lost entirely
+ */
+#define CAR_LINK_DERATE_QUALITY   (60)
+#define CAR_LINK_DERATE_MIN_SPEED (30)
+
+/*!
+ * Sequence number a controller starts counting from. Until a sequenced
+ * command has been accepted (after construction or carCommandSeqReset) the
+ * first one is taken whatever its sequence number; after that commands are
+ * compared using serial number arithmetic, so the 8-bit sequence number may
+ * wrap freely as long as fewer than 128 commands are in flight at once.
+ */
+#define CAR_CMD_SEQ_INITIAL (0x00)
+
+/*!
+ * Indices of the Car's wheels in its per-wheel arrays
+ */
+#define CAR_WHEEL_FRONT_LEFT  (0)
+#define CAR_WHEEL_FRONT_RIGHT (1)
+#define CAR_WHEEL_BACK_LEFT   (2)
+#define CAR_WHEEL_BACK_RIGHT  (3)
+#define CAR_NUM_WHEELS        (4)
+
+/*!
+ * Wheel speeds are signed permille of full speed (-1000..1000). The motion
+ * profile keeps them with CAR_SPEED_FRAC_BITS extra fractional bits so that
+ * small per-tick steps do not round away.
+ */
+#define CAR_SPEED_FULL        (1000)
+#define CAR_SPEED_FRAC_BITS   (5)
+#define CAR_SPEED_FIXED(s)    ((int16_t)(s)*(1 << CAR_SPEED_FRAC_BITS))
+
+/*!
+ * Full speed in mm/s. Each Motor holds its wheel at the commanded speed
+ * (@ref MotorDriveSpeed), so at 1000 a permille of full speed is 1 mm/s on
+ * every wheel, whatever each motor's load.
+ */
+#define CAR_SPEED_MAX_MMPS    (1000)
+#define CAR_SPEED_TO_MMPS(s) \
+        ((int16_t)(((int32_t)(s) * CAR_SPEED_MAX_MMPS) / CAR_SPEED_FULL))
+
+/*!
+ * Distance a wheel travels per encoder edge (um): 65 mm wheels on a 48:1
+ * gearbox with 12-line encoders read on both edges of A, 204 mm / 1152
+ */
+#define CAR_WHEEL_UM_PER_EDGE (177)
+
+/*!
+ * Set to 1 for chassis without wheel encoders, whose speed loops are closed
+ * on each motor's back-EMF instead (@ref bemf.h)
+ */
+#ifndef CAR_SENSORLESS
+#define CAR_SENSORLESS        (0)
+#endif
+
+/*!
+ * Wheel speed per volt of back-EMF (mm/s): 65 mm wheels on a 48:1 gearbox
+ * whose motor turns at 1820 rpm per volt, 204 mm * 1820 / 48 / 60
+ */
+#define CAR_WHEEL_MMPS_PER_VOLT (129)
+
+/*!
+ * Set to 1 to calibrate the wheels at boot (@ref CarCalibrate), with the
+ * car on a stand
+ */
+#ifndef CAR_CALIBRATE
+#define CAR_CALIBRATE         (0)
+#endif
+
+/*!
+ * Traction control settings (@ref CarTractionSet)
+ *
+ * CAR_TRACTION_MIN_MMPS:   commanded wheel speed below which a wheel is not
+ *                          judged, where its speed reads too coarsely
+ * CAR_TRACTION_SLIP_PCT:   how far a wheel's share of its commanded speed
+ *                          must exceed the gripping wheels' for it to slip
+ * CAR_TRACTION_SLIP_MMPS:  how much faster than the gripping wheels' share
+ *                          a wheel must also turn for it to slip
+ * CAR_TRACTION_CUT_SHIFT:  a slipping wheel's demand is cut by 2^-shift of
+ *                          itself each time a measurement finds it slipping
+ * CAR_TRACTION_RECOVER:    how fast a cut is restored once the wheel grips
+ *                          (permille of duty per tick)
+ */
+#define CAR_TRACTION_MIN_MMPS        (50)
+#define CAR_TRACTION_SLIP_PCT        (20)
+#define CAR_TRACTION_SLIP_MMPS       (40)
+#define CAR_TRACTION_CUT_SHIFT       (2)
+#define CAR_TRACTION_RECOVER         (2)
+
+/*!
+ * Dead-man failsafe settings (@ref CarFailsafeSet)
+ *
+ * CAR_FAILSAFE_MS:       default silence window after the last accepted
+ *                        drive command
+ * CAR_FAILSAFE_RAMP_MS:  time the failsafe ramps the wheels from full speed
+ *                        to rest (>= 64 ms at 1 kHz)
+ *
+ * The failsafe runs from the control tick, so its worst-case stop latency,
+ * from the last accepted command until every motor is released, is
+ *
+ *     window + 1 tick                      (silence seen on the next tick)
+ *            + CAR_FAILSAFE_RAMP_MS        (wheel speeds ramped to 0)
+ *            + MOTOR_PID_TICKS ticks       (each speed loop coasts its motor)
+ *            + 1 PWM period                (compare values latched)
+ *
+ * or about 755 ms at the defaults, whatever the main loop is doing. The
+ * only further delay is the longest time interrupts are ever disabled,
+ * which holds off the tick; the tick's overrun count (@ref TickStatsGet)
+ * shows whether it is ever held off past a whole period.
+ *
+ * The RobotDrive app writes the legacy speed and direction characteristics
+ * only when a slider moves, so it holds a command by not writing at all.
+ * While the BLE link is up, each poll that finds a legacy characteristic
+ * unchanged renews its command (@ref CarCommandRefresh), and the failsafe
+ * only stops such a controller once the link monitor has found the link
+ * lost: up to BLE_LINK_MONITOR_PERIOD_MS later than the window above.
+ */
+#define CAR_FAILSAFE_MS              (500)
+#define CAR_FAILSAFE_RAMP_MS         (250)
+
+/*!
+ * Drive modes
+ *
+ * DIFFERENTIAL: conventional wheels; each side is driven together
+ * MECANUM:      mecanum wheels, rollers forming an X when viewed from above;
+ *               the Car may also move sideways
+ */
+#define CAR_MODE_DIFFERENTIAL        (0)
+#define CAR_MODE_MECANUM             (1)
+
+/*!
+ * Motion profile types
+ *
+ * NONE:        wheels jump straight to their target speed
+ * TRAPEZOIDAL: wheel speed slews at no more than maxAccel
+ * SCURVE:      wheel acceleration additionally slews at no more than maxJerk
+ */
+#define CAR_PROFILE_TYPE_NONE        (0)
+#define CAR_PROFILE_TYPE_TRAPEZOIDAL (1)
+#define CAR_PROFILE_TYPE_SCURVE      (2)
+
+/*!
+ * Wheel accelerations are kept with CAR_ACCEL_FRAC_BITS further fractional
+ * bits on top of the wheel speed units, so that gentle jerk limits remain
+ * representable
+ */
+#define CAR_ACCEL_FRAC_BITS   (6)
+
+/*!
+ * Helpers to express profile limits in time rather than per-tick units
+ *
+ * CAR_PROFILE_ACCEL(ms):       acceleration reaching full speed from rest
+ *                              in ms milliseconds (ms >= 64 at 1 kHz)
+ * CAR_PROFILE_JERK(accel, ms): jerk reaching acceleration accel from zero
+ *                              in ms milliseconds
+ */
+#define CAR_PROFILE_ACCEL(ms) \
+        ((int16_t)(((int32_t)CAR_SPEED_FIXED(CAR_SPEED_FULL) * \
+                    (1000L << CAR_ACCEL_FRAC_BITS)) / \
+                   ((int32_t)(ms) * TICK_HZ)))
+#define CAR_PROFILE_JERK(accel, ms) \
+        ((int16_t)(((int32_t)(accel) * 1000L) / ((int32_t)(ms) * TICK_HZ)))
+
 /* ------------------------ TYPEDEFS ---------------------------------------- */
 
 /*!
@@ -29,6 +195,23 @@
  */
 typedef struct Car Car;
 
+/*!
+ * Motion profile limiting how fast the Car's wheel speeds may change. Both
+ * limits are per control tick, in the fixed-point wheel acceleration units
+ * above (wheel speed units scaled by 2^CAR_ACCEL_FRAC_BITS).
+ */
+typedef struct CAR_PROFILE
+{
+    // One of CAR_PROFILE_TYPE_*
+    uint8_t type;
+
+    // Max change in wheel speed per tick
+    int16_t maxAccel;
+
+    // Max change in wheel acceleration per tick (SCURVE only)
+    int16_t maxJerk;
+} CAR_PROFILE;
+
 /*!
  * Constructs a Car object
  *
@@ -37,6 +220,9 @@ typedef struct Car Car;
  * @param[in]     pFrontRight   Pointer to Car's front right Motor
  * @param[in]     pBackLeft     Pointer to Car's back left Motor
  * @param[in]     pBackRight    Pointer to Car's back right Motor
+ *
+ * @note The Motors must already be constructed; the control tick drives
+ *       them without checking them again
  */
 typedef void CarConstruct(Car   *pCar,
                           Motor *pFrontLeft,
@@ -48,11 +234,291 @@ typedef void CarConstruct(Car   *pCar,
  * Drives the car according to given speed and direction
  *
  * @param[in/out] pCar      Pointer to Car object
- * @param[in]     speed     Speed to drive (as % of total speed)
+ * @param[in]     speed     Speed to drive (as % of CAR_SPEED_MAX_MMPS)
  * @param[in]     direction Direction to drive relative to front of the car
  */
 typedef void CarDrive(Car *pCar, uint8_t speed, uint8_t direction);
 
+/*!
+ * Drives the car along an arc using differential-drive kinematics. The left
+ * wheels run at linear - turn and the right wheels at linear + turn, so
+ * linear = 0 pivots the car in place and turn = 0 drives straight. If either
+ * side would exceed the allowed top speed, both sides are scaled down
+ * together so the car still follows the commanded arc.
+ *
+ * @param[in/out] pCar      Pointer to Car object
+ * @param[in]     linear    Linear speed (permille of full speed, + forward)
+ * @param[in]     turn      Turn rate (permille of full speed, + left)
+ */
+typedef void CarDriveArc(Car *pCar, int16_t linear, int16_t turn);
+
+/*!
+ * Drives the car with independent forward, sideways and turning motion. In
+ * CAR_MODE_MECANUM the three are mixed into the four wheel speeds; in
+ * CAR_MODE_DIFFERENTIAL vy is ignored and this is equivalent to carDriveArc.
+ * If any wheel would exceed the allowed top speed, all four are scaled down
+ * together so the car keeps its commanded heading and curvature.
+ *
+ * @param[in/out] pCar      Pointer to Car object
+ * @param[in]     vx        Forward speed (permille of full speed, + forward)
+ * @param[in]     vy        Sideways speed (permille of full speed, + left)
+ * @param[in]     omega     Turn rate (permille of full speed, + left)
+ *
+ * @note May be called from any context: the wheels' targets are replaced
+ *       together, so the control tick never applies half of a motion. The
+ *       same holds for carDrive and carDriveArc, which drive through this.
+ */
+typedef void CarDriveHolonomic(Car *pCar, int16_t vx, int16_t vy,
+                               int16_t omega);
+
+/*!
+ * Selects the Car's drive mode. Takes effect on the next control tick.
+ *
+ * @param[in/out] pCar      Pointer to Car object
+ * @param[in]     mode      One of CAR_MODE_*
+ */
+typedef void CarModeSet(Car *pCar, uint8_t mode);
+
+/*!
+ * Derates the Car's top speed according to the quality of the BLE link
+ * carrying its drive commands, so that a command lost on a poor link leaves
+ * the car moving slowly rather than at full speed
+ *
+ * @param[in/out] pCar      Pointer to Car object
+ * @param[in]     quality   Link quality from 0 (lost) to 100 (excellent)
+ */
+typedef void CarLinkQualityDerate(Car *pCar, uint8_t quality);
+
+/*!
+ * Compensates the motors for the battery voltage (@ref MotorSupplySet), so
+ * that a commanded speed drives the wheels equally fast across the whole
+ * discharge. Once the battery has sagged below MOTOR_SUPPLY_NOMINAL_MV, the
+ * top speed is also capped at the share of full speed it can still
+ * compensate, scaling all wheels down together as carLinkQualityDerate
+ * does.
+ *
+ * @param[in/out] pCar          Pointer to Car object
+ * @param[in]     millivolts    Battery voltage (mV), or 0 if unknown
+ */
+typedef void CarSupplyDerate(Car *pCar, uint16_t millivolts);
+
+/*!
+ * Submits a sequenced drive command. The command only becomes the Car's
+ * pending setpoint if it is newer than every command accepted before it;
+ * duplicated, late or out-of-order commands are dropped. Nothing is applied
+ * to the motors until the next call to carUpdate, so any number of commands
+ * arriving within one control period collapse into a single carDrive.
+ *
+ * @param[in/out] pCar      Pointer to Car object
+ * @param[in]     seq       Sequence number of the command
+ * @param[in]     speed     Speed to drive (as % of total speed)
+ * @param[in]     direction Direction to drive relative to front of the car
+ *
+ * @return STATUS_OK if the command was accepted
+ * @return STATUS_ERR_INVALID_PTR if pCar is NULL
+ * @return STATUS_ERR_GENERAL if the command was superseded and dropped
+ */
+typedef STATUS CarCommand(Car *pCar, uint8_t seq, uint8_t speed,
+                          uint8_t direction);
+
+/*!
+ * Submits a sequenced arc drive command. Sequenced exactly as carCommand,
+ * with which it shares its sequence numbers.
+ *
+ * @param[in/out] pCar      Pointer to Car object
+ * @param[in]     seq       Sequence number of the command
+ * @param[in]     linear    Linear speed (permille of full speed, + forward)
+ * @param[in]     turn      Turn rate (permille of full speed, + left)
+ *
+ * @return STATUS_OK if the command was accepted
+ * @return STATUS_ERR_INVALID_PTR if pCar is NULL
+ * @return STATUS_ERR_GENERAL if the command was superseded and dropped
+ */
+typedef STATUS CarCommandArc(Car *pCar, uint8_t seq, int16_t linear,
+                             int16_t turn);
+
+/*!
+ * Submits a sequenced holonomic drive command. Sequenced exactly as
+ * carCommand, with which it shares its sequence numbers.
+ *
+ * @param[in/out] pCar      Pointer to Car object
+ * @param[in]     seq       Sequence number of the command
+ * @param[in]     vx        Forward speed (permille of full speed, + forward)
+ * @param[in]     vy        Sideways speed (permille of full speed, + left)
+ * @param[in]     omega     Turn rate (permille of full speed, + left)
+ *
+ * @return STATUS_OK if the command was accepted
+ * @return STATUS_ERR_INVALID_PTR if pCar is NULL
+ * @return STATUS_ERR_GENERAL if the command was superseded and dropped
+ */
+typedef STATUS CarCommandHolonomic(Car *pCar, uint8_t seq, int16_t vx,
+                                   int16_t vy, int16_t omega);
+
+/*!
+ * Forgets the last accepted sequence number, so that the next sequenced
+ * command is accepted whatever its sequence number. Called when the
+ * controller may have restarted its count, i.e. on a BLE (re)connect.
+ *
+ * @param[in/out] pCar      Pointer to Car object
+ */
+typedef void CarCommandSeqReset(Car *pCar);
+
+/*!
+ * Submits an unsequenced drive command, as sent by controllers that write
+ * the legacy speed and direction characteristics. Such commands carry no
+ * sequence number, so every valid one is accepted and the latest wins; they
+ * neither consume nor check the sequenced commands' numbers. Otherwise
+ * handled exactly as carCommand.
+ *
+ * @param[in/out] pCar      Pointer to Car object
+ * @param[in]     speed     Speed to drive (as % of total speed)
+ * @param[in]     direction Direction to drive relative to front of the car
+ *
+ * @return STATUS_OK if the command was accepted
+ * @return STATUS_ERR_INVALID_PTR if pCar is NULL
+ * @return STATUS_ERR_GENERAL if the command was invalid
+ */
+typedef STATUS CarCommandLegacy(Car *pCar, uint8_t speed, uint8_t direction);
+
+/*!
+ * Renews the Car's last drive command, as though the controller had sent it
+ * again, for controllers that hold a command by not writing (the legacy
+ * characteristics). Only a command from carCommandLegacy is renewed, so
+ * that a stale legacy value can never keep a silent sequenced controller's
+ * command alive, and nothing is renewed once the failsafe has stopped the
+ * car.
+ *
+ * @param[in/out] pCar      Pointer to Car object
+ *
+ * @return STATUS_OK if the command was renewed
+ * @return STATUS_ERR_INVALID_PTR if pCar is NULL
+ * @return STATUS_ERR_GENERAL if there was no legacy command to renew
+ */
+typedef STATUS CarCommandRefresh(Car *pCar);
+
+/*!
+ * Applies the latest pending drive command, if any, to the motors. Called
+ * once per control period.
+ *
+ * @param[in/out] pCar      Pointer to Car object
+ */
+typedef void CarUpdate(Car *pCar);
+
+/*!
+ * Runs one step of the Car's control loop from the freshest setpoints. This
+ * is the Car's control tick handler (@ref tick.h) and runs in interrupt
+ * context at TICK_HZ.
+ *
+ * @param[in/out] pCar      Pointer to Car object
+ */
+typedef void CarControlStep(Car *pCar);
+
+/*!
+ * Drives all four wheels at the given signed speeds in one pass: the
+ * arguments are validated once, each Motor's speed loop and H-bridge are
+ * stepped, and the new compare values are committed to all four timers
+ * together. This is the output stage of carControlStep, which passes the
+ * profiled wheel speeds; speeds applied directly are replaced on the next
+ * control tick.
+ *
+ * @param[in/out] pCar      Pointer to Car object
+ * @param[in]     speeds    Wheel speeds indexed by CAR_WHEEL_* (permille of
+ *                          full speed CAR_SPEED_MAX_MMPS, + forward)
+ *
+ * @return STATUS_OK if the speeds were applied
+ * @return STATUS_ERR_INVALID_PTR if either pointer is NULL
+ */
+typedef STATUS CarApplyWheelSpeeds(Car *pCar,
+                                   const int16_t speeds[CAR_NUM_WHEELS]);
+
+/*!
+ * Selects the motion profile the Car's wheel speeds follow. Takes effect on
+ * the next control tick, from the wheels' current speeds.
+ *
+ * @param[in/out] pCar      Pointer to Car object
+ * @param[in]     pProfile  Pointer to profile to follow (i.e. carProfileSoft)
+ */
+typedef void CarProfileSet(Car *pCar, const CAR_PROFILE *pProfile);
+
+/*!
+ * Sets how much the Car softens turns as its linear speed rises. At full
+ * speed the turn rate is reduced by turnScale permille, and proportionally
+ * less at lower speeds. 0 (the default) disables the scaling.
+ *
+ * @param[in/out] pCar      Pointer to Car object
+ * @param[in]     turnScale Turn reduction at full speed (permille, 0-1000)
+ */
+typedef void CarTurnScaleSet(Car *pCar, uint16_t turnScale);
+
+/*!
+ * Calibrates every wheel's Motor (@ref MotorCalibrate) in turn, then trims
+ * each down to the top speed of the slowest, so that both sides match and
+ * the car drives straight, and saves each wheel's calibration to the EEPROM
+ * slot of its CAR_WHEEL_* index. The car is brought to rest first.
+ *
+ * Blocks for several seconds per wheel, so must be called from the main
+ * loop, with the wheels off the ground and the control tick running.
+ *
+ * @param[in/out] pCar      Pointer to Car object
+ *
+ * @return STATUS_OK if every wheel was calibrated and saved
+ * @return STATUS_ERR_INVALID_PTR if pCar is NULL
+ * @return STATUS_ERR_GENERAL if a wheel could not be calibrated, leaving
+ *         the EEPROM as it was
+ */
+typedef STATUS CarCalibrate(Car *pCar);
+
+/*!
+ * Enables or disables the Car's traction control. While enabled, each
+ * wheel's measured speed (@ref MotorSpeedFresh) is compared, as a share of
+ * its commanded speed, with the share of the gripping wheels (the lowest,
+ * or with three or more wheels judged the second lowest) and with the
+ * command itself. A wheel turning well ahead of both is spinning rather
+ * than gripping: it is flagged as slipping, and its Motor's demand is cut
+ * (@ref MotorDemandMaxSet) on that control tick, and again each time a new
+ * measurement finds it still slipping. Once it grips, the cut is restored
+ * gradually.
+ *
+ * The wheels are judged on every tick, each from its latest measurement,
+ * so a wheel is cut on the tick its speed estimate shows it slipping, and
+ * the cut takes effect at the next step of its Motor. Wheels without speed
+ * feedback are never judged. Enabled by default.
+ *
+ * @param[in/out] pCar      Pointer to Car object
+ * @param[in]     bEnable   true to enable traction control, false to
+ *                          disable it and restore every cut
+ */
+typedef void CarTractionSet(Car *pCar, bool bEnable);
+
+/*!
+ * Gets which of the Car's wheels traction control last found slipping
+ *
+ * @param[in] pCar      Pointer to Car object
+ *
+ * @return a mask of the slipping wheels, bit n set for wheel CAR_WHEEL_* n,
+ *         or 0 if pCar is NULL
+ */
+typedef uint8_t CarSlipGet(Car *pCar);
+
+/*!
+ * Sets the silence window of the Car's dead-man failsafe. Every drive
+ * command accepted by carCommand, carCommandArc or carCommandHolonomic is
+ * timestamped; once none has been accepted for the window, the control tick
+ * ramps the car to a stop in CAR_FAILSAFE_RAMP_MS and drops the last
+ * command, so nothing re-applies it. The next command accepted drives the
+ * car again. A controller holding a steady course must therefore repeat its
+ * command, with a new sequence number, well within the window.
+ *
+ * Drives called directly rather than commanded (i.e. carDrive) neither
+ * hold off the failsafe nor re-arm it once it has stopped the car. The
+ * failsafe is armed with CAR_FAILSAFE_MS at construction; its worst-case
+ * stop latency is documented with CAR_FAILSAFE_MS.
+ *
+ * @param[in/out] pCar      Pointer to Car object
+ * @param[in]     ms        Silence window (ms), or 0 to disable the failsafe
+ */
+typedef void CarFailsafeSet(Car *pCar, uint16_t ms);
+
 /* ------------------------ STRUCT DEFINITIONS  ----------------------------- */
 
 /*!
@@ -61,23 +527,156 @@ typedef void CarDrive(Car *pCar, uint8_t speed, uint8_t direction);
 struct Car
 {
     // Car's speed as a percentage of its maximum speed
-    uint8_t        speed;
+    uint8_t               speed;
 
     // Direction in which Car is driving
-    uint8_t        direction;
+    uint8_t               direction;
 
-    // Pointers to each of the Car's Motor's
-    Motor         *pFrontLeft;
-    Motor         *pFrontRight;
-    Motor         *pBackLeft;
-    Motor         *pBackRight;
+    //
+    // Sequence number of the most recently accepted drive command, valid
+    // once bSeqValid is set
+    //
+    uint8_t               seq;
+    bool                  bSeqValid;
 
-    // Method to drive car given speed and direction
-    CarDrive      *carDrive;
+    // Latest accepted drive command not yet applied to the motors
+    bool                  bPending;
+    int16_t               pendingLinear;
+    int16_t               pendingStrafe;
+    int16_t               pendingTurn;
+
+    // Drive mode (one of CAR_MODE_*)
+    uint8_t               mode;
+
+    // Motion the Car is driving (permille of full speed)
+    int16_t               linear;
+    int16_t               strafe;
+    int16_t               turn;
+
+    // Turn reduction at full linear speed (permille)
+    uint16_t              turnScale;
+
+    //
+    // Top speed currently allowed by the BLE link and by the battery (as %
+    // of total speed); the lower of the two applies
+    //
+    uint8_t               maxSpeed;
+    uint8_t               supplyMaxSpeed;
+
+    // Motion profile and per-wheel profile state (fixed-point speed units)
+    CAR_PROFILE           profile;
+    int16_t               wheelTarget[CAR_NUM_WHEELS];
+    int16_t               wheelSpeed[CAR_NUM_WHEELS];
+    int16_t               wheelAccel[CAR_NUM_WHEELS];
+
+    //
+    // Traction control: whether enabled, the wheels found slipping, the
+    // wheels with a share to judge, each wheel's share of its commanded
+    // speed as last measured, and the demand each wheel's Motor is capped
+    // at (permille)
+    //
+    bool                  bTraction;
+    uint8_t               slipMask;
+    uint8_t               tractionMask;
+    uint16_t              tractionShare[CAR_NUM_WHEELS];
+    uint16_t              demandMax[CAR_NUM_WHEELS];
+
+    //
+    // Dead-man failsafe: the tick the last drive command was accepted on,
+    // whether it came from carCommandLegacy, the silence window (ticks, 0
+    // when disabled), and whether it has stopped the car since
+    //
+    uint32_t              cmdTick;
+    bool                  bCmdLegacy;
+    uint16_t              failsafeTicks;
+    bool                  bFailsafe;
+
+    // Pointers to each of the Car's Motor's, indexed by CAR_WHEEL_*
+    Motor                *pMotors[CAR_NUM_WHEELS];
+
+    // The Motors' PWMs, indexed by CAR_WHEEL_*, committed together
+    PWM                  *pPwms[CAR_NUM_WHEELS];
+
+#if METHOD_POINTERS
+    // Methods to drive car given speed and direction, along an arc, or
+    // holonomically
+    CarDrive             *carDrive;
+    CarDriveArc          *carDriveArc;
+    CarDriveHolonomic    *carDriveHolonomic;
+
+    // Method to select the drive mode
+    CarModeSet           *carModeSet;
+
+    // Method to derate top speed from the BLE link quality
+    CarLinkQualityDerate *carLinkQualityDerate;
+
+    // Method to compensate for and derate on the battery voltage
+    CarSupplyDerate      *carSupplyDerate;
+
+    // Methods to submit sequenced drive commands and apply the latest one
+    CarCommand           *carCommand;
+    CarCommandArc        *carCommandArc;
+    CarCommandHolonomic  *carCommandHolonomic;
+    CarCommandSeqReset   *carCommandSeqReset;
+    CarCommandLegacy     *carCommandLegacy;
+    CarCommandRefresh    *carCommandRefresh;
+    CarUpdate            *carUpdate;
+
+    // Method run on every control tick
+    CarControlStep       *carControlStep;
+
+    // Method to drive all four wheels at once
+    CarApplyWheelSpeeds  *carApplyWheelSpeeds;
+
+    // Method to select the motion profile
+    CarProfileSet        *carProfileSet;
+
+    // Method to set the speed-dependent turn scaling
+    CarTurnScaleSet      *carTurnScaleSet;
+
+    // Method to calibrate the wheels' Motors
+    CarCalibrate         *carCalibrate;
+
+    // Methods for traction control
+    CarTractionSet       *carTractionSet;
+    CarSlipGet           *carSlipGet;
+
+    // Method to set the dead-man failsafe's window
+    CarFailsafeSet       *carFailsafeSet;
+#endif
 };
 
 /* ------------------------ FUNCTION PROTOTYPES ----------------------------- */
-CarConstruct carConstruct;
-CarDrive     carDrive;
+CarConstruct         carConstruct;
+CarDrive             carDrive;
+CarDriveArc          carDriveArc;
+CarDriveHolonomic    carDriveHolonomic;
+CarModeSet           carModeSet;
+CarLinkQualityDerate carLinkQualityDerate;
+CarSupplyDerate      carSupplyDerate;
+CarCommand           carCommand;
+CarCommandArc        carCommandArc;
+CarCommandHolonomic  carCommandHolonomic;
+CarCommandSeqReset   carCommandSeqReset;
+CarCommandLegacy     carCommandLegacy;
+CarCommandRefresh    carCommandRefresh;
+CarUpdate            carUpdate;
+CarControlStep       carControlStep;
+CarApplyWheelSpeeds  carApplyWheelSpeeds;
+CarProfileSet        carProfileSet;
+CarTurnScaleSet      carTurnScaleSet;
+CarCalibrate         carCalibrate;
+CarTractionSet       carTractionSet;
+CarSlipGet           carSlipGet;
+CarFailsafeSet       carFailsafeSet;
+
+/* ------------------------ EXTERNS ----------------------------------------- */
+
+/*!
+ * Built-in motion profiles: a gentle S-curve for indoor driving, and a fast
+ * trapezoidal ramp for open floor
+ */
+extern const CAR_PROFILE carProfileSoft;
+extern const CAR_PROFILE carProfileAggressive;
 
 #endif // _CAR_H_
@@ -20,6 +20,67 @@
 #define STATUS_ERR_GENERAL     (-1)
 #define STATUS_ERR_INVALID_PTR (-2)
 
+/*!
+ * Arithmetic helpers
+ *
+ * @note arguments may be evaluated more than once
+ */
+#define ABS(x)              (((x) < 0) ? -(x) : (x))
+#define MIN(a, b)           (((a) < (b)) ? (a) : (b))
+#define MAX(a, b)           (((a) > (b)) ? (a) : (b))
+#define CLAMP(x, lo, hi)    (((x) < (lo)) ? (lo) : (((x) > (hi)) ? (hi) : (x)))
+
+/*!
+ * Set to 1 to dispatch the methods of the Motor, PWM, Car, LCD and BLE
+ * objects at compile time: calls made through METHOD or METHOD_AS become
+ * direct calls the compiler may inline, rather than indirect calls through
+ * the objects' method pointers. The pointers are still constructed, so
+ * pObj->method(...) keeps compiling and behaving as before.
+ */
+#ifndef STATIC_DISPATCH
+#define STATIC_DISPATCH     (0)
+#endif
+
+/*!
+ * Set to 0, along with STATIC_DISPATCH, to compile the method pointers out
+ * of the objects as well, saving 2 bytes of SRAM per method per object:
+ * 252 bytes for the car's 4 PWMs (6 methods each), 4 Motors (18), Car (21)
+ * and BLE (9), and 14 more per LCD (7).
+ *
+ * @warning This breaks the API: pObj->method(...) no longer compiles, as
+ *          the objects have no method members; every call must go through
+ *          METHOD or METHOD_AS.
+ *
+ * @note Flash and cycle figures come from avr-size (make size) and the
+ *       car_test and pwm_test benchmarks, built with each setting.
+ */
+#ifndef METHOD_POINTERS
+#define METHOD_POINTERS     (1)
+#endif
+
+#if !METHOD_POINTERS && !STATIC_DISPATCH
+#error "METHOD_POINTERS may only be cleared along with STATIC_DISPATCH"
+#endif
+
+/*!
+ * Resolves a method of an object, for calls that build either way
+ *
+ * @param[in] pObj      Pointer to the object
+ * @param[in] method    Name of the object's method pointer
+ * @param[in] func      Function the method pointer is constructed with, when
+ *                      it is not named after the method
+ *
+ * i.e. METHOD(pLcd, lcdClear)(pLcd) or
+ *      METHOD_AS(pMotor, drive, motorDrive)(pMotor, speed)
+ */
+#if STATIC_DISPATCH
+#define METHOD_AS(pObj, method, func)   (func)
+#else
+#define METHOD_AS(pObj, method, func)   ((pObj)->method)
+#endif
+
+#define METHOD(pObj, method)            METHOD_AS(pObj, method, method)
+
 /*!
  * Sets a bit high for a given byte
  *
@@ -179,4 +240,37 @@ char * stringcat(char *dst, const char *src1, const char *src2);
  */
 uint16_t string2int(const char *str);
 
+/*!
+ * Converts a string with an optional leading '-' into the corresponding
+ * signed integer
+ *
+ * @param[in] str
+ *
+ * @return signed integer representation of str
+ *
+ * @note conversion stops at the first character that does not belong to the
+ *       set {0,1,2,...,9}, so trailing text (i.e. "\r\nOK") is ignored
+ */
+int16_t string2sint(const char *str);
+
+/*!
+ * Converts a signed integer into its decimal string representation
+ *
+ * @param[in/out] dst   The destination string (at least 7 bytes long)
+ * @param[in]     val   The value to convert
+ *
+ * @return Pointer to the NULL byte written to dst
+ */
+char * int2string(char *dst, int16_t val);
+
+/*!
+ * Converts an unsigned integer into its decimal string representation
+ *
+ * @param[in/out] dst   The destination string (at least 11 bytes long)
+ * @param[in]     val   The value to convert
+ *
+ * @return Pointer to the NULL byte written to dst
+ */
+char * uint2string(char *dst, uint32_t val);
+
 #endif /* _COMMON_UTILS_H_ */
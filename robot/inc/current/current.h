@@ -0,0 +1,60 @@
+/* Header file for the cycle-by-cycle motor current limit */
+
+#ifndef _CURRENT_H_
+#define _CURRENT_H_
+
+/* ------------------------ INCLUDES ---------------------------------------- */
+#include "pwm/pfcpwm.h"
+#include "common/utils.h"
+
+/* ------------------------ MACROS AND DEFINES ------------------------------ */
+
+/*!
+ * The motors' supply returns through a shared shunt, whose amplified
+ * voltage is compared with the 1.1 V bandgap by the analog comparator on
+ * AIN1 (PE3). With a 0.05 ohm shunt and a gain of 10, the limit trips at
+ * 2.2 A.
+ *
+ * The comparator interrupts as the shunt voltage rises through the
+ * bandgap, and every motor PWM is chopped for the rest of its carrier
+ * period (@ref pwmChop). The outputs fall 4 to 12 us after the trip, one
+ * PWM after another. The control tick's handler re-enables interrupts once
+ * its time-critical part is done, so the comparator preempts the rest of
+ * it, and waits at most for that part or for the drivers' longest atomic
+ * section.
+ */
+#define CURRENT_LIMIT_TRIP_MV   (1100)
+#define CURRENT_LIMIT_MAX       (4)
+
+/* ------------------------ TYPEDEFS ---------------------------------------- */
+
+/*!
+ * Starts limiting the current of a group of PWMs
+ *
+ * @param[in] pPwms     array of pointers to initialized PWM objects,
+ *                      chopped together on a trip
+ * @param[in] numPwms   number of PWM objects in pPwms (up to
+ *                      CURRENT_LIMIT_MAX)
+ *
+ * @return STATUS_OK if the limit was started
+ * @return STATUS_ERR_INVALID_PTR if pPwms is NULL
+ * @return STATUS_ERR_GENERAL if numPwms is invalid
+ *
+ * @note The pins of the PWMs' outputs must be left low in their PORT
+ *       registers, as they are from reset
+ */
+typedef STATUS CurrentLimitInit(PWM *const pPwms[], uint8_t numPwms);
+
+/*!
+ * Gets the number of times the limit has tripped, for telemetry. Trips
+ * while the outputs are still chopped from the last one are not counted.
+ *
+ * @return the number of trips since currentLimitInit (wraps)
+ */
+typedef uint32_t CurrentLimitEventsGet(void);
+
+/* ------------------------ FUNCTION PROTOTYPES ----------------------------- */
+CurrentLimitInit      currentLimitInit;
+CurrentLimitEventsGet currentLimitEventsGet;
+
+#endif // _CURRENT_H_
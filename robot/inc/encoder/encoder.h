@@ -0,0 +1,95 @@
+/* Header file for the wheel encoders */
+
+#ifndef _ENCODER_H_
+#define _ENCODER_H_
+
+/* ------------------------ INCLUDES ---------------------------------------- */
+#include "common/utils.h"
+
+/* ------------------------ MACROS AND DEFINES ------------------------------ */
+
+/*!
+ * Quadrature encoders, read through pin change interrupt 2 on PORTK. Encoder
+ * n has its A channel on PK(2n) and its B channel on PK(2n+1).
+ *
+ * Only the A channels interrupt, and B gives the direction, so each encoder
+ * counts two edges per quadrature cycle at half the interrupt rate of
+ * counting every edge. Swapping A and B reverses the sign of an encoder.
+ *
+ * The input capture units cannot time the edges, since all four 16-bit
+ * timers generate motor PWM; edges are timestamped from the control tick's
+ * timer instead.
+ */
+#define ENCODER_NUM             (4)
+#define ENCODER_A_MASK          (0x55)
+
+/*!
+ * Speed estimates are in edges per second, scaled by 2^ENCODER_SPEED_FRAC_BITS
+ */
+#define ENCODER_SPEED_FRAC_BITS (4)
+
+/*!
+ * Time without an edge after which an encoder's wheel is taken as stopped
+ */
+#define ENCODER_STOP_MS         (100)
+
+/* ------------------------ TYPEDEFS ---------------------------------------- */
+
+/*!
+ * Initializes the encoder inputs and starts counting
+ *
+ * @return STATUS_OK if the encoders were started
+ * @return STATUS_ERR_GENERAL if the control tick is not running
+ *
+ * @note The control tick must be initialized first, since edges are
+ *       timestamped from its timer
+ */
+typedef STATUS EncoderInit(void);
+
+/*!
+ * Updates the speed estimate of one encoder, in turn. Each estimate spans
+ * ENCODER_NUM calls, and divides the edges counted by the time between the
+ * last edges of consecutive estimates, so it is precise at high speeds and
+ * at low ones. Without an edge, an estimate decays to one edge over the time
+ * since the last edge, and to 0 after ENCODER_STOP_MS.
+ *
+ * @note Must be run on every control tick
+ * @note A wheel starting from rest reads 0 for one estimate
+ */
+typedef void EncoderUpdate(void);
+
+/*!
+ * Gets the speed estimate of an encoder
+ *
+ * @param[in] idx   Index of the encoder
+ *
+ * @return the signed speed in edges per second, scaled by
+ *         2^ENCODER_SPEED_FRAC_BITS, or 0 for an invalid index
+ */
+typedef int32_t EncoderSpeedGet(uint8_t idx);
+
+/*!
+ * Gets the position of an encoder, as of its last speed estimate
+ *
+ * @param[in] idx   Index of the encoder
+ *
+ * @return the signed number of edges counted since encoderInit, or 0 for an
+ *         invalid index
+ */
+typedef int32_t EncoderPositionGet(uint8_t idx);
+
+/*!
+ * Gets which encoder's speed estimate the last encoderUpdate refreshed
+ *
+ * @return the index of the encoder
+ */
+typedef uint8_t EncoderFreshGet(void);
+
+/* ------------------------ FUNCTION PROTOTYPES ----------------------------- */
+EncoderInit        encoderInit;
+EncoderUpdate      encoderUpdate;
+EncoderSpeedGet    encoderSpeedGet;
+EncoderPositionGet encoderPositionGet;
+EncoderFreshGet    encoderFreshGet;
+
+#endif // _ENCODER_H_
@@ -0,0 +1,90 @@
+/* Header file for the emergency stop */
+
+#ifndef _ESTOP_H_
+#define _ESTOP_H_
+
+/* ------------------------ INCLUDES ---------------------------------------- */
+#include "pwm/pfcpwm.h"
+#include "common/utils.h"
+
+/* ------------------------ MACROS AND DEFINES ------------------------------ */
+
+/*!
+ * The e-stop switch, where one is wired, is normally closed, between INT0
+ * (PD0) and ground, with the pin's pull-up enabled. Pressing it, or a
+ * broken wire, lets the pin rise, and the rising edge trips the e-stop.
+ * Without a switch, the e-stop is tripped only by estopTrigger.
+ *
+ * A trip halts every motor PWM (@ref pwmHalt) straight from the external
+ * interrupt, without passing through the Car, the AT command path or the
+ * main loop. INT0 is the highest priority interrupt, and the outputs fall
+ * 3 to 10 us after the edge, one PWM after another. Like every interrupt,
+ * it waits out any code running with interrupts disabled. The control tick
+ * and BLE handlers each re-enable interrupts after their time-critical
+ * part, so the e-stop waits at most for that part or for the longest
+ * atomic section in the drivers (i.e. a group's PWM commit), not for a
+ * whole tick. That wait has not been measured on the car.
+ */
+#define ESTOP_PORT      PORTD
+#define ESTOP_PIN       PIND
+#define ESTOP_DDR       DDRD
+#define ESTOP_BIT       (0)
+
+#define ESTOP_MAX       (4)
+
+/* ------------------------ TYPEDEFS ---------------------------------------- */
+
+/*!
+ * Arms the e-stop over a group of PWMs. If the switch is sensed and already
+ * open, the e-stop trips at once.
+ *
+ * @param[in] pPwms     array of pointers to initialized PWM objects, halted
+ *                      together on a trip
+ * @param[in] numPwms   number of PWM objects in pPwms (up to ESTOP_MAX)
+ * @param[in] bSwitch   true to sense the switch, which must then be wired;
+ *                      false leaves its pin alone, as an unwired pin would
+ *                      read open and trip the e-stop
+ *
+ * @return STATUS_OK if the e-stop was armed
+ * @return STATUS_ERR_INVALID_PTR if pPwms is NULL
+ * @return STATUS_ERR_GENERAL if numPwms is invalid
+ *
+ * @note The pins of the PWMs' outputs must be left low in their PORT
+ *       registers, as they are from reset
+ */
+typedef STATUS EstopInit(PWM *const pPwms[], uint8_t numPwms, bool bSwitch);
+
+/*!
+ * Trips the e-stop from software, as the switch would, i.e. on an e-stop
+ * request received from the controller over BLE. May be called from any
+ * context.
+ */
+typedef void EstopTrigger(void);
+
+/*!
+ * Gets whether the e-stop has tripped and not been cleared
+ *
+ * @return true if the motor PWMs are halted by the e-stop, else false
+ */
+typedef bool EstopActiveGet(void);
+
+/*!
+ * Clears a tripped e-stop, reconnecting the motor PWMs. The e-stop is
+ * latched, so the motors stay off after the switch is released until this
+ * is called.
+ *
+ * @return STATUS_OK if the e-stop was cleared, or was not tripped
+ * @return STATUS_ERR_GENERAL if the switch is sensed and still open
+ *
+ * @note The Car drops its drive command while the e-stop is tripped, so
+ *       the wheels are at rest on clearing until the next command
+ */
+typedef STATUS EstopClear(void);
+
+/* ------------------------ FUNCTION PROTOTYPES ----------------------------- */
+EstopInit      estopInit;
+EstopTrigger   estopTrigger;
+EstopActiveGet estopActiveGet;
+EstopClear     estopClear;
+
+#endif // _ESTOP_H_
@@ -173,6 +173,7 @@ struct LCD
     // Pointer to UART object
     UART *uart;
 
+#if METHOD_POINTERS
     LcdCursorCmdSend    *lcdCursorCmdSend;
     LcdBacklightCmdSend *lcdBacklightCmdSend;
     LcdDisplayCmdSend   *lcdDisplayCmdSend;
@@ -180,6 +181,7 @@ struct LCD
     LcdWrite            *lcdWrite;
     LcdPrintln          *lcdPrintln;
     LcdClear            *lcdClear;
+#endif
 };
 
 /* ------------------------ FUNCTION PROTOTYPES ----------------------------- */
@@ -7,6 +7,9 @@
 #include <avr/io.h>
 
 #include "pwm/pfcpwm.h"
+#include "tick/tick.h"
+#include "encoder/encoder.h"
+#include "bemf/bemf.h"
 #include "common/utils.h"
 
 /* ------------------------ TYPE DEFINITIONS -------------------------------- */
@@ -16,6 +19,54 @@
  */
 typedef struct Motor Motor;
 
+/*!
+ * Gains of the Motor's speed loop, and its feed-forward duty map
+ *
+ * The duty map gives the open-loop duty cycle for a speed, as
+ * ffOffset + ffGain * |speed|, and the PID loop corrects it from the wheel's
+ * measured speed. Gains are permille of duty per mm/s, scaled by
+ * 2^MOTOR_PID_FRAC_BITS; ki and kd are per run of the loop
+ * (MOTOR_PID_TICKS control ticks).
+ */
+typedef struct MOTOR_PID
+{
+    uint16_t kp;
+    uint16_t ki;
+    uint16_t kd;
+    uint16_t ffGain;
+    uint16_t ffOffset;
+} MOTOR_PID;
+
+/*!
+ * Number of segments in a Motor's linearising curve
+ */
+#define MOTOR_CAL_POINTS                (8)
+
+/*!
+ * Calibration of a Motor's duty cycles
+ *
+ * Every duty cycle the Motor drives at (a demand) is scaled by the trim and
+ * then mapped through a piecewise-linear curve onto the duty cycle sent to
+ * the H-bridge. The curve starts at minDuty, just above 0, so the smallest
+ * demand already turns the motor, and passes through curve[k] at demand
+ * (k + 1) / MOTOR_CAL_POINTS, so the wheel's speed rises in proportion to
+ * the demand. The trim slows the faster motors to match the slowest.
+ */
+typedef struct MOTOR_CAL
+{
+    // Duty cycle at which the motor starts from rest (permille)
+    uint16_t minDuty;
+
+    // Duty cycles along the curve (permille), never decreasing
+    uint16_t curve[MOTOR_CAL_POINTS];
+
+    // Scale of each demand, where MOTOR_CAL_TRIM_UNITY is 1
+    uint16_t trim;
+
+    // Wheel speed at full duty, as measured (mm/s)
+    uint16_t topSpeed;
+} MOTOR_CAL;
+
 /*!
  * Type definition for the Motor object's constructor
  *
@@ -44,7 +95,11 @@ typedef STATUS MotorDriveForward(Motor *pMotor, uint8_t speed);
 typedef STATUS MotorDriveReverse(Motor *pMotor, uint8_t speed);
 
 /*!
- * Type definition for the Motor object's stop method
+ * Type definition for the Motor object's stop method. Brakes, driving both
+ * sides of the H-bridge together at full duty from the next call to step,
+ * rather than releasing them: the wheel stops in tens of milliseconds
+ * instead of coasting for seconds, at the cost of a braking current of up
+ * to the stall current. Use coast to release the motor instead.
  *
  * @param[in/out] pMotor    pointer to the Motor object to stop
  */
@@ -58,6 +113,231 @@ typedef STATUS MotorStop(Motor *pMotor);
  */
 typedef STATUS MotorChangeSpeed(Motor *pMotor, uint8_t speed);
 
+/*!
+ * Type definition for the Motor object's drive method. Requests a signed
+ * speed; the H-bridge follows on the next call to step. Driving in the
+ * direction opposite the one last driven first brakes for
+ * MOTOR_REVERSE_BRAKE_MS and then coasts for MOTOR_DEADTIME_MS, however
+ * long the motor has coasted or braked in between. A coast or brake request
+ * during a reversal is followed at once, and the reversal starts over on
+ * the next request to drive the other way.
+ *
+ * @param[in/out] pMotor    pointer to the Motor object to drive
+ * @param[in]     speed     speed to drive Motor (permille, + forward), where
+ *                          0 coasts
+ */
+typedef STATUS MotorDrive(Motor *pMotor, int16_t speed);
+
+/*!
+ * Type definition for the Motor object's brake method. Drives both sides of
+ * the H-bridge together, shorting the motor's windings so that its back-EMF
+ * opposes its rotation. Takes effect on the next call to step.
+ *
+ * @param[in/out] pMotor    pointer to the Motor object to brake
+ * @param[in]     strength  duty cycle both sides are driven at (permille)
+ */
+typedef STATUS MotorBrake(Motor *pMotor, uint16_t strength);
+
+/*!
+ * Type definition for the Motor object's coast method. Releases both sides of
+ * the H-bridge so the motor spins down freely. Takes effect on the next call
+ * to step.
+ *
+ * @param[in/out] pMotor    pointer to the Motor object to coast
+ */
+typedef STATUS MotorCoast(Motor *pMotor);
+
+/*!
+ * Type definition for the Motor object's step method. Advances the Motor's
+ * H-bridge state machine and applies its outputs; must be run once per
+ * control tick (@ref tick.h). Does nothing if pMotor is NULL.
+ *
+ * @param[in/out] pMotor    pointer to the Motor object to step
+ */
+typedef void MotorStep(Motor *pMotor);
+
+/*!
+ * Type definition for the Motor object's driveSpeed method. Requests a
+ * signed wheel speed, held by the Motor's speed loop from the next call to
+ * step. Without feedback (@ref MotorFeedbackSet) the duty cycle comes from
+ * the feed-forward duty map alone. The loop never drives against the
+ * requested direction; a change of direction reverses as for drive.
+ *
+ * @param[in/out] pMotor    pointer to the Motor object to drive
+ * @param[in]     mmps      speed to drive Motor (mm/s, + forward), where 0
+ *                          coasts
+ */
+typedef STATUS MotorDriveSpeed(Motor *pMotor, int16_t mmps);
+
+/*!
+ * Type definition for the Motor object's feedbackSet method. Selects what
+ * measures the Motor's wheel speed, closing its speed loop.
+ *
+ * @param[in/out] pMotor    pointer to the Motor object
+ * @param[in]     source    one of MOTOR_FEEDBACK_*
+ * @param[in]     idx       index of the wheel's encoder (@ref encoder.h) or
+ *                          back-EMF input (@ref bemf.h)
+ * @param[in]     scale     distance the wheel travels per encoder edge (um),
+ *                          or its speed per volt of back-EMF (mm/s)
+ *
+ * @return STATUS_ERR_GENERAL if source or idx is not valid
+ */
+typedef STATUS MotorFeedbackSet(Motor *pMotor, uint8_t source, uint8_t idx,
+                                uint16_t scale);
+
+/*!
+ * Type definition for the Motor object's pidSet method. Sets the gains of
+ * the speed loop and its duty map; may be called while the Motor runs.
+ *
+ * @param[in/out] pMotor    pointer to the Motor object
+ * @param[in]     pPid      pointer to the gains to copy
+ */
+typedef STATUS MotorPidSet(Motor *pMotor, const MOTOR_PID *pPid);
+
+/*!
+ * Type definition for the Motor object's speedGet method
+ *
+ * @param[in] pMotor    pointer to the Motor object
+ *
+ * @return the wheel's measured speed (mm/s, + forward), as of the last run
+ *         of the speed loop (every MOTOR_PID_TICKS), or 0 without feedback
+ */
+typedef int16_t MotorSpeedGet(Motor *pMotor);
+
+/*!
+ * Type definition for the Motor object's calSet method. Sets the Motor's
+ * calibration; may be called while the Motor runs.
+ *
+ * @param[in/out] pMotor    pointer to the Motor object
+ * @param[in]     pCal      pointer to the calibration to copy
+ *
+ * @return STATUS_ERR_GENERAL if the curve decreases or leaves 0..1000, or
+ *         the trim is 0
+ */
+typedef STATUS MotorCalSet(Motor *pMotor, const MOTOR_CAL *pCal);
+
+/*!
+ * Type definition for the Motor object's calLoad method. Loads the Motor's
+ * calibration from an EEPROM slot, as saved by calSave.
+ *
+ * @param[in/out] pMotor    pointer to the Motor object
+ * @param[in]     slot      EEPROM slot (0 to MOTOR_CAL_SLOTS - 1)
+ *
+ * @return STATUS_ERR_GENERAL if slot is invalid or holds no valid
+ *         calibration, leaving the Motor's calibration as it was
+ */
+typedef STATUS MotorCalLoad(Motor *pMotor, uint8_t slot);
+
+/*!
+ * Type definition for the Motor object's calSave method. Saves the Motor's
+ * calibration to an EEPROM slot, writing only the bytes that changed.
+ *
+ * @param[in] pMotor    pointer to the Motor object
+ * @param[in] slot      EEPROM slot (0 to MOTOR_CAL_SLOTS - 1)
+ *
+ * @return STATUS_ERR_GENERAL if slot is invalid
+ *
+ * @note Each changed byte takes about 3.4 ms to write, so must not be
+ *       called from the control tick
+ */
+typedef STATUS MotorCalSave(Motor *pMotor, uint8_t slot);
+
+/*!
+ * Type definition for the Motor object's calibrate method. Measures the
+ * Motor's minimum duty and linearising curve from its wheel speed feedback
+ * (@ref MotorFeedbackSet), driving forward: the duty rises by
+ * MOTOR_CAL_RAMP_STEP until the wheel turns at MOTOR_CAL_START_MMPS, and
+ * then the speed is measured at MOTOR_CAL_POINTS duties from there to full.
+ * Each duty is held for MOTOR_CAL_SETTLE_MS. The trim is left as it was.
+ *
+ * Blocks until done, typically 3 s, while the control tick drives the Motor;
+ * requests made meanwhile are overridden. The wheel should be off the
+ * ground and at rest.
+ *
+ * @param[in/out] pMotor    pointer to the Motor object
+ *
+ * @return STATUS_OK if the calibration was measured
+ * @return STATUS_ERR_GENERAL if the Motor has no feedback, interrupts are
+ *         disabled, another Motor is calibrating, or the wheel never turned
+ */
+typedef STATUS MotorCalibrate(Motor *pMotor);
+
+/*!
+ * Type definition for the function that compensates every Motor's duty
+ * cycles for the supply voltage. Driven duty cycles are specified at
+ * MOTOR_SUPPLY_NOMINAL_MV, and are scaled by MOTOR_SUPPLY_NOMINAL_MV /
+ * millivolts (up to MOTOR_SUPPLY_COMP_MAX) after calibration, so that a
+ * duty drives the motor at the same voltage however charged the battery.
+ * Duties beyond what the battery can supply are clipped at full.
+ *
+ * param[in] millivolts  the supply voltage (mV), or 0 to drive duty cycles
+ *                       as they are
+ */
+typedef void MotorSupplySet(uint16_t millivolts);
+
+/*!
+ * Type definition for the function that drives a group of Motors at signed
+ * wheel speeds and steps each one, as motorDriveSpeed followed by motorStep
+ * would. Nothing is checked per Motor: the caller validates the pointers
+ * once, and every Motor's PWM was checked at construction.
+ *
+ * param[in/out] pMotors    array of pointers to constructed Motor objects
+ * param[in]     mmps       speeds indexed as pMotors (mm/s, + forward)
+ * param[in]     numMotors  number of Motor objects in pMotors
+ */
+typedef void MotorDriveSpeeds(Motor *const pMotors[], const int16_t mmps[],
+                              uint8_t numMotors);
+
+/*!
+ * Type definition for the function that gets a wheel's speed when it was
+ * measured afresh on the last control tick, so that it can be acted on at
+ * once rather than at the next run of the speed loop. Encoders and back-EMF
+ * inputs are each refreshed in turn, one per tick (@ref EncoderUpdate,
+ * @ref BemfUpdate).
+ *
+ * @param[in]  pMotor   pointer to the Motor object
+ * @param[out] pSpeed   the wheel's measured speed (mm/s, + forward)
+ *
+ * @return true if pSpeed was set, or false if the wheel's speed has not
+ *         been measured since the last tick, or it has no feedback
+ *
+ * @note Must be called from the control tick, after encoderUpdate and
+ *       before bemfUpdate
+ */
+typedef bool MotorSpeedFresh(Motor *pMotor, int16_t *pSpeed);
+
+/*!
+ * Type definition for the Motor object's dutyLimitGet method. Gets the
+ * largest duty cycle the Motor's thermal model currently lets it drive.
+ *
+ * The model integrates the square of the duty cycle driven on every control
+ * tick, a stand-in for the I^2 t heating of the motor and its half of the
+ * driver, and cools with time constant 2^MOTOR_THERMAL_TAU_SHIFT ticks.
+ * Once the heat passes MOTOR_THERMAL_START_PCT of what running at
+ * MOTOR_THERMAL_RATED_DUTY settles at, the limit falls steadily from full,
+ * reaching the rated duty as the heat reaches it, so the motor settles at
+ * its rating rather than overheating. Brakes are never limited, but heat
+ * the model all the same.
+ *
+ * @param[in] pMotor    pointer to the Motor object
+ *
+ * @return the duty cycle limit (permille), or 0 if pMotor is NULL
+ */
+typedef uint16_t MotorDutyLimitGet(Motor *pMotor);
+
+/*!
+ * Type definition for the Motor object's demandMaxSet method. Caps the duty
+ * cycle the speed loop may demand, as for traction control. A demand above
+ * the new cap is cut to it at once, taking effect on the next call to step
+ * rather than the next run of the loop, and the loop's integral holds while
+ * the cap clamps its output.
+ *
+ * @param[in/out] pMotor    pointer to the Motor object
+ * @param[in]     demandMax largest duty cycle to demand (permille), where
+ *                          PWM_PERMILLE_FULL removes the cap
+ */
+typedef STATUS MotorDemandMaxSet(Motor *pMotor, uint16_t demandMax);
+
 /*!
  * Structure definition for the motor object
  */
@@ -75,9 +355,69 @@ struct Motor
     //
     uint8_t            bDirection;
 
+    // H-bridge state (one of MOTOR_STATE_*)
+    uint8_t            state;
+
+    // Ticks left in a timed reversal state
+    uint16_t           stateTicks;
+
+    //
+    // Direction last driven (MOTOR_STATE_FORWARD or _REVERSE), which the
+    // rotor may still be turning in, or MOTOR_STATE_COAST if never driven
+    //
+    uint8_t            driveState;
+
+    //
+    // Requested state (MOTOR_STATE_FORWARD, _REVERSE, _COAST or _BRAKE) and
+    // its duty cycle (permille), with the fraction of a permille the speed
+    // loop computed beyond it (in 1/2^MOTOR_PID_FRAC_BITS)
+    //
+    uint8_t            cmdState;
+    uint16_t           cmdDuty;
+    uint8_t            cmdDutyFrac;
+
+    //
+    // Whether the requested duty cycle comes from the speed loop, and the
+    // loop's requested speed (mm/s)
+    //
+    bool               bSpeedCmd;
+    int16_t            cmdSpeed;
+
+    //
+    // Source of the wheel's measured speed (one of MOTOR_FEEDBACK_*), the
+    // index of its encoder or back-EMF input, and its scale
+    //
+    uint8_t            feedback;
+    uint8_t            feedbackIdx;
+    uint16_t           feedbackScale;
+
+    //
+    // Speed loop gains and state: the integral term (scaled as the gains),
+    // the last measured speed (mm/s), and the ticks until the next run
+    //
+    MOTOR_PID          pid;
+    int32_t            pidInteg;
+    int16_t            pidSpeedLast;
+    uint8_t            pidTicks;
+
+    // Largest duty cycle the speed loop may demand (permille)
+    uint16_t           demandMax;
+
+    // Calibration of the duty cycles driven
+    MOTOR_CAL          cal;
+
+    //
+    // Thermal model: the integrated square of the duty cycles driven,
+    // scaled by 2^MOTOR_THERMAL_FRAC_BITS, and the resulting duty cycle
+    // limit (permille)
+    //
+    uint32_t           thermalHeat;
+    uint16_t           dutyLimit;
+
     // PWM object to control motor speed and direction
     PWM               *pPwm;
 
+#if METHOD_POINTERS
     // Method to drive motor forward
     MotorDriveForward *driveForward;
 
@@ -89,6 +429,33 @@ struct Motor
 
     // Method to change the motor's speed
     MotorChangeSpeed  *changeSpeed;
+
+    // Methods to request a signed speed, a brake or a coast
+    MotorDrive        *drive;
+    MotorBrake        *brake;
+    MotorCoast        *coast;
+
+    // Method run on every control tick
+    MotorStep         *step;
+
+    // Methods for closed-loop speed control
+    MotorDriveSpeed   *driveSpeed;
+    MotorFeedbackSet  *feedbackSet;
+    MotorPidSet       *pidSet;
+    MotorSpeedGet     *speedGet;
+
+    // Methods to calibrate the duty cycles and keep the calibration
+    MotorCalSet       *calSet;
+    MotorCalLoad      *calLoad;
+    MotorCalSave      *calSave;
+    MotorCalibrate    *calibrate;
+
+    // Method to get the thermal duty cycle limit
+    MotorDutyLimitGet *dutyLimitGet;
+
+    // Method to cap the speed loop's demand
+    MotorDemandMaxSet *demandMaxSet;
+#endif
 };
 
 /* ------------------------ MACROS AND DEFINES ------------------------------ */
@@ -97,11 +464,132 @@ struct Motor
 #define DEFAULT_SPEED   (0)
 #define DEFAULT_DIR     FORWARD_DIR
 
+/*!
+ * H-bridge states
+ *
+ * COAST:             both sides released
+ * FORWARD, REVERSE:  one side driven at the requested duty cycle
+ * BRAKE:             both sides driven together
+ * REVERSAL_BRAKE:    full brake on the way to the opposite direction
+ * REVERSAL_DEADTIME: both sides released after a reversal brake, letting
+ *                    the winding current decay before driving the other way
+ */
+#define MOTOR_STATE_COAST               (0)
+#define MOTOR_STATE_FORWARD             (1)
+#define MOTOR_STATE_REVERSE             (2)
+#define MOTOR_STATE_BRAKE               (3)
+#define MOTOR_STATE_REVERSAL_BRAKE      (4)
+#define MOTOR_STATE_REVERSAL_DEADTIME   (5)
+
+/*!
+ * Duration of the brake and dead-time phases of a reversal. A reversal can
+ * never stop the wheel sooner than driving straight against it, so the
+ * brake trades stopping time for current. On the host model of the motor
+ * in test/motor_test/motor_plant.c (not measured on the car), a full-speed
+ * reversal peaks at 6.5 A and stops in 13 ms driven directly; this brake
+ * takes it to 5.2 A and 21 ms, where 30 ms would reach 4.0 A but take
+ * 36 ms. Stopping by braking (@ref MotorStop) takes 57 ms, against about
+ * 3 s coasting.
+ */
+#define MOTOR_REVERSE_BRAKE_MS          (10)
+#define MOTOR_DEADTIME_MS               (2)
+
+/*!
+ * Converts milliseconds to whole control ticks, rounding up
+ */
+#define MOTOR_MS_TO_TICKS(ms) \
+        ((uint16_t)((((uint32_t)(ms) * TICK_HZ) + 999) / 1000))
+
+/*!
+ * Speed loop settings
+ *
+ * The loop runs once per ENCODER_NUM ticks, the period of each encoder's
+ * speed estimate and of each motor's back-EMF sample. The default duty map
+ * drives MOTOR_SPEED_MAX_MMPS at full duty, which is 1 mm/s per permille,
+ * as the Motor behaved open loop.
+ */
+#define MOTOR_PID_FRAC_BITS             (8)
+#define MOTOR_PID_TICKS                 (ENCODER_NUM)
+#define MOTOR_SPEED_MAX_MMPS            (1000)
+
+/*!
+ * Sources of a Motor's measured wheel speed
+ *
+ * NONE:    open loop, on the duty map alone
+ * ENCODER: a quadrature wheel encoder (@ref encoder.h)
+ * BEMF:    the motor's back-EMF, sampled while coasting (@ref bemf.h)
+ */
+#define MOTOR_FEEDBACK_NONE             (0)
+#define MOTOR_FEEDBACK_ENCODER          (1)
+#define MOTOR_FEEDBACK_BEMF             (2)
+
+/*!
+ * Calibration settings
+ *
+ * MOTOR_CAL_TRIM_UNITY:  trim leaving demands unscaled
+ * MOTOR_CAL_SLOTS:       calibrations kept in EEPROM, one per wheel
+ * MOTOR_CAL_RAMP_STEP:   duty step searching for the minimum duty (permille)
+ * MOTOR_CAL_START_MMPS:  wheel speed at which the motor has started
+ * MOTOR_CAL_SETTLE_MS:   time each duty is held before measuring the speed
+ */
+#define MOTOR_CAL_TRIM_FRAC_BITS        (10)
+#define MOTOR_CAL_TRIM_UNITY            (1 << MOTOR_CAL_TRIM_FRAC_BITS)
+#define MOTOR_CAL_SLOTS                 (4)
+#define MOTOR_CAL_RAMP_STEP             (10)
+#define MOTOR_CAL_START_MMPS            (20)
+#define MOTOR_CAL_SETTLE_MS             (100)
+
+/*!
+ * Supply compensation settings (@ref MotorSupplySet). The nominal voltage
+ * is that of a 2S pack part way down its discharge, so full speed is
+ * reachable for most of a run. The compensation is capped at 1.5, beyond
+ * which the reading is more likely wrong than the battery that flat.
+ */
+#define MOTOR_SUPPLY_NOMINAL_MV         (7200)
+#define MOTOR_SUPPLY_COMP_FRAC_BITS     (10)
+#define MOTOR_SUPPLY_COMP_MAX           (3 << (MOTOR_SUPPLY_COMP_FRAC_BITS - 1))
+
+/*!
+ * Thermal model settings (@ref MotorDutyLimitGet). The time constant is
+ * about 16 s at the default TICK_HZ, that of a small geared motor's
+ * windings, and the derating starts about 7 s into a run at full duty.
+ */
+#define MOTOR_THERMAL_TAU_SHIFT         (14)
+#define MOTOR_THERMAL_FRAC_BITS         (8)
+#define MOTOR_THERMAL_RATED_DUTY        (700)
+#define MOTOR_THERMAL_START_PCT         (75)
+
+#define MOTOR_PID_GAIN(g)   ((uint16_t)((g) * (1 << MOTOR_PID_FRAC_BITS)))
+
+#define MOTOR_PID_KP_DEFAULT            MOTOR_PID_GAIN(0.5)
+#define MOTOR_PID_KI_DEFAULT            MOTOR_PID_GAIN(0.05)
+#define MOTOR_PID_KD_DEFAULT            MOTOR_PID_GAIN(0)
+#define MOTOR_PID_FF_GAIN_DEFAULT \
+        MOTOR_PID_GAIN((double)PWM_PERMILLE_FULL / MOTOR_SPEED_MAX_MMPS)
+#define MOTOR_PID_FF_OFFSET_DEFAULT     (0)
+
 /* ------------------------ FUNCTION PROTOTYPES ----------------------------- */
 MotorConstruct    motorConstruct;
 MotorDriveForward motorDriveForward;
 MotorDriveReverse motorDriveReverse;
 MotorStop         motorStop;
 MotorChangeSpeed  motorChangeSpeed;
+MotorDrive        motorDrive;
+MotorBrake        motorBrake;
+MotorCoast        motorCoast;
+MotorStep         motorStep;
+MotorDriveSpeed   motorDriveSpeed;
+MotorFeedbackSet  motorFeedbackSet;
+MotorPidSet       motorPidSet;
+MotorSpeedGet     motorSpeedGet;
+MotorCalSet       motorCalSet;
+MotorCalLoad      motorCalLoad;
+MotorCalSave      motorCalSave;
+MotorCalibrate    motorCalibrate;
+MotorSupplySet    motorSupplySet;
+MotorDriveSpeeds  motorDriveSpeeds;
+MotorSpeedFresh   motorSpeedFresh;
+MotorDutyLimitGet motorDutyLimitGet;
+MotorDemandMaxSet motorDemandMaxSet;
 
 #endif // _MOTOR_H_
@@ -8,12 +8,107 @@
 #include "common/utils.h"
 
 /* ------------------------ MACROS AND DEFINES ------------------------------ */
+
+//
+// The driver defines the overflow and compare A interrupt vectors of Timers
+// 1, 3, 4 and 5, so programs linking it must not; a free timebase for tests
+// is Timer0.
+//
+
 #define NON_INVERTED_PWM    (0)
 #define INVERTED_PWM        (1)
 
 // See note in PWM struct below above field dir
 #define PWM_FORWARD         (0)
 #define PWM_REVERSE         (1)
+#define PWM_BRAKE           (2)
+
+/*!
+ * Phase of a PWM's carrier relative to the other PWMs started with it by
+ * pwmSyncStart. Bit 0 delays the timer's start by a quarter period; bit 1
+ * inverts its outputs, centring each pulse on TOP instead of BOTTOM, which
+ * shifts it by half a period.
+ */
+#define PWM_PHASE_0         (0)
+#define PWM_PHASE_90        (1)
+#define PWM_PHASE_180       (2)
+#define PWM_PHASE_270       (3)
+
+#define PWM_PHASE_QUARTER   (0x01)
+#define PWM_PHASE_INVERTED  (0x02)
+
+/*!
+ * Set to 0 to switch all four motors on at the same instant. Otherwise each
+ * motor's PWM is a quarter period behind the one before, so that their on
+ * times interleave and the battery's peak current is shared out over the
+ * period instead of drawn all at once.
+ */
+#ifndef PWM_INTERLEAVE
+#define PWM_INTERLEAVE      (1)
+#endif
+
+/*!
+ * Set to 1 to build the sigma-delta dither engine (@ref pwmDitherStart).
+ * Dithering carries the fractional part of each compare value from one
+ * carrier period to the next, so that over 2^n periods the average duty
+ * cycle gains up to n bits of resolution, but never more than the duty
+ * cycle it is given. At 20 kHz (TOP = 400, 8 bits), 16 periods (0.8 ms)
+ * reach 12 bits through pwmSetDutyCycle16, which the Motors drive through;
+ * the 1000-step pwmSetDutyCyclePermille gets about 10 bits.
+ *
+ * The engine runs from one timer's overflow interrupt, every carrier period.
+ * Counting instructions gives roughly 40 cycles of interrupt entry and exit
+ * plus 25 cycles per dithered PWM, or for all four motors at 20 kHz about
+ * 2.8M cycles/s (17% of the CPU). pwm_test's pwmDitherCost measures the
+ * actual cost on the target, in cycles per carrier period and permille of
+ * the CPU, from the time the interrupt takes away from a busy loop; check
+ * it against the control tick's budget before enabling the engine.
+ */
+#ifndef PWM_DITHER
+#define PWM_DITHER          (0)
+#endif
+
+/*!
+ * Maximum number of PWMs dithered together, chopped at once, and committed
+ * together from an interrupt (@ref PWMCommit)
+ */
+#define PWM_DITHER_MAX      (4)
+#define PWM_CHOP_MAX        (4)
+#define PWM_COMMIT_MAX      (4)
+
+/*!
+ * Full-scale duty cycles of the high-resolution duty cycle methods
+ */
+#define PWM_DUTY_FULL       (0xFFFF)
+#define PWM_PERMILLE_FULL   (1000)
+
+/*!
+ * Carrier frequency of the motor PWMs. 20 kHz is above the audible range and
+ * well above the motors' electrical time constant, while still leaving
+ * 400 steps of duty cycle resolution at F_CPU = 16 MHz.
+ */
+#ifndef PWM_CARRIER_HZ
+#define PWM_CARRIER_HZ      (20000)
+#endif
+
+/*!
+ * Smallest TOP (and so the coarsest resolution) a carrier may be given,
+ * keeping at least the 1% steps of pwmSetDutyCycle
+ */
+#define PWM_TOP_MIN         (100)
+
+/*!
+ * Minimum distance (in timer counts) from BOTTOM at which pwmCommit starts
+ * writing staged compare values. Output compare registers latch at BOTTOM,
+ * so this must cover the time taken to write every staged value; otherwise
+ * some timers would pick up the new values a period before the others.
+ */
+#define PWM_COMMIT_GUARD    (192)
+
+/*!
+ * Most carrier periods a coast window may last (@ref pwmCoastWindow)
+ */
+#define PWM_COAST_MAX       (8)
 
 /* ------------------------ TYPE DEFINITIONS -------------------------------- */
 
@@ -34,17 +129,21 @@ typedef struct PWM PWM;
  *                          in order to enable the corresponding timer unit
  * @param[in/out] tccrA     Timer control register A
  * @param[in/out] tccrB     Timer control register B
- * @param[in]     clkSrc    The clock source for the timer used for PWM
+ * @param[in]     carrierHz The PWM carrier frequency in Hz. The prescaler and
+ *                          TOP are chosen to give the finest resolution at
+ *                          this frequency.
  * @param[in/out] ocrA      Output compare register A of timer used for PWM
  * @param[in/out] ocrB      Output compare register B of timer used for PWM
  * @param[in/out] ocrC      Output compare register C of timer used for PWM
  *
  * @return STATUS_OK if PWM constructed successfully
  * @return STATUS_ERR_INVALID_PTR if input pointer is NULL
+ * @return STATUS_ERR_GENERAL if carrierHz is out of range, i.e. it would
+ *         leave fewer than PWM_TOP_MIN steps of resolution
  */
 typedef STATUS PWMConstruct(PWM *pPWM, REG8 *ddr, uint8_t bit1, uint8_t bit2,
                             REG8 *prr, uint8_t prrBit, REG8 *tccrA, REG8 *tccrB,
-                            uint8_t clkSrc, REG16 *ocrA, REG16 *ocrB,
+                            uint16_t carrierHz, REG16 *ocrA, REG16 *ocrB,
                             REG16 *ocrC);
 
 /*!
@@ -66,6 +165,187 @@ typedef STATUS PWMInit(PWM *pPWM);
  */
 typedef STATUS PWMSetDutyCycle(PWM *pPWM, uint8_t pct);
 
+/*!
+ * Type definition for the PWM object's setDutyCycle16 method. Sets the duty
+ * cycle with a single multiply-shift, using the TOP value cached by pwmInit
+ * rather than reading OCRnA.
+ *
+ * param[in/out] pPWM   pointer to the PWM object's duty cycle to change
+ * param[in]     duty   duty cycle, where PWM_DUTY_FULL is 100%
+ */
+typedef STATUS PWMSetDutyCycle16(PWM *pPWM, uint16_t duty);
+
+/*!
+ * Type definition for the PWM object's setDutyCyclePermille method. Sets the
+ * duty cycle with a single multiply-shift by a scale precomputed by pwmInit.
+ *
+ * param[in/out] pPWM     pointer to the PWM object's duty cycle to change
+ * param[in]     permille duty cycle, where PWM_PERMILLE_FULL is 100%
+ */
+typedef STATUS PWMSetDutyCyclePermille(PWM *pPWM, uint16_t permille);
+
+/*!
+ * Type definition for the function that sets a PWM's duty cycle exactly as
+ * setDutyCycle16, but without checking the pointer, for callers that
+ * validated it once up front (i.e. a Motor, at construction)
+ *
+ * param[in/out] pPWM   pointer to an initialized PWM object
+ * param[in]     duty   duty cycle, where PWM_DUTY_FULL is 100%
+ */
+typedef STATUS PWMSetDutyCycle16Unchecked(PWM *pPWM, uint16_t duty);
+
+/*!
+ * Type definition for the PWM object's setStaged method. While staged, the
+ * setDutyCycle methods only record the new compare values; nothing reaches
+ * the timer until pwmCommit.
+ *
+ * param[in/out] pPWM     pointer to the PWM object
+ * param[in]     bStaged  true to stage duty cycle changes, false to apply
+ *                        them immediately
+ */
+typedef STATUS PWMSetStaged(PWM *pPWM, bool bStaged);
+
+/*!
+ * Type definition for the PWM object's setPhase method. Must be called before
+ * pwmInit, and takes effect from pwmSyncStart. The phase is fixed by the
+ * timer's count and output polarity, so duty cycle changes never disturb it.
+ *
+ * param[in/out] pPWM     pointer to the PWM object
+ * param[in]     phase    one of PWM_PHASE_*
+ */
+typedef STATUS PWMSetPhase(PWM *pPWM, uint8_t phase);
+
+/*!
+ * Type definition for the function that starts a group of PWM timers in
+ * phase. The shared prescaler is halted while every timer's counter is reset,
+ * then released, so timers clocked through the prescaler resume on the same
+ * clock cycle. Timers using CLK_SEL_NO_PRESCALE bypass the prescaler and
+ * restart a few cycles apart, in array order. Timers whose phase includes
+ * PWM_PHASE_QUARTER are then started once the others are a quarter period
+ * in, with interrupts held off for up to that quarter period.
+ *
+ * param[in/out] pPWMs    array of pointers to initialized PWM objects
+ * param[in]     numPWMs  number of PWM objects in pPWMs
+ */
+typedef void PWMSyncStart(PWM *const pPWMs[], uint8_t numPWMs);
+
+/*!
+ * Type definition for the function that applies the staged duty cycles of a
+ * group of PWM objects started with pwmSyncStart. Every staged compare value
+ * is written with interrupts disabled while all the timers are at least
+ * PWM_COMMIT_GUARD counts from BOTTOM, so that all timers latch their new
+ * duty cycles at the same BOTTOM. Timers a quarter period out of phase reach
+ * BOTTOM half a period apart, so they latch at most half a period apart.
+ *
+ * It never waits: if a timer is too close to BOTTOM, the write is left to
+ * the compare A (TOP) interrupt of the first PWM's timer, which makes it at
+ * that timer's next TOP, where every timer is furthest from BOTTOM. The
+ * duty cycles then latch at most one carrier period later. Only one group
+ * is deferred at a time; committing again supersedes it. Carriers with TOP
+ * below twice the guard, and groups of more than PWM_COMMIT_MAX, are
+ * written immediately.
+ *
+ * param[in/out] pPWMs    array of pointers to staged PWM objects
+ * param[in]     numPWMs  number of PWM objects in pPWMs
+ */
+typedef void PWMCommit(PWM *const pPWMs[], uint8_t numPWMs);
+
+/*!
+ * Type definition for the function that starts dithering a group of PWM
+ * objects. From then on, the fractional part of every duty cycle set on them
+ * is spread over successive carrier periods by a first-order sigma-delta
+ * modulator, run from the overflow interrupt of the first PWM's timer. The
+ * PWMs should share a carrier frequency and have been started together with
+ * pwmSyncStart. Only available when built with PWM_DITHER.
+ *
+ * param[in/out] pPWMs    array of pointers to initialized PWM objects
+ * param[in]     numPWMs  number of PWM objects in pPWMs (up to
+ *                        PWM_DITHER_MAX)
+ *
+ * @return STATUS_OK if dithering started
+ * @return STATUS_ERR_GENERAL if dithering is not built or numPWMs is invalid
+ */
+typedef STATUS PWMDitherStart(PWM *const pPWMs[], uint8_t numPWMs);
+
+/*!
+ * Type definition for the handler run in a coast window
+ *
+ * @param[in/out] pArg  Argument registered along with the handler
+ *
+ * @note Handlers run in interrupt context with interrupts disabled
+ */
+typedef void PWMCoastHandler(void *pArg);
+
+/*!
+ * Type definition for the function that opens a coast window on a PWM.
+ * Both outputs are released for a number of whole carrier periods, and the
+ * handler runs at TOP of the last one, half a period after the outputs
+ * were last driven and half a period before they are driven again, which
+ * is when the motor's winding current has decayed furthest. The window is
+ * timed from the timer's compare A (TOP) interrupt: its first TOP releases
+ * the outputs from the next BOTTOM, and the last one restores them from
+ * the BOTTOM after it.
+ *
+ * Only one window may be open at a time. It takes up to periods + 1
+ * carrier periods, and the duty cycle in force when it opens is restored
+ * when it closes, so it should be opened just after pwmCommit and must
+ * close before the next duty cycle change.
+ *
+ * param[in/out] pPWM      pointer to an initialized PWM object
+ * param[in]     periods   number of carrier periods to coast (1 to
+ *                         PWM_COAST_MAX)
+ * param[in]     pHandler  handler to run at TOP of the last period
+ * param[in]     pArg      argument passed to pHandler
+ *
+ * @return STATUS_OK if the window was opened
+ * @return STATUS_ERR_INVALID_PTR if an input pointer is NULL
+ * @return STATUS_ERR_GENERAL if a window is already open or periods is
+ *         out of range
+ */
+typedef STATUS PWMCoastWindow(PWM *pPWM, uint8_t periods,
+                              PWMCoastHandler *pHandler, void *pArg);
+
+/*!
+ * Type definition for the function that chops a PWM's outputs for the rest
+ * of its carrier period. Both output pins are disconnected from the timer,
+ * falling at once to their PORT level, which is left low, and are
+ * reconnected by the timer's overflow interrupt at the next BOTTOM.
+ *
+ * The timer's force output compare strobes would be quicker still, but
+ * they are ignored in the PWM modes, so the compare outputs are switched
+ * off instead.
+ *
+ * param[in/out] pPWM      pointer to an initialized PWM object
+ *
+ * @return true if the PWM was chopped, false if it already was
+ *
+ * @note Must be called with interrupts disabled, i.e. from an interrupt
+ */
+typedef bool PWMChop(PWM *pPWM);
+
+/*!
+ * Type definition for the function that halts a PWM's outputs until
+ * pwmResume. Both output pins are disconnected from the timer at once, as
+ * by pwmChop, but stay disconnected across BOTTOM; duty cycles may still be
+ * set meanwhile, and take effect on resuming. Chopping a halted PWM does
+ * nothing.
+ *
+ * param[in/out] pPWM      pointer to an initialized PWM object
+ *
+ * @note Must be called with interrupts disabled, i.e. from an interrupt
+ */
+typedef void PWMHalt(PWM *pPWM);
+
+/*!
+ * Type definition for the function that reconnects the outputs of a PWM
+ * halted by pwmHalt, as they were before
+ *
+ * param[in/out] pPWM      pointer to an initialized PWM object
+ *
+ * @note Must be called with interrupts disabled
+ */
+typedef void PWMResume(PWM *pPWM);
+
 /*!
  * Structure definition for the pwm object
  */
@@ -105,11 +385,81 @@ struct PWM
     REG16  *ocrB;
     REG16  *ocrC;
 
+    //
+    // Cached TOP (OCRnA) and the precomputed Q16 scale from a permille duty
+    // cycle to an output compare value, so that setting the duty cycle
+    // needs neither a register read nor a divide
+    //
+    uint16_t top;
+    uint32_t permilleScale;
+
+    //
+    // Carrier frequency actually achieved (Hz), and the effective duty cycle
+    // resolution in whole bits (TOP + 1 distinct duty cycles)
+    //
+    uint16_t carrierHz;
+    uint8_t  resolutionBits;
+
+    // Counter, interrupt mask and interrupt flag registers of the timer
+    REG16  *tcnt;
+    REG8   *timsk;
+    REG8   *tifr;
+
+    // Compare values recorded while staged, applied by pwmCommit
+    bool     bStaged;
+    uint16_t ocrBStaged;
+    uint16_t ocrCStaged;
+
+    // Carrier phase (one of PWM_PHASE_*)
+    uint8_t  phase;
+
+    //
+    // Sigma-delta dither state: the channel being dithered and the direction
+    // it was chosen for, its compare value, the value last written to it,
+    // and the step added to it on each carry of the accumulated fraction
+    //
+    bool     bDither;
+    REG16   *ditherOcr;
+    uint8_t  ditherDir;
+    uint16_t ditherBase;
+    uint16_t ditherLast;
+    int8_t   ditherStep;
+    uint16_t ditherFrac;
+    uint16_t ditherAcc;
+    uint16_t ditherFracStaged;
+
+    // Whether the outputs are released for a coast window
+    bool     bCoast;
+
+    //
+    // Whether the outputs are chopped until the next BOTTOM, and their
+    // compare output mode bits to restore then
+    //
+    bool     bChop;
+    uint8_t  chopCom;
+
+    //
+    // Whether the outputs are halted until pwmResume, and their compare
+    // output mode bits to restore then
+    //
+    bool     bHalt;
+    uint8_t  haltCom;
+
+#if METHOD_POINTERS
     // Method to initialize this PWM object
-    PWMInit         *pwmInit;
+    PWMInit                 *pwmInit;
+
+    // Methods to set PWM duty cycle
+    PWMSetDutyCycle         *pwmSetDutyCycle;
+    PWMSetDutyCycle16       *pwmSetDutyCycle16;
+    PWMSetDutyCyclePermille *pwmSetDutyCyclePermille;
+
+    // Method to select staged or immediate duty cycle changes
+    PWMSetStaged            *pwmSetStaged;
 
-    // Method to set PWM duty cycle
-    PWMSetDutyCycle *pwmSetDutyCycle;
+    // Method to set the carrier phase
+    PWMSetPhase             *pwmSetPhase;
+#endif
 };
 
 // TODO: Deprecate use of this macro
@@ -129,8 +479,20 @@ struct PWM
         } while (0)
 
 /* ------------------------ FUNCTION PROTOTYPES ----------------------------- */
-PWMConstruct    pwmConstruct;
-PWMInit         pwmInit;
-PWMSetDutyCycle pwmSetDutyCycle;
+PWMConstruct            pwmConstruct;
+PWMInit                 pwmInit;
+PWMSetDutyCycle         pwmSetDutyCycle;
+PWMSetDutyCycle16       pwmSetDutyCycle16;
+PWMSetDutyCyclePermille pwmSetDutyCyclePermille;
+PWMSetDutyCycle16Unchecked pwmSetDutyCycle16Unchecked;
+PWMSetStaged            pwmSetStaged;
+PWMSetPhase             pwmSetPhase;
+PWMSyncStart            pwmSyncStart;
+PWMCommit               pwmCommit;
+PWMDitherStart          pwmDitherStart;
+PWMCoastWindow          pwmCoastWindow;
+PWMChop                 pwmChop;
+PWMHalt                 pwmHalt;
+PWMResume               pwmResume;
 
 #endif /* _PFCPWM_H_ */
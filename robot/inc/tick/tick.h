@@ -0,0 +1,121 @@
+/* Header file for the fixed-rate control tick */
+
+#ifndef _TICK_H_
+#define _TICK_H_
+
+/* ------------------------ INCLUDES ---------------------------------------- */
+#include "common/utils.h"
+
+/* ------------------------ MACROS AND DEFINES ------------------------------ */
+
+/*!
+ * Rate of the control tick. The tick runs on Timer/Counter2 in CTC mode,
+ * the only timer not used for motor PWM, and supports rates from 62 Hz to
+ * F_CPU/2. Every control feature hangs off this tick, so rates in the
+ * 500 Hz - 1 kHz range are recommended.
+ */
+#ifndef TICK_HZ
+#define TICK_HZ         (1000)
+#endif
+
+#define TICK_MIN_HZ     (62)
+
+/* ------------------------ TYPEDEFS ---------------------------------------- */
+
+/*!
+ * Timing statistics of the control tick. Latency is the time from the
+ * timer compare match to the start of the tick handler; its spread
+ * (latencyMax - latencyMin) is the tick's jitter. An overrun is counted
+ * whenever the handler is still running when the next tick falls due.
+ *
+ * Times are in timer counts; multiply by cyclesPerCount for CPU cycles.
+ */
+typedef struct TICK_STATS
+{
+    // Number of ticks run since the statistics were last reset
+    uint32_t ticks;
+
+    // Number of ticks whose handler ran past the next tick
+    uint16_t overruns;
+
+    // Min and max latency from compare match to handler start
+    uint8_t  latencyMin;
+    uint8_t  latencyMax;
+
+    // Max time spent in the handler of a tick that did not overrun
+    uint8_t  durationMax;
+
+    // Timer counts per tick period, and CPU cycles per timer count
+    uint16_t countsPerTick;
+    uint16_t cyclesPerCount;
+} TICK_STATS;
+
+/*!
+ * Type definition for a control tick handler
+ *
+ * @param[in/out] pArg  Argument registered along with the handler
+ *
+ * @note Handlers run in interrupt context with interrupts disabled and the
+ *       tick's own interrupt masked. A handler may re-enable interrupts once
+ *       its time-critical part is done, so that other interrupts are not
+ *       held off for the rest of it; the tick disables them again after.
+ */
+typedef void TickHandler(void *pArg);
+
+/*!
+ * Initializes and starts the control tick
+ *
+ * @param[in] hz    Rate of the control tick
+ *
+ * @return STATUS_OK if the tick was started
+ * @return STATUS_ERR_GENERAL if hz cannot be generated from F_CPU
+ */
+typedef STATUS TickInit(uint16_t hz);
+
+/*!
+ * Registers the handler run on every control tick
+ *
+ * @param[in] pHandler  Handler to run, or NULL for none
+ * @param[in] pArg      Argument passed to pHandler
+ */
+typedef void TickHandlerSet(TickHandler *pHandler, void *pArg);
+
+/*!
+ * Gets a consistent snapshot of the control tick's timing statistics
+ *
+ * @param[in/out] pStats    Pointer to statistics to populate
+ */
+typedef void TickStatsGet(TICK_STATS *pStats);
+
+/*!
+ * Resets the control tick's timing statistics
+ */
+typedef void TickStatsReset(void);
+
+/*!
+ * Gets the number of ticks since the control tick was started
+ *
+ * @return the tick count (wraps after 2^32 ticks)
+ */
+typedef uint32_t TickCountGet(void);
+
+/*!
+ * Gets a free-running timestamp with the resolution of the tick's timer,
+ * for timing events between ticks
+ *
+ * @return the time in timer counts of TICK_STATS.cyclesPerCount CPU cycles
+ *         (wraps after 2^16 counts, i.e. 262 ms at 1 kHz)
+ *
+ * @note Must be called with interrupts disabled, i.e. from an ISR
+ */
+typedef uint16_t TickTimestampGet(void);
+
+/* ------------------------ FUNCTION PROTOTYPES ----------------------------- */
+TickInit         tickInit;
+TickHandlerSet   tickHandlerSet;
+TickStatsGet     tickStatsGet;
+TickStatsReset   tickStatsReset;
+TickCountGet     tickCountGet;
+TickTimestampGet tickTimestampGet;
+
+#endif // _TICK_H_
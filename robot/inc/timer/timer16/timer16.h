@@ -54,6 +54,13 @@
 #define TIMER_MODE_COM_PFC_PWM_CLEAR_UP     (0x02)
 #define TIMER_MODE_COM_PFC_PWM_SET_UP       (0x03)
 
+/*!
+ * Compare output mode bits of channels B and C in timer control register A
+ * (i.e. COM1B1:0 and COM1C1:0 in TCCR1A)
+ */
+#define TIMER16_COM_B_MASK                  (0x30)
+#define TIMER16_COM_C_MASK                  (0x0C)
+
 #define CLK_SEL_NO_SOURCE                   (0x00)
 #define CLK_SEL_NO_PRESCALE                 (0x01)
 #define CLK_SEL_PRESCALE_8                  (0x02)
@@ -62,6 +69,18 @@
 #define CLK_SEL_PRESCALE_1024               (0x05)
 #define CLK_SEL_EXTERN_FALL_EDGE            (0x06)
 #define CLK_SEL_EXTERN_RISE_EDGE            (0x07)
+#define CLK_SEL_MASK                        (0x07)
+
+/*!
+ * Interrupt enable bits of the 16-bit timers' interrupt mask registers
+ * (i.e. TIMSK1 for 16-bit timer 1), which are also the positions of the
+ * matching flags in the interrupt flag registers (i.e. TIFR1)
+ */
+#define TIMER16_INT_OVF                     (0)
+#define TIMER16_INT_COMPA                   (1)
+#define TIMER16_INT_COMPB                   (2)
+#define TIMER16_INT_COMPC                   (3)
+#define TIMER16_INT_CAPT                    (5)
 
 /*!
  * Helper macro to set the waveform generation bits of the timer control
@@ -123,6 +142,21 @@
             tccrB |= source; \
         } while (0)
 
+/*!
+ * Helper macros to halt and release the prescaler shared by Timers 0, 1, 3,
+ * 4 and 5. While halted, timers clocked through the prescaler do not count,
+ * so they can be configured and then released on the same clock cycle.
+ */
+#define TIMER16_SYNC_HALT() \
+        do { \
+            GTCCR = (1 << TSM) | (1 << PSRSYNC); \
+        } while (0)
+
+#define TIMER16_SYNC_RELEASE() \
+        do { \
+            GTCCR = 0; \
+        } while (0)
+
 /*!
  * Helper macro to set output compare register to provided value
  *
@@ -171,4 +205,36 @@
 void timer16Init(REG8 *prr, uint8_t prrBit, REG8 *tccrA, REG8 *tccrB,
                  uint8_t wgmMode, uint8_t comMode, uint8_t clkSrc);
 
+/*!
+ * Function to look up the counter register of a 16-bit timer
+ *
+ * @param[in] tccrA     Timer control register A for chosen timer
+ *
+ * @return Pointer to the timer's counter register (i.e. TCNT1 for TCCR1A)
+ * @return NULL if tccrA does not belong to a 16-bit timer
+ */
+REG16 *timer16CounterGet(REG8 *tccrA);
+
+/*!
+ * Function to look up the interrupt mask register of a 16-bit timer
+ *
+ * @param[in] tccrA     Timer control register A for chosen timer
+ *
+ * @return Pointer to the timer's interrupt mask register (i.e. TIMSK1 for
+ *         TCCR1A)
+ * @return NULL if tccrA does not belong to a 16-bit timer
+ */
+REG8 *timer16InterruptMaskGet(REG8 *tccrA);
+
+/*!
+ * Function to look up the interrupt flag register of a 16-bit timer
+ *
+ * @param[in] tccrA     Timer control register A for chosen timer
+ *
+ * @return Pointer to the timer's interrupt flag register (i.e. TIFR1 for
+ *         TCCR1A)
+ * @return NULL if tccrA does not belong to a 16-bit timer
+ */
+REG8 *timer16InterruptFlagGet(REG8 *tccrA);
+
 #endif /* _TIMER16_H_ */
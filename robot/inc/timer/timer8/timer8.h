@@ -0,0 +1,74 @@
+/* Header file for 8-bit timer/counters */
+
+#ifndef _TIMER8_H_
+#define _TIMER8_H_
+
+/* ------------------------ INCLUDES ---------------------------------------- */
+#include "timer/timer16/timer16.h"
+#include "common/utils.h"
+
+/* ------------------------ MACROS AND DEFINES ------------------------------ */
+
+//
+// USEFUL ABBREVIATIONS
+// WGM = waveform generation mode
+// CTC = clear timer on compare match
+// OCRnA = output compare register A for timer n
+//
+
+#define TIMER8_MODE_WGM_NORMAL              (0x00)
+#define TIMER8_MODE_WGM_PC_PWM              (0x01)
+#define TIMER8_MODE_WGM_CTC                 (0x02)
+#define TIMER8_MODE_WGM_FPWM                (0x03)
+#define TIMER8_MODE_WGM_PC_PWM_TOP_OCRnA    (0x05)
+#define TIMER8_MODE_WGM_FPWM_TOP_OCRnA      (0x07)
+
+//
+// Clock sources for Timer/Counter2. Note these differ from the clock source
+// encodings of Timer/Counter0 and the 16-bit timers, since Timer/Counter2
+// has its own prescaler with extra /32 and /128 taps.
+//
+#define TIMER2_CLK_SEL_NO_SOURCE            (0x00)
+#define TIMER2_CLK_SEL_NO_PRESCALE          (0x01)
+#define TIMER2_CLK_SEL_PRESCALE_8           (0x02)
+#define TIMER2_CLK_SEL_PRESCALE_32          (0x03)
+#define TIMER2_CLK_SEL_PRESCALE_64          (0x04)
+#define TIMER2_CLK_SEL_PRESCALE_128         (0x05)
+#define TIMER2_CLK_SEL_PRESCALE_256         (0x06)
+#define TIMER2_CLK_SEL_PRESCALE_1024        (0x07)
+
+/*!
+ * Helper macro to set the waveform generation bits of the timer control
+ * registers of an 8-bit timer
+ *
+ * @param[in/out] tccrA     Timer control register A
+ *                          (i.e. TCCR2A for 8-bit timer 2)
+ * @param[in/out] tccrB     Timer control register B
+ *                          (i.e. TCCR2B for 8-bit timer 2)
+ * @param[in]     mode      The waveform generation mode (see #define's above)
+ */
+#define SET_TIMER8_MODE_WGM(tccrA, tccrB, mode) \
+        do { \
+            tccrA |= ((mode) & 0b00000011); \
+            tccrB |= (((mode) << 1) & 0b00001000); \
+        } while (0)
+
+/* ------------------------ FUNCTION DEFINITIONS ---------------------------- */
+
+/*!
+ * Function to intialize an 8-bit timer
+ *
+ * @param[in/out] prr       A power reduction register (i.e. PRR0) whose given
+ *                          bits are cleared to enable timer to be initialized
+ * @param[in]     prrBit    Bit in prr to be cleared
+ * @param[in/out] tccrA     Timer control register A for chosen timer
+ * @param[in/out] tccrB     Timer control register B for chosen timer
+ * @param[in]     wgmMode   The waveform generation mode for the timer
+ * @param[in]     clkSrc    The clock source for the timer
+ *
+ * @note The timer's compare outputs are left disconnected
+ */
+void timer8Init(REG8 *prr, uint8_t prrBit, REG8 *tccrA, REG8 *tccrB,
+                uint8_t wgmMode, uint8_t clkSrc);
+
+#endif /* _TIMER8_H_ */
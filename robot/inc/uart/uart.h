@@ -145,6 +145,15 @@ UartInit(UART        *uart,
 typedef void
 UartTX(UART *uart, uint8_t data);
 
+/*!
+ * Function transmit a NULL-terminated string over UART
+ *
+ * @param[in/out]  uart     Pointer to UART object
+ * @param[in]      str      The string to transmit, without its NULL byte
+ */
+typedef void
+UartTXString(UART *uart, const char *str);
+
 /* ------------------------ STRUCTURE DEFINITION ---------------------------- */
 
 /*!
@@ -178,5 +187,6 @@ struct UART
 UartConstruct uartConstruct;
 UartInit      uartInit;
 UartTX        uartTX;
+UartTXString  uartTXString;
 
 #endif // _UART_H_
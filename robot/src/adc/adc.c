@@ -0,0 +1,131 @@
+/* Implementation file for the analog to digital converter */
+
+/* ------------------------- SYSTEM INCLUDES -------------------------------- */
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <stdlib.h>
+
+/* ------------------------- APPLICATION INCLUDES --------------------------- */
+#include "adc/adc.h"
+#include "common/utils.h"
+
+/* ------------------------- MACROS AND DEFINES ----------------------------- */
+
+/*!
+ * ADC clock prescaler of F_CPU / 16 (@ref ADC_CONVERSION_US)
+ */
+#define ADC_PRESCALE_BITS   (1 << ADPS2)
+
+/* ------------------------- STATIC VARIABLES ------------------------------- */
+
+/*!
+ * Whether a conversion is running, and the handler of its result
+ */
+static volatile bool  adcBusy = false;
+static AdcHandler    *adcHandler;
+static void          *adcHandlerArg;
+
+/* ------------------------- STATIC FUNCTIONS ------------------------------- */
+
+/*!
+ * Selects the input channel of the next conversion, referenced to AVCC
+ *
+ * @param[in] channel   Input channel (0 to ADC_NUM_CHANNELS - 1)
+ */
+static inline void
+_adcChannelSelect
+(
+    uint8_t channel
+)
+{
+    ADMUX = (1 << REFS0) | (channel & 0x07);
+
+    if (channel & 0x08)
+    {
+        SET_BIT(ADCSRB, MUX5);
+    }
+    else
+    {
+        CLEAR_BIT(ADCSRB, MUX5);
+    }
+}
+
+/* ------------------------- FUNCTION DEFINITIONS --------------------------- */
+
+/*!
+ * @ref adc.h for function documentation
+ */
+void
+adcInit(void)
+{
+    CLEAR_BIT(PRR0, PRADC);
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        adcBusy = false;
+        ADCSRB  = 0x00;
+        _adcChannelSelect(0);
+
+        // The first conversion after enabling takes 25 ADC clocks; run it now
+        ADCSRA = (1 << ADEN) | (1 << ADIF) | ADC_PRESCALE_BITS;
+        SET_BIT(ADCSRA, ADSC);
+        while (ADCSRA & (1 << ADSC));
+
+        ADCSRA = (1 << ADEN) | (1 << ADIF) | (1 << ADIE) | ADC_PRESCALE_BITS;
+    }
+}
+
+/*!
+ * @ref adc.h for function documentation
+ */
+STATUS
+adcStart
+(
+    uint8_t     channel,
+    AdcHandler *pHandler,
+    void       *pArg
+)
+{
+    STATUS status = STATUS_OK;
+
+    if (pHandler == NULL)
+    {
+        return STATUS_ERR_INVALID_PTR;
+    }
+
+    if (channel >= ADC_NUM_CHANNELS)
+    {
+        return STATUS_ERR_GENERAL;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (adcBusy)
+        {
+            status = STATUS_ERR_GENERAL;
+        }
+        else
+        {
+            adcBusy       = true;
+            adcHandler    = pHandler;
+            adcHandlerArg = pArg;
+
+            _adcChannelSelect(channel);
+            SET_BIT(ADCSRA, ADSC);
+        }
+    }
+
+    return status;
+}
+
+/* ------------------------ ISR DEFS ---------------------------------------- */
+
+/*!
+ * Passes the result of a finished conversion to its handler
+ */
+ISR(ADC_vect, ISR_BLOCK)
+{
+    adcBusy = false;
+    adcHandler(ADC, adcHandlerArg);
+}
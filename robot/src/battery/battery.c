@@ -0,0 +1,122 @@
+/* Implementation file for the battery voltage monitor */
+
+/* ------------------------- SYSTEM INCLUDES -------------------------------- */
+#include <avr/io.h>
+#include <util/atomic.h>
+#include <stdlib.h>
+
+/* ------------------------- APPLICATION INCLUDES --------------------------- */
+#include "battery/battery.h"
+#include "tick/tick.h"
+#include "common/utils.h"
+
+/* ------------------------- MACROS AND DEFINES ----------------------------- */
+
+/*!
+ * Control ticks between battery samples
+ */
+#define BATTERY_PERIOD_TICKS \
+        ((uint8_t)(((uint32_t)BATTERY_PERIOD_MS * TICK_HZ + 999) / 1000))
+
+/* ------------------------- STATIC VARIABLES ------------------------------- */
+
+/*!
+ * Ticks until the next sample is due
+ */
+static uint8_t  batteryTicks;
+
+/*!
+ * Filtered battery voltage (mV, scaled by 2^BATTERY_FILTER_FRAC_BITS), and
+ * whether the first sample has seeded it
+ */
+static uint32_t batteryFiltered;
+static bool     bBatterySeeded;
+
+/* ------------------------- STATIC FUNCTIONS ------------------------------- */
+
+/*!
+ * Filters a battery sample into the battery voltage
+ *
+ * @ref AdcHandler
+ */
+static void
+_batterySample
+(
+    uint16_t  result,
+    void     *pArg
+)
+{
+    uint32_t mv;
+
+    mv = (((uint32_t)result * BATTERY_FULL_SCALE_MV) / ADC_FULL_SCALE) <<
+         BATTERY_FILTER_FRAC_BITS;
+
+    if (!bBatterySeeded)
+    {
+        batteryFiltered = mv;
+        bBatterySeeded  = true;
+    }
+    else
+    {
+        batteryFiltered = batteryFiltered - (batteryFiltered >>
+                                             BATTERY_FILTER_SHIFT) +
+                          (mv >> BATTERY_FILTER_SHIFT);
+    }
+}
+
+/* ------------------------- FUNCTION DEFINITIONS --------------------------- */
+
+/*!
+ * @ref battery.h for function documentation
+ */
+void
+batteryInit(void)
+{
+    // The battery input is analog only
+    CLEAR_BIT(DDRF, BATTERY_CHANNEL);
+    CLEAR_BIT(PORTF, BATTERY_CHANNEL);
+    SET_BIT(DIDR0, BATTERY_CHANNEL);
+
+    adcInit();
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        batteryTicks    = 1;
+        batteryFiltered = 0;
+        bBatterySeeded  = false;
+    }
+}
+
+/*!
+ * @ref battery.h for function documentation
+ */
+void
+batteryUpdate(void)
+{
+    if (batteryTicks > 1)
+    {
+        --batteryTicks;
+        return;
+    }
+
+    if (adcStart(BATTERY_CHANNEL, _batterySample, NULL) == STATUS_OK)
+    {
+        batteryTicks = BATTERY_PERIOD_TICKS;
+    }
+}
+
+/*!
+ * @ref battery.h for function documentation
+ */
+uint16_t
+batteryVoltageGet(void)
+{
+    uint32_t filtered;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        filtered = batteryFiltered;
+    }
+
+    return (uint16_t)(filtered >> BATTERY_FILTER_FRAC_BITS);
+}
@@ -0,0 +1,192 @@
+/* Implementation file for the sensorless back-EMF speed estimates */
+
+/* ------------------------- SYSTEM INCLUDES -------------------------------- */
+#include <avr/io.h>
+#include <util/atomic.h>
+#include <stdlib.h>
+
+/* ------------------------- APPLICATION INCLUDES --------------------------- */
+#include "bemf/bemf.h"
+#include "common/utils.h"
+
+/* ------------------------- STATIC VARIABLES ------------------------------- */
+
+/*!
+ * PWMs of the sampled motors, the next motor to sample and the one being
+ * sampled
+ */
+static PWM     *bemfPwms[BEMF_NUM];
+static uint8_t  bemfNum = 0;
+static uint8_t  bemfNext;
+static uint8_t  bemfSampling;
+
+/*!
+ * First terminal's conversion of the motor being sampled
+ */
+static uint16_t bemfSampleA;
+
+/*!
+ * Filtered back-EMF of each motor (mV, scaled by 2^BEMF_FILTER_FRAC_BITS)
+ */
+static int32_t  bemfFiltered[BEMF_NUM];
+
+/* ------------------------- STATIC FUNCTIONS ------------------------------- */
+
+/*!
+ * Filters the second terminal's conversion into the sampled motor's
+ * back-EMF
+ *
+ * @ref AdcHandler
+ */
+static void
+_bemfSampleB
+(
+    uint16_t  result,
+    void     *pArg
+)
+{
+    int32_t  mv;
+    int32_t *pFiltered = &bemfFiltered[bemfSampling];
+
+    mv = (((int32_t)bemfSampleA - result) * BEMF_FULL_SCALE_MV) /
+         ADC_FULL_SCALE;
+
+    *pFiltered += ((mv << BEMF_FILTER_FRAC_BITS) - *pFiltered) >>
+                  BEMF_FILTER_SHIFT;
+}
+
+/*!
+ * Keeps the first terminal's conversion and converts the second, while the
+ * motor is still coasting
+ *
+ * @ref AdcHandler
+ */
+static void
+_bemfSampleA
+(
+    uint16_t  result,
+    void     *pArg
+)
+{
+    bemfSampleA = result;
+    adcStart(BEMF_CHANNEL_B(bemfSampling), _bemfSampleB, NULL);
+}
+
+/*!
+ * Starts converting the sampled motor's terminals at the end of its coast
+ * window. A sample is skipped if the ADC is busy.
+ *
+ * @ref PWMCoastHandler
+ */
+static void
+_bemfCoastHandler
+(
+    void *pArg
+)
+{
+    adcStart(BEMF_CHANNEL_A(bemfSampling), _bemfSampleA, NULL);
+}
+
+/* ------------------------- FUNCTION DEFINITIONS --------------------------- */
+
+/*!
+ * @ref bemf.h for function documentation
+ */
+STATUS
+bemfInit
+(
+    PWM     *const pPwms[],
+    uint8_t        numPwms
+)
+{
+    uint8_t pins;
+    uint8_t i;
+
+    if (pPwms == NULL)
+    {
+        return STATUS_ERR_INVALID_PTR;
+    }
+
+    if (numPwms == 0 || numPwms > BEMF_NUM)
+    {
+        return STATUS_ERR_GENERAL;
+    }
+
+    // Two PORTK pins per motor, as analog inputs without pull-ups
+    pins   = (uint8_t)((1 << (2 * numPwms)) - 1);
+    DDRK  &= ~pins;
+    PORTK &= ~pins;
+    DIDR2 |= pins;
+
+    adcInit();
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        for (i = 0; i < numPwms; ++i)
+        {
+            bemfPwms[i]     = pPwms[i];
+            bemfFiltered[i] = 0;
+        }
+        bemfNum      = numPwms;
+        bemfNext     = 0;
+        bemfSampling = 0;
+    }
+
+    return STATUS_OK;
+}
+
+/*!
+ * @ref bemf.h for function documentation
+ */
+void
+bemfUpdate(void)
+{
+    if (bemfNum == 0)
+    {
+        return;
+    }
+
+    //
+    // A window still open from the last tick is left to finish, and delays
+    // the next motor's turn
+    //
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (pwmCoastWindow(bemfPwms[bemfNext], BEMF_COAST_PERIODS,
+                           _bemfCoastHandler, NULL) == STATUS_OK)
+        {
+            bemfSampling = bemfNext;
+            bemfNext     = (bemfNext + 1) % bemfNum;
+        }
+    }
+}
+
+/*!
+ * @ref bemf.h for function documentation
+ */
+int16_t
+bemfGet(uint8_t idx)
+{
+    int32_t filtered;
+
+    if (idx >= bemfNum)
+    {
+        return 0;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        filtered = bemfFiltered[idx];
+    }
+
+    return (int16_t)(filtered >> BEMF_FILTER_FRAC_BITS);
+}
+
+/*!
+ * @ref bemf.h for function documentation
+ */
+uint8_t
+bemfFreshGet(void)
+{
+    return bemfSampling;
+}
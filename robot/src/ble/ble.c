@@ -10,6 +10,7 @@
 #include "sdep/sdep.h"
 #include "ble/ble.h"
 #include "car/car.h"
+#include "estop/estop.h"
 #include "common/utils.h"
 
 /* ------------------------ EXTERNS ----------------------------------------- */
@@ -37,6 +38,7 @@ extern Car car;
 BLE_GATT_SERVICE RobotDriveService;
 BLE_GATT_CHAR    RobotDriveCharSpeed;
 BLE_GATT_CHAR    RobotDriveCharDirection;
+BLE_GATT_CHAR    RobotDriveCharCommand;
 
 /*!
  * Definition of BLE module name
@@ -48,6 +50,14 @@ static const char *bleDeviceName = "BluefruitLE";
  */
 static const char bleCmdEmptyPayload[1] = {'\0'};
 
+/*!
+ * TX power levels (dBm) accepted by AT+BLEPOWERLEVEL, lowest to highest
+ */
+static const int8_t bleTxPowerLevels[] = {-40, -20, -16, -12, -8, -4, 0, 4};
+
+#define BLE_TX_POWER_NUM_LEVELS \
+        (sizeof(bleTxPowerLevels)/sizeof(bleTxPowerLevels[0]))
+
 
 
 /* STANDARD AT-COMMAND STRINGS */
@@ -813,23 +823,162 @@ _bleGattCharacteristicInitialize
 }
 
 /*!
- * Update handler for the RobotDriveService speed characteristic
+ * Update handler for the RobotDriveService speed characteristic. The
+ * direction is the one last written to its own characteristic, whatever
+ * command the Car is driving.
  */
 static void
 _robotDriveServiceSpeedHandler(ble_char_value value)
 {
     uint8_t speed = string2int(&value[0]);
-    car.carDrive(&car, speed, car.direction);
+    uint8_t dir   = string2int(&RobotDriveCharDirection.value[0]);
+    METHOD(&car, carCommandLegacy)(&car, speed, dir);
 }
 
 /*!
- * Update handler for the RobotDriveService direction characteristic
+ * Update handler for the RobotDriveService direction characteristic. The
+ * speed is the one last written to its own characteristic, whatever command
+ * the Car is driving.
  */
 static void
 _robotDriveServiceDirectionHandler(ble_char_value value)
 {
-    uint8_t dir = string2int(&value[0]);
-    car.carDrive(&car, car.speed, dir);
+    uint8_t speed = string2int(&RobotDriveCharSpeed.value[0]);
+    uint8_t dir   = string2int(&value[0]);
+    METHOD(&car, carCommandLegacy)(&car, speed, dir);
+}
+
+/*!
+ * Parses one field of a drive command: one to three decimal digits, no
+ * greater than UINT8_MAX
+ *
+ * @param[in/out] pp        Pointer to the parse position, left just past the
+ *                          field's digits
+ * @param[out]    pField    Value of the field
+ *
+ * @return true if the field was valid, else false
+ */
+static bool
+_robotDriveCommandFieldParse
+(
+    const char **pp,
+    uint8_t     *pField
+)
+{
+    const char *p     = *pp;
+    uint16_t    value = 0;
+    uint8_t     digits;
+
+    for (digits = 0; *p >= '0' && *p <= '9'; ++digits, ++p)
+    {
+        // Checked before adding, so the value cannot overflow
+        if (digits == 3)
+        {
+            return false;
+        }
+        value = (value * 10) + (*p - '0');
+    }
+
+    if (digits == 0 || value > UINT8_MAX)
+    {
+        return false;
+    }
+
+    *pField = (uint8_t)value;
+    *pp     = p;
+
+    return true;
+}
+
+/*!
+ * Update handler for the RobotDriveService command characteristic, whose
+ * value is "<seq>,<speed>,<direction>", each field 0-255. Malformed commands,
+ * with empty, non-digit or out of range fields, are dropped, as superseded
+ * commands are by the Car. BLE_CMD_ESTOP_TRIGGER trips the e-stop, and
+ * BLE_CMD_ESTOP_CLEAR clears it.
+ */
+static void
+_robotDriveServiceCommandHandler(ble_char_value value)
+{
+    uint8_t     field[3];
+    const char *p = &value[0];
+    uint8_t     i;
+
+    if (stringcmp(&value[0], BLE_CMD_ESTOP_TRIGGER))
+    {
+        estopTrigger();
+        return;
+    }
+    if (stringcmp(&value[0], BLE_CMD_ESTOP_CLEAR))
+    {
+        estopClear();
+        return;
+    }
+
+    for (i = 0; i < 3; ++i)
+    {
+        if (i > 0 && *p++ != ',')
+        {
+            return;
+        }
+        if (!_robotDriveCommandFieldParse(&p, &field[i]))
+        {
+            return;
+        }
+    }
+
+    // Only the end of the value, or of its line, may follow
+    if (*p != '\0' && *p != '\r' && *p != '\n')
+    {
+        return;
+    }
+
+    METHOD(&car, carCommand)(&car, field[0], field[1], field[2]);
+}
+
+/*!
+ * Sets the module's TX power level
+ *
+ * @param[in/out] pBLE  Pointer to BLE object
+ * @param[in]     idx   Index into bleTxPowerLevels of the level to set
+ */
+static void
+_bleTxPowerSet
+(
+    BLE     *pBLE,
+    uint8_t  idx
+)
+{
+    char payload[7];
+    int2string(&payload[0], bleTxPowerLevels[idx]);
+
+    _bleCmdSend(atBlePowerLevel, &payload[0], WRITE, NULL);
+    pBLE->txPowerIdx = idx;
+}
+
+/*!
+ * Maps a smoothed RSSI onto a 0-100 link quality figure
+ *
+ * @param[in] rssi  Smoothed RSSI (dBm, scaled by 2^BLE_RSSI_FRAC_BITS)
+ *
+ * @return link quality from 0 (lost) to 100 (excellent)
+ */
+static uint8_t
+_bleLinkQualityCompute(int16_t rssi)
+{
+    const int16_t min = BLE_RSSI_FIXED(BLE_RSSI_QUALITY_MIN_DBM);
+    const int16_t max = BLE_RSSI_FIXED(BLE_RSSI_QUALITY_MAX_DBM);
+
+    if (rssi <= min)
+    {
+        return 0;
+    }
+    if (rssi >= max)
+    {
+        return 100;
+    }
+
+    return (uint8_t)(((int32_t)(rssi - min) * 100) / (max - min));
 }
 
 /* ------------------------ FUNCTION DEFINITIONS ---------------------------- */
@@ -840,13 +989,24 @@ _robotDriveServiceDirectionHandler(ble_char_value value)
 void
 bleConstruct(BLE *pBLE)
 {
+#if METHOD_POINTERS
     // Initialize methods of BLE object
     pBLE->bleInitialize           = bleInitialize;
     pBLE->bleConnect              = bleConnect;
     pBLE->bleServicesConfigure    = bleServicesConfigure;
     pBLE->bleCharacteristicUpdate = bleCharacteristicUpdate;
+    pBLE->bleCharacteristicRead   = bleCharacteristicRead;
+    pBLE->bleCharacteristicWrite  = bleCharacteristicWrite;
     pBLE->blePing                 = blePing;
     pBLE->bleInfo                 = bleInfo;
+    pBLE->bleLinkMonitor          = bleLinkMonitor;
+#endif
+
+    // Start the link monitor from a neutral, unconnected state
+    pBLE->rssi        = BLE_RSSI_FIXED(BLE_RSSI_QUALITY_MIN_DBM);
+    pBLE->txPowerIdx  = BLE_TX_POWER_DEFAULT_IDX;
+    pBLE->linkQuality = 0;
+    pBLE->bConnected  = false;
 }
 
 /*!
@@ -880,6 +1040,10 @@ bleConnect(BLE *pBLE)
 
     // Stop advertising
     _bleCmdSend(atGapStopAdv, BLE_CMD_EMPTY_PAYLOAD, EXEC, NULL);
+    pBLE->bConnected = true;
+
+    // A new central counts its drive commands afresh
+    METHOD(&car, carCommandSeqReset)(&car);
 }
 
 /*!
@@ -912,11 +1076,20 @@ bleServicesConfigure(BLE *pBLE)
                               "1",
                               "0",
                               _robotDriveServiceDirectionHandler);
+    _bleGattCharacteristicInitialize(&RobotDriveCharCommand,
+                              "00-00-01-00-00-00-00-00-00-00-00-00-00-00-00-00",
+                              "0x04",
+                              "5",
+                              "11",
+                              "0,0,0",
+                              _robotDriveServiceCommandHandler);
 
     _bleGattServiceAdd(pBLE, &RobotDriveService);
     _bleGattCharacteristicAdd(pBLE, &RobotDriveService, &RobotDriveCharSpeed);
     _bleGattCharacteristicAdd(pBLE, &RobotDriveService,
                               &RobotDriveCharDirection);
+    _bleGattCharacteristicAdd(pBLE, &RobotDriveService,
+                              &RobotDriveCharCommand);
 
     // Enable Bluetooth Battery Service
     _bleCmdSend(atBleBattEn, "1", WRITE, NULL);
@@ -935,19 +1108,61 @@ bleCharacteristicUpdate
     BLE_GATT_CHAR *pChar
 )
 {
-    // Read the characteristic value from BLE struct
-    char *currValue = &pChar->value[0];
+    //
+    // Keep the most recently recorded value, since reading from the BLE
+    // module records the new one over it
+    //
+    char currValue[BLE_GATT_CHAR_VALUE_LEN];
+    stringcpy(&currValue[0], &pChar->value[0]);
 
     // Compare to most recently recorded value on BLE module
     char newValue[BLE_GATT_CHAR_VALUE_LEN];
     _bleGattCharacteristicRead(pChar, &newValue[0]);
 
     // If different, then set old value to new value and act accordingly
-    if (!stringcmp(currValue, &newValue[0]))
+    if (!stringcmp(&currValue[0], &newValue[0]))
     {
         // Call characteristic update handler
         pChar->handler(&newValue[0]);
     }
+    else if (pBLE->bConnected &&
+             (pChar == &RobotDriveCharSpeed ||
+              pChar == &RobotDriveCharDirection))
+    {
+        //
+        // The legacy characteristics are written only when a slider moves,
+        // so while connected an unchanged value is a command being held
+        //
+        METHOD(&car, carCommandRefresh)(&car);
+    }
+}
+
+/*!
+ * @ref ble.h for function documentation
+ */
+void
+bleCharacteristicRead
+(
+    BLE            *pBLE,
+    BLE_GATT_CHAR  *pChar,
+    ble_char_value  value
+)
+{
+    _bleGattCharacteristicRead(pChar, value);
+}
+
+/*!
+ * @ref ble.h for function documentation
+ */
+void
+bleCharacteristicWrite
+(
+    BLE            *pBLE,
+    BLE_GATT_CHAR  *pChar,
+    ble_char_value  value
+)
+{
+    _bleGattCharacteristicWrite(pChar, value);
 }
 
 /*!
@@ -979,6 +1194,58 @@ bleInfo(BLE *pBLE, char info[], uint8_t infoLen)
            infoLen < SDEP_MAX_FULL_MSG_LEN ? infoLen : SDEP_MAX_FULL_MSG_LEN);
 }
 
+/*!
+ * @ref ble.h for function documentation
+ */
+void
+bleLinkMonitor(BLE *pBLE)
+{
+    char    reply[SDEP_MAX_FULL_MSG_LEN];
+    int16_t sample;
+
+    memset(&reply[0], 0, SDEP_MAX_FULL_MSG_LEN);
+    _bleCmdSend(atBleGetRssi, BLE_CMD_EMPTY_PAYLOAD, EXEC, &reply[0]);
+
+    // The module reports 0 when there is no connection
+    sample = string2sint(&reply[0]);
+    if (sample == 0)
+    {
+        pBLE->rssi        = BLE_RSSI_FIXED(BLE_RSSI_QUALITY_MIN_DBM);
+        pBLE->linkQuality = 0;
+        pBLE->bConnected  = false;
+        METHOD(&car, carLinkQualityDerate)(&car, 0);
+
+        // Whoever reconnects counts its drive commands afresh
+        METHOD(&car, carCommandSeqReset)(&car);
+        return;
+    }
+
+    pBLE->bConnected = true;
+
+    // Exponential moving average of the RSSI in fixed point
+    pBLE->rssi += (BLE_RSSI_FIXED(sample) - pBLE->rssi) >>
+                  BLE_RSSI_EMA_SHIFT;
+    pBLE->linkQuality = _bleLinkQualityCompute(pBLE->rssi);
+
+    //
+    // Raise TX power before the link degrades far enough to lose commands,
+    // and back it off again once the central is close
+    //
+    if (pBLE->rssi < BLE_RSSI_FIXED(BLE_RSSI_RAISE_DBM) &&
+        pBLE->txPowerIdx < BLE_TX_POWER_NUM_LEVELS - 1)
+    {
+        _bleTxPowerSet(pBLE, pBLE->txPowerIdx + 1);
+    }
+    else if (pBLE->rssi > BLE_RSSI_FIXED(BLE_RSSI_LOWER_DBM) &&
+             pBLE->txPowerIdx > 0)
+    {
+        _bleTxPowerSet(pBLE, pBLE->txPowerIdx - 1);
+    }
+
+    // Let the drive code limit top speed while commands risk being lost
+    METHOD(&car, carLinkQualityDerate)(&car, pBLE->linkQuality);
+}
+
 /* ------------------------ ISR DEFS ---------------------------------------- */
 
 /*!
@@ -986,6 +1253,13 @@ bleInfo(BLE *pBLE, char info[], uint8_t infoLen)
  */
 ISR(BLE_vect, ISR_BLOCK)
 {
+    //
+    // Collecting a response takes milliseconds of SPI traffic, so mask this
+    // interrupt and let the control tick preempt the rest of the handler
+    //
+    CLEAR_BIT(EIMSK, BLE_IRQ);
+    sei();
+
     // Process messages from the BLE module while available
     while (BLE_PORT & (1 << BLE_IRQ))
     {
@@ -1007,4 +1281,7 @@ ISR(BLE_vect, ISR_BLOCK)
 
     // Signal the semaphore
     sdepBufferSemaphore = 1;
+
+    cli();
+    SET_BIT(EIMSK, BLE_IRQ);
 }
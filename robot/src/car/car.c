@@ -1,140 +1,475 @@
 /* Implementation file for the Car object */
 
 /* ------------------------ INCLUDES ---------------------------------------- */
+#include <util/atomic.h>
+#include <stdlib.h>
+
 #include "car/car.h"
+#include "estop/estop.h"
+
+/* ------------------------ MACROS AND DEFINES ------------------------------ */
+
+/*!
+ * Wheel speeds are judged for slip as a share of their commanded speeds,
+ * scaled by 2^CAR_TRACTION_SHARE_BITS
+ */
+#define CAR_TRACTION_SHARE_BITS   (10)
+#define CAR_TRACTION_SHARE_UNITY  (1L << CAR_TRACTION_SHARE_BITS)
+#define CAR_TRACTION_SHARE_SLIP \
+        ((CAR_TRACTION_SHARE_UNITY * CAR_TRACTION_SLIP_PCT) / 100)
+
+/* ------------------------ GLOBAL VARIABLES -------------------------------- */
+
+/*!
+ * @ref car.h for documentation of the built-in motion profiles
+ */
+const CAR_PROFILE carProfileSoft =
+{
+    CAR_PROFILE_TYPE_SCURVE,
+    CAR_PROFILE_ACCEL(1000),
+    CAR_PROFILE_JERK(CAR_PROFILE_ACCEL(1000), 250)
+};
+
+const CAR_PROFILE carProfileAggressive =
+{
+    CAR_PROFILE_TYPE_TRAPEZOIDAL,
+    CAR_PROFILE_ACCEL(250),
+    0
+};
+
+/* ------------------------ STATIC VARIABLES -------------------------------- */
+
+/*!
+ * Profile the dead-man failsafe ramps the wheels to rest along, reaching it
+ * within CAR_FAILSAFE_RAMP_MS from any speed
+ */
+static const CAR_PROFILE carProfileFailsafe =
+{
+    CAR_PROFILE_TYPE_TRAPEZOIDAL,
+    CAR_PROFILE_ACCEL(CAR_FAILSAFE_RAMP_MS),
+    0
+};
 
 /* ------------------------ STATIC FUNCTIONS -------------------------------- */
 
 /*!
- * Drives the car forward
+ * Advances a single wheel's speed one tick along the Car's motion profile
  *
- * @param[in/out] pCar  Pointer to Car object
- * @param[in]     speed Speed to drive forward (as % of total speed)
+ * @param[in]     pProfile  Pointer to profile to follow
+ * @param[in]     target    Wheel's target speed
+ * @param[in/out] pSpeed    Pointer to wheel's current speed
+ * @param[in/out] pAccel    Pointer to wheel's current acceleration
  */
 static void
-_carDriveForward
+_carProfileWheelStep
 (
-    Car     *pCar,
-    uint8_t  speed
+    const CAR_PROFILE *pProfile,
+    int16_t            target,
+    int16_t           *pSpeed,
+    int16_t           *pAccel
 )
 {
-    pCar->speed     = speed;
-    pCar->direction = DRIVE_FORWARD;
+    //
+    // Work in 32 bits: a full reversal is an error of twice full speed,
+    // which does not fit the 16-bit fixed-point speed
+    //
+    int32_t speed = *pSpeed;
+    int32_t accel = *pAccel;
+    int32_t err   = (int32_t)target - speed;
+    int16_t amax  = pProfile->maxAccel;
+    int16_t jerk  = pProfile->maxJerk;
+
+    if (err == 0 && accel == 0)
+    {
+        return;
+    }
+
+    switch (pProfile->type)
+    {
+        case CAR_PROFILE_TYPE_TRAPEZOIDAL:
+            // Constant acceleration until the target is reached
+            amax >>= CAR_ACCEL_FRAC_BITS;
+            if (err > amax)
+            {
+                err = amax;
+            }
+            else if (err < -amax)
+            {
+                err = -amax;
+            }
+            speed += err;
+            break;
+
+        case CAR_PROFILE_TYPE_SCURVE:
+        {
+            //
+            // Ramping acceleration back to zero at the jerk limit changes
+            // speed by about accel^2/(2*jerk). Start ramping down once the
+            // remaining error is that small, otherwise ramp towards the
+            // acceleration limit in the direction of the error.
+            //
+            int8_t  dir    = (err > 0) ? 1 : -1;
+            int32_t absErr = (err > 0) ? err : -err;
+
+            if ((accel > 0) == (dir > 0) && accel != 0 &&
+                ((accel * accel) >> (CAR_ACCEL_FRAC_BITS + 1)) >=
+                jerk * absErr)
+            {
+                accel -= dir * jerk;
+            }
+            else
+            {
+                accel += dir * jerk;
+            }
 
-    pCar->pFrontLeft->driveForward(pCar->pFrontLeft, speed);
-    pCar->pFrontRight->driveForward(pCar->pFrontRight, speed);
-    pCar->pBackLeft->driveForward(pCar->pBackLeft, speed);
-    pCar->pBackRight->driveForward(pCar->pBackRight, speed);
+            if (accel > amax)
+            {
+                accel = amax;
+            }
+            else if (accel < -amax)
+            {
+                accel = -amax;
+            }
+
+            speed += (accel + (1 << (CAR_ACCEL_FRAC_BITS - 1))) >>
+                     CAR_ACCEL_FRAC_BITS;
+
+            // Land exactly on the target rather than oscillating about it
+            if ((dir > 0) ? (speed >= target) : (speed <= target))
+            {
+                speed = target;
+                accel = 0;
+            }
+            break;
+        }
+
+        default:
+            speed = target;
+            accel = 0;
+            break;
+    }
+
+    *pSpeed = (int16_t)CLAMP(speed, -CAR_SPEED_FIXED(CAR_SPEED_FULL),
+                             CAR_SPEED_FIXED(CAR_SPEED_FULL));
+    *pAccel = (int16_t)accel;
 }
 
 /*!
- * Drives the car in reverse
+ * Converts a legacy speed and direction into a linear speed and turn rate.
+ * The wheels on the inside of a turn run at DRIVE_TURN_SPEED, exactly as the
+ * original discrete direction cases did.
  *
- * @param[in/out] pCar  Pointer to Car object
- * @param[in]     speed Speed to drive car in reverse
+ * @param[in]     speed     Speed to drive (as % of total speed)
+ * @param[in]     direction Direction to drive relative to front of the car
+ * @param[in/out] pLinear   Pointer to resulting linear speed
+ * @param[in/out] pTurn     Pointer to resulting turn rate
+ *
+ * @return true if direction is valid, else false
  */
-static void
-_carDriveReverse
+static bool
+_carDirectionToArc
 (
-    Car     *pCar,
-    uint8_t  speed
+    uint8_t  speed,
+    uint8_t  direction,
+    int16_t *pLinear,
+    int16_t *pTurn
 )
 {
-    pCar->speed     = speed;
-    pCar->direction = DRIVE_REVERSE;
+    int16_t left  = speed;
+    int16_t right = speed;
 
-    pCar->pFrontLeft->driveReverse(pCar->pFrontLeft, speed);
-    pCar->pFrontRight->driveReverse(pCar->pFrontRight, speed);
-    pCar->pBackLeft->driveReverse(pCar->pBackLeft, speed);
-    pCar->pBackRight->driveReverse(pCar->pBackRight, speed);
+    if ((direction & ~(DRIVE_REVERSE | DRIVE_LEFT | DRIVE_RIGHT)) != 0 ||
+        (direction & (DRIVE_LEFT | DRIVE_RIGHT)) == (DRIVE_LEFT | DRIVE_RIGHT))
+    {
+        return false;
+    }
+
+    if (direction & DRIVE_LEFT)
+    {
+        left = DRIVE_TURN_SPEED;
+    }
+    else if (direction & DRIVE_RIGHT)
+    {
+        right = DRIVE_TURN_SPEED;
+    }
+
+    // Wheel speeds are in %, arcs in permille: (l + r)/2 * 10
+    *pLinear = (left + right) * (CAR_SPEED_FULL / 200);
+    *pTurn   = (right - left) * (CAR_SPEED_FULL / 200);
+
+    if (direction & DRIVE_REVERSE)
+    {
+        *pLinear = -*pLinear;
+        *pTurn   = -*pTurn;
+    }
+
+    return true;
 }
 
 /*!
- * Turns the car left while moving forward
+ * Runs one tick of the Car's traction control over the wheel speeds about
+ * to be applied
  *
- * @param[in/out] pCar  Pointer to Car object
- * @param[in]     speed Speed to drive
+ * Each wheel measured afresh on this tick has its share of its commanded
+ * speed updated, and every wheel is then judged on its latest share. The
+ * gripping wheels are taken to be those turning at the lowest share of
+ * their commanded speed, which is never taken as more than the command
+ * itself, so a wheel spinning ahead of the others or of its command is
+ * found slipping. With three or more wheels judged the second lowest share
+ * is taken instead, so one wheel held back (i.e. against an obstacle, or
+ * still starting from rest) does not make the rest look as if slipping. A
+ * wheel found slipping has its demand cut at once, and again on each fresh
+ * measurement that finds it still slipping; others have any cut restored
+ * gradually.
+ *
+ * @param[in/out] pCar      Pointer to Car object
+ * @param[in]     speeds    Wheel speeds indexed by CAR_WHEEL_* (permille)
  */
 static void
-_carDriveForwardLeft
+_carTractionStep
 (
-    Car     *pCar,
-    uint8_t  speed
+    Car           *pCar,
+    const int16_t  speeds[CAR_NUM_WHEELS]
 )
 {
-    pCar->speed     = speed;
-    pCar->direction = DRIVE_FORWARD | DRIVE_LEFT;
+    Motor   *pMotor;
+    int16_t  cmd[CAR_NUM_WHEELS];
+    uint16_t lowest = UINT16_MAX;
+    uint16_t second = UINT16_MAX;
+    uint16_t ground;
+    uint16_t share;
+    uint16_t demand;
+    int32_t  ratio;
+    int32_t  excess;
+    int16_t  speed;
+    uint8_t  fresh = 0;
+    uint8_t  slip  = 0;
+    uint8_t  count = 0;
+    uint8_t  bit;
+    uint8_t  i;
 
-    pCar->pFrontLeft->driveForward(pCar->pFrontLeft, DRIVE_TURN_SPEED);
-    pCar->pFrontRight->driveForward(pCar->pFrontRight, speed);
-    pCar->pBackLeft->driveForward(pCar->pBackLeft, DRIVE_TURN_SPEED);
-    pCar->pBackRight->driveForward(pCar->pBackRight, speed);
+    if (!pCar->bTraction)
+    {
+        return;
+    }
+
+    for (i = 0, bit = 1; i < CAR_NUM_WHEELS; ++i, bit <<= 1)
+    {
+        cmd[i] = CAR_SPEED_TO_MMPS(speeds[i]);
+        if (ABS(cmd[i]) < CAR_TRACTION_MIN_MMPS)
+        {
+            pCar->tractionMask &= ~bit;
+            continue;
+        }
+
+        if (motorSpeedFresh(pCar->pMotors[i], &speed))
+        {
+            // Work in the commanded direction
+            if (cmd[i] < 0)
+            {
+                speed = -speed;
+            }
+
+            ratio = ((int32_t)MAX(speed, 0) << CAR_TRACTION_SHARE_BITS) /
+                    ABS(cmd[i]);
+            pCar->tractionShare[i] = (uint16_t)MIN(ratio, UINT16_MAX);
+            pCar->tractionMask |= bit;
+            fresh |= bit;
+        }
+
+        if (!(pCar->tractionMask & bit))
+        {
+            continue;
+        }
+
+        share = pCar->tractionShare[i];
+        if (share < lowest)
+        {
+            second = lowest;
+            lowest = share;
+        }
+        else if (share < second)
+        {
+            second = share;
+        }
+        ++count;
+    }
+
+    // A single stalled or stuck wheel is not taken as the ground speed
+    ground = MIN((count >= 3) ? second : lowest, CAR_TRACTION_SHARE_UNITY);
+
+    for (i = 0, bit = 1; i < CAR_NUM_WHEELS; ++i, bit <<= 1)
+    {
+        if (!(pCar->tractionMask & bit))
+        {
+            continue;
+        }
+
+        excess = (int32_t)pCar->tractionShare[i] - ground;
+        if (excess > CAR_TRACTION_SHARE_SLIP &&
+            ((excess * ABS(cmd[i])) >> CAR_TRACTION_SHARE_BITS) >
+            CAR_TRACTION_SLIP_MMPS)
+        {
+            slip |= bit;
+        }
+    }
+
+    for (i = 0, bit = 1; i < CAR_NUM_WHEELS; ++i, bit <<= 1)
+    {
+        pMotor = pCar->pMotors[i];
+        demand = pCar->demandMax[i];
+
+        if (slip & bit)
+        {
+            // Cut once per measurement that finds the wheel slipping
+            if ((pCar->slipMask & bit) && !(fresh & bit))
+            {
+                continue;
+            }
+            demand = pMotor->cmdDuty -
+                     (pMotor->cmdDuty >> CAR_TRACTION_CUT_SHIFT);
+        }
+        else if (demand < PWM_PERMILLE_FULL)
+        {
+            demand = MIN(demand + CAR_TRACTION_RECOVER, PWM_PERMILLE_FULL);
+        }
+        else
+        {
+            continue;
+        }
+
+        pCar->demandMax[i] = demand;
+        motorDemandMaxSet(pMotor, demand);
+    }
+
+    pCar->slipMask = slip;
 }
 
 /*!
- * Turns the car right while moving forward
+ * Checks whether a sequenced drive command is newer than every one accepted
+ * before it
+ *
+ * @param[in] pCar      Pointer to Car object
+ * @param[in] seq       Sequence number of the command
  *
- * @param[in/out] pCar  Pointer to Car object
- * @param[in]     speed Speed to drive
+ * @return true if the command should be accepted
  */
-static void
-_carDriveForwardRight
+static bool
+_carCommandSeqAccept
+(
+    const Car *pCar,
+    uint8_t    seq
+)
+{
+    //
+    // Serial number arithmetic: seq is newer if it is ahead of the last
+    // accepted sequence number by less than half the sequence space
+    //
+    return !pCar->bSeqValid || (int8_t)(seq - pCar->seq) > 0;
+}
+
+/*!
+ * Takes a drive command as the one the control tick applies next. The
+ * latest wins, overwriting any command not yet applied, but a sequenced
+ * command is dropped unless it is newer than every one accepted before it.
+ *
+ * @param[in/out] pCar      Pointer to Car object
+ * @param[in]     bSeq      true if the command is sequenced
+ * @param[in]     seq       Sequence number of a sequenced command
+ * @param[in]     linear    Forward speed (permille of full speed)
+ * @param[in]     strafe    Sideways speed (permille of full speed, + left)
+ * @param[in]     turn      Turn rate (permille of full speed, + left)
+ *
+ * @return STATUS_OK if the command was taken
+ * @return STATUS_ERR_GENERAL if it was superseded
+ */
+static STATUS
+_carCommandTake
 (
     Car     *pCar,
-    uint8_t  speed
+    bool     bSeq,
+    uint8_t  seq,
+    int16_t  linear,
+    int16_t  strafe,
+    int16_t  turn
 )
 {
-    pCar->speed     = speed;
-    pCar->direction = DRIVE_FORWARD | DRIVE_RIGHT;
+    STATUS status = STATUS_OK;
 
-    pCar->pFrontLeft->driveForward(pCar->pFrontLeft, speed);
-    pCar->pFrontRight->driveForward(pCar->pFrontRight, DRIVE_TURN_SPEED);
-    pCar->pBackLeft->driveForward(pCar->pBackLeft, speed);
-    pCar->pBackRight->driveForward(pCar->pBackRight, DRIVE_TURN_SPEED);
+    // Checked and taken together, so a racing command cannot slip between
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (bSeq && !_carCommandSeqAccept(pCar, seq))
+        {
+            status = STATUS_ERR_GENERAL;
+        }
+        else
+        {
+            if (bSeq)
+            {
+                pCar->seq       = seq;
+                pCar->bSeqValid = true;
+            }
+            pCar->cmdTick       = tickCountGet();
+            pCar->bCmdLegacy    = !bSeq;
+            pCar->bFailsafe     = false;
+            pCar->pendingLinear = linear;
+            pCar->pendingStrafe = strafe;
+            pCar->pendingTurn   = turn;
+            pCar->bPending      = true;
+        }
+    }
+
+    return status;
 }
 
 /*!
- * Turns the car left (relative to front of car) while moving in reverse
+ * Drops the Car's drive command, targeting rest, so that nothing (i.e. a
+ * derate) re-applies it
  *
- * @param[in/out] pCar  Pointer to Car object
- * @param[in]     speed Speed to drive
+ * @param[in/out] pCar      Pointer to Car object
  */
 static void
-_carDriveReverseLeft
+_carCommandDrop
 (
-    Car     *pCar,
-    uint8_t  speed
+    Car *pCar
 )
 {
-    pCar->speed     = speed;
-    pCar->direction = DRIVE_REVERSE | DRIVE_LEFT;
+    uint8_t i;
 
-    pCar->pFrontLeft->driveReverse(pCar->pFrontLeft, DRIVE_TURN_SPEED);
-    pCar->pFrontRight->driveReverse(pCar->pFrontRight, speed);
-    pCar->pBackLeft->driveReverse(pCar->pBackLeft, DRIVE_TURN_SPEED);
-    pCar->pBackRight->driveReverse(pCar->pBackRight, speed);
+    pCar->bPending      = false;
+    pCar->pendingLinear = 0;
+    pCar->pendingStrafe = 0;
+    pCar->pendingTurn   = 0;
+
+    carDriveHolonomic(pCar, 0, 0, 0);
+    for (i = 0; i < CAR_NUM_WHEELS; ++i)
+    {
+        pCar->wheelAccel[i] = 0;
+    }
 }
 
 /*!
- * Turns the car right (relative to front of car) while moving in reverse
+ * Stops the car once no drive command has been accepted for the failsafe's
+ * window. Runs from the control tick, so is never held up by the main loop.
  *
- * @param[in/out] pCar  Pointer to Car object
- * @param[in]     speed Speed to drive
+ * @param[in/out] pCar      Pointer to Car object
  */
 static void
-_carDriveReverseRight
+_carFailsafeStep
 (
-    Car     *pCar,
-    uint8_t  speed
+    Car *pCar
 )
 {
-    pCar->speed     = speed;
-    pCar->direction = DRIVE_REVERSE | DRIVE_RIGHT;
+    if (pCar->failsafeTicks == 0 || pCar->bFailsafe ||
+        (tickCountGet() - pCar->cmdTick) < pCar->failsafeTicks)
+    {
+        return;
+    }
 
-    pCar->pFrontLeft->driveReverse(pCar->pFrontLeft, speed);
-    pCar->pFrontRight->driveReverse(pCar->pFrontRight, DRIVE_TURN_SPEED);
-    pCar->pBackLeft->driveReverse(pCar->pBackLeft, speed);
-    pCar->pBackRight->driveReverse(pCar->pBackRight, DRIVE_TURN_SPEED);
+    // Ramp from the wheels' current speeds, on the failsafe's own profile
+    pCar->bFailsafe = true;
+    _carCommandDrop(pCar);
 }
 
 /* ------------------------ FUNCTION DEFINITIONS ---------------------------- */
@@ -152,15 +487,82 @@ carConstruct
     Motor *pBackRight
 )
 {
-    pCar->speed     = 0;
-    pCar->direction = DRIVE_FORWARD;
+    uint8_t i;
+
+    pCar->speed          = 0;
+    pCar->direction      = DRIVE_FORWARD;
+    pCar->maxSpeed       = 100;
+    pCar->supplyMaxSpeed = 100;
+
+    pCar->seq           = CAR_CMD_SEQ_INITIAL;
+    pCar->bSeqValid     = false;
+    pCar->bPending      = false;
+    pCar->pendingLinear = 0;
+    pCar->pendingStrafe = 0;
+    pCar->pendingTurn   = 0;
+
+    pCar->mode      = CAR_MODE_DIFFERENTIAL;
+    pCar->linear    = 0;
+    pCar->strafe    = 0;
+    pCar->turn      = 0;
+    pCar->turnScale = 0;
+
+    pCar->profile = carProfileSoft;
+    for (i = 0; i < CAR_NUM_WHEELS; ++i)
+    {
+        pCar->wheelTarget[i] = 0;
+        pCar->wheelSpeed[i]  = 0;
+        pCar->wheelAccel[i]  = 0;
+    }
+
+    pCar->cmdTick       = 0;
+    pCar->bCmdLegacy    = false;
+    pCar->failsafeTicks = MOTOR_MS_TO_TICKS(CAR_FAILSAFE_MS);
+    pCar->bFailsafe     = false;
+
+    pCar->bTraction     = true;
+    pCar->slipMask      = 0;
+    pCar->tractionMask  = 0;
+    for (i = 0; i < CAR_NUM_WHEELS; ++i)
+    {
+        pCar->demandMax[i] = PWM_PERMILLE_FULL;
+    }
+
+    pCar->pMotors[CAR_WHEEL_FRONT_LEFT]  = pFrontLeft;
+    pCar->pMotors[CAR_WHEEL_FRONT_RIGHT] = pFrontRight;
+    pCar->pMotors[CAR_WHEEL_BACK_LEFT]   = pBackLeft;
+    pCar->pMotors[CAR_WHEEL_BACK_RIGHT]  = pBackRight;
 
-    pCar->pFrontLeft  = pFrontLeft;
-    pCar->pFrontRight = pFrontRight;
-    pCar->pBackLeft   = pBackLeft;
-    pCar->pBackRight  = pBackRight;
+    // Wheel duty cycles are staged and committed together on every tick
+    for (i = 0; i < CAR_NUM_WHEELS; ++i)
+    {
+        pCar->pPwms[i] = pCar->pMotors[i]->pPwm;
+        METHOD(pCar->pPwms[i], pwmSetStaged)(pCar->pPwms[i], true);
+    }
 
-    pCar->carDrive = carDrive;
+#if METHOD_POINTERS
+    pCar->carDrive             = carDrive;
+    pCar->carDriveArc          = carDriveArc;
+    pCar->carDriveHolonomic    = carDriveHolonomic;
+    pCar->carModeSet           = carModeSet;
+    pCar->carLinkQualityDerate = carLinkQualityDerate;
+    pCar->carSupplyDerate      = carSupplyDerate;
+    pCar->carCommand           = carCommand;
+    pCar->carCommandArc        = carCommandArc;
+    pCar->carCommandHolonomic  = carCommandHolonomic;
+    pCar->carCommandSeqReset   = carCommandSeqReset;
+    pCar->carCommandLegacy     = carCommandLegacy;
+    pCar->carCommandRefresh    = carCommandRefresh;
+    pCar->carUpdate            = carUpdate;
+    pCar->carControlStep       = carControlStep;
+    pCar->carApplyWheelSpeeds  = carApplyWheelSpeeds;
+    pCar->carProfileSet        = carProfileSet;
+    pCar->carTurnScaleSet      = carTurnScaleSet;
+    pCar->carCalibrate         = carCalibrate;
+    pCar->carTractionSet       = carTractionSet;
+    pCar->carSlipGet           = carSlipGet;
+    pCar->carFailsafeSet       = carFailsafeSet;
+#endif
 }
 
 /*!
@@ -174,24 +576,611 @@ carDrive
     uint8_t  direction
 )
 {
-    switch (direction)
+    int16_t linear;
+    int16_t turn;
+
+    if (pCar == NULL ||
+        !_carDirectionToArc(speed, direction, &linear, &turn))
     {
-        case DRIVE_FORWARD:
-            _carDriveForward(pCar, speed);
-            break;
-        case DRIVE_REVERSE:
-            _carDriveReverse(pCar, speed);
-            break;
-        case DRIVE_FORWARD|DRIVE_LEFT:
-            _carDriveForwardLeft(pCar, speed);
-            break;
-        case DRIVE_FORWARD|DRIVE_RIGHT:
-            _carDriveForwardRight(pCar, speed);
-            break;
-        case DRIVE_REVERSE|DRIVE_LEFT:
-            _carDriveReverseLeft(pCar, speed);
-            break;
-        case DRIVE_REVERSE|DRIVE_RIGHT:
-            _carDriveReverseRight(pCar, speed);
+        return;
+    }
+
+    pCar->speed     = speed;
+    pCar->direction = direction;
+
+    carDriveArc(pCar, linear, turn);
+}
+
+/*!
+ * @ref car.h for function documentation
+ */
+void
+carDriveArc
+(
+    Car     *pCar,
+    int16_t  linear,
+    int16_t  turn
+)
+{
+    // An arc is a holonomic motion with no sideways component
+    carDriveHolonomic(pCar, linear, 0, turn);
+}
+
+/*!
+ * @ref car.h for function documentation
+ */
+void
+carDriveHolonomic
+(
+    Car     *pCar,
+    int16_t  vx,
+    int16_t  vy,
+    int16_t  omega
+)
+{
+    int16_t wheel[CAR_NUM_WHEELS];
+    int16_t mag;
+    int16_t limit;
+    uint8_t i;
+
+    if (pCar == NULL)
+    {
+        return;
+    }
+
+    limit = (int16_t)MIN(pCar->maxSpeed, pCar->supplyMaxSpeed) *
+            (CAR_SPEED_FULL / 100);
+
+    vx    = CLAMP(vx, -CAR_SPEED_FULL, CAR_SPEED_FULL);
+    vy    = CLAMP(vy, -CAR_SPEED_FULL, CAR_SPEED_FULL);
+    omega = CLAMP(omega, -CAR_SPEED_FULL, CAR_SPEED_FULL);
+
+    // Conventional wheels cannot strafe
+    if (pCar->mode != CAR_MODE_MECANUM)
+    {
+        vy = 0;
+    }
+
+    // Optionally soften turns in proportion to linear speed for stability
+    if (pCar->turnScale != 0)
+    {
+        mag   = MAX(ABS(vx), ABS(vy));
+        omega = (int16_t)(((int32_t)omega *
+                           (CAR_SPEED_FULL -
+                            ((int32_t)mag * pCar->turnScale) / CAR_SPEED_FULL))
+                          / CAR_SPEED_FULL);
+    }
+
+    //
+    // Mecanum mixing, rollers in an X when viewed from above. With vy = 0
+    // this reduces to differential drive: the turn rate speeds up one side
+    // and slows the other.
+    //
+    wheel[CAR_WHEEL_FRONT_LEFT]  = vx - vy - omega;
+    wheel[CAR_WHEEL_FRONT_RIGHT] = vx + vy + omega;
+    wheel[CAR_WHEEL_BACK_LEFT]   = vx + vy - omega;
+    wheel[CAR_WHEEL_BACK_RIGHT]  = vx - vy + omega;
+
+    //
+    // If any wheel exceeds the allowed top speed, scale all wheels down
+    // together so the direction of travel and curvature are preserved
+    //
+    mag = 0;
+    for (i = 0; i < CAR_NUM_WHEELS; ++i)
+    {
+        mag = MAX(mag, ABS(wheel[i]));
+    }
+
+    for (i = 0; i < CAR_NUM_WHEELS; ++i)
+    {
+        if (mag > limit)
+        {
+            wheel[i] = (int16_t)(((int32_t)wheel[i] * limit) / mag);
+        }
+    }
+
+    // The control tick reads the targets; it must not see half of them
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        pCar->linear = vx;
+        pCar->strafe = vy;
+        pCar->turn   = omega;
+
+        for (i = 0; i < CAR_NUM_WHEELS; ++i)
+        {
+            pCar->wheelTarget[i] = CAR_SPEED_FIXED(wheel[i]);
+        }
+    }
+}
+
+/*!
+ * @ref car.h for function documentation
+ */
+void
+carModeSet
+(
+    Car     *pCar,
+    uint8_t  mode
+)
+{
+    if (mode != CAR_MODE_DIFFERENTIAL && mode != CAR_MODE_MECANUM)
+    {
+        return;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        pCar->mode     = mode;
+        pCar->bPending = true;
+    }
+}
+
+/*!
+ * @ref car.h for function documentation
+ */
+void
+carLinkQualityDerate
+(
+    Car     *pCar,
+    uint8_t  quality
+)
+{
+    uint8_t maxSpeed = 100;
+
+    //
+    // Below the derate threshold, scale the top speed linearly down to
+    // CAR_LINK_DERATE_MIN_SPEED at zero link quality
+    //
+    if (quality < CAR_LINK_DERATE_QUALITY)
+    {
+        maxSpeed = CAR_LINK_DERATE_MIN_SPEED +
+                   (uint8_t)(((uint16_t)(100 - CAR_LINK_DERATE_MIN_SPEED) *
+                              quality) / CAR_LINK_DERATE_QUALITY);
+    }
+
+    if (maxSpeed == pCar->maxSpeed)
+    {
+        return;
+    }
+
+    //
+    // Re-apply the latest command on the next control tick so a lower limit
+    // takes effect right away
+    //
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        pCar->maxSpeed = maxSpeed;
+        pCar->bPending = true;
+    }
+}
+
+/*!
+ * @ref car.h for function documentation
+ */
+void
+carSupplyDerate
+(
+    Car      *pCar,
+    uint16_t  millivolts
+)
+{
+    uint8_t maxSpeed = 100;
+
+    motorSupplySet(millivolts);
+
+    //
+    // Below the nominal voltage, full duty only drives millivolts /
+    // MOTOR_SUPPLY_NOMINAL_MV of full speed
+    //
+    if (millivolts != 0 && millivolts < MOTOR_SUPPLY_NOMINAL_MV)
+    {
+        maxSpeed = (uint8_t)(((uint32_t)millivolts * 100) /
+                             MOTOR_SUPPLY_NOMINAL_MV);
+    }
+
+    if (maxSpeed == pCar->supplyMaxSpeed)
+    {
+        return;
+    }
+
+    // Re-apply the latest command so the new cap takes effect right away
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        pCar->supplyMaxSpeed = maxSpeed;
+        pCar->bPending       = true;
+    }
+}
+
+/*!
+ * @ref car.h for function documentation
+ */
+STATUS
+carCommand
+(
+    Car     *pCar,
+    uint8_t  seq,
+    uint8_t  speed,
+    uint8_t  direction
+)
+{
+    int16_t linear;
+    int16_t turn;
+
+    if (pCar == NULL)
+    {
+        return STATUS_ERR_INVALID_PTR;
+    }
+
+    if (!_carDirectionToArc(speed, direction, &linear, &turn))
+    {
+        return STATUS_ERR_GENERAL;
+    }
+
+    return _carCommandTake(pCar, true, seq, linear, 0, turn);
+}
+
+/*!
+ * @ref car.h for function documentation
+ */
+STATUS
+carCommandArc
+(
+    Car     *pCar,
+    uint8_t  seq,
+    int16_t  linear,
+    int16_t  turn
+)
+{
+    if (pCar == NULL)
+    {
+        return STATUS_ERR_INVALID_PTR;
+    }
+
+    return _carCommandTake(pCar, true, seq, linear, 0, turn);
+}
+
+/*!
+ * @ref car.h for function documentation
+ */
+STATUS
+carCommandHolonomic
+(
+    Car     *pCar,
+    uint8_t  seq,
+    int16_t  vx,
+    int16_t  vy,
+    int16_t  omega
+)
+{
+    if (pCar == NULL)
+    {
+        return STATUS_ERR_INVALID_PTR;
+    }
+
+    return _carCommandTake(pCar, true, seq, vx, vy, omega);
+}
+
+/*!
+ * @ref car.h for function documentation
+ */
+void
+carCommandSeqReset(Car *pCar)
+{
+    if (pCar == NULL)
+    {
+        return;
+    }
+
+    pCar->bSeqValid = false;
+}
+
+/*!
+ * @ref car.h for function documentation
+ */
+STATUS
+carCommandLegacy
+(
+    Car     *pCar,
+    uint8_t  speed,
+    uint8_t  direction
+)
+{
+    int16_t linear;
+    int16_t turn;
+
+    if (pCar == NULL)
+    {
+        return STATUS_ERR_INVALID_PTR;
+    }
+
+    if (!_carDirectionToArc(speed, direction, &linear, &turn))
+    {
+        return STATUS_ERR_GENERAL;
+    }
+
+    // Latest wins, as for carCommand, but without touching the sequence
+    return _carCommandTake(pCar, false, 0, linear, 0, turn);
+}
+
+/*!
+ * @ref car.h for function documentation
+ */
+STATUS
+carCommandRefresh(Car *pCar)
+{
+    STATUS status = STATUS_ERR_GENERAL;
+
+    if (pCar == NULL)
+    {
+        return STATUS_ERR_INVALID_PTR;
+    }
+
+    // Checked and renewed together, against a command or failsafe between
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (pCar->bCmdLegacy && !pCar->bFailsafe)
+        {
+            pCar->cmdTick = tickCountGet();
+            status        = STATUS_OK;
+        }
+    }
+
+    return status;
+}
+
+/*!
+ * @ref car.h for function documentation
+ */
+void
+carUpdate(Car *pCar)
+{
+    if (!pCar->bPending)
+    {
+        return;
+    }
+
+    pCar->bPending = false;
+
+    carDriveHolonomic(pCar, pCar->pendingLinear, pCar->pendingStrafe,
+                      pCar->pendingTurn);
+}
+
+/*!
+ * @ref car.h for function documentation
+ */
+void
+carControlStep(Car *pCar)
+{
+    const CAR_PROFILE *pProfile;
+    int16_t            speeds[CAR_NUM_WHEELS];
+    uint16_t           mag;
+    uint8_t            i;
+
+    // Take the freshest drive command as the wheels' targets
+    carUpdate(pCar);
+
+    //
+    // The e-stop has already released the motors; hold the wheels at rest
+    // so that nothing drives them once it is cleared
+    //
+    if (estopActiveGet())
+    {
+        _carCommandDrop(pCar);
+        for (i = 0; i < CAR_NUM_WHEELS; ++i)
+        {
+            pCar->wheelSpeed[i] = 0;
+        }
+    }
+
+    // Stop the car if the commands have gone quiet
+    _carFailsafeStep(pCar);
+    pProfile = pCar->bFailsafe ? &carProfileFailsafe : &pCar->profile;
+
+    // Move each wheel one tick along the motion profile towards its target
+    for (i = 0; i < CAR_NUM_WHEELS; ++i)
+    {
+        _carProfileWheelStep(pProfile, pCar->wheelTarget[i],
+                             &pCar->wheelSpeed[i], &pCar->wheelAccel[i]);
+
+        // Round from fixed-point permille to whole permille
+        mag = (uint16_t)ABS((int32_t)pCar->wheelSpeed[i]);
+        mag = (mag + (1 << (CAR_SPEED_FRAC_BITS - 1))) >> CAR_SPEED_FRAC_BITS;
+        speeds[i] = (pCar->wheelSpeed[i] < 0) ? -(int16_t)mag : (int16_t)mag;
+    }
+
+    // Cut any wheel spinning rather than gripping before it is driven
+    _carTractionStep(pCar, speeds);
+
+    carApplyWheelSpeeds(pCar, speeds);
+}
+
+/*!
+ * @ref car.h for function documentation
+ */
+STATUS
+carApplyWheelSpeeds
+(
+    Car           *pCar,
+    const int16_t  speeds[CAR_NUM_WHEELS]
+)
+{
+    int16_t mmps[CAR_NUM_WHEELS];
+    uint8_t i;
+
+    // Validate once for all four wheels
+    if (pCar == NULL || speeds == NULL)
+    {
+        return STATUS_ERR_INVALID_PTR;
+    }
+
+    for (i = 0; i < CAR_NUM_WHEELS; ++i)
+    {
+        mmps[i] = CAR_SPEED_TO_MMPS(CLAMP(speeds[i], -CAR_SPEED_FULL,
+                                          CAR_SPEED_FULL));
+    }
+
+    //
+    // The Car is built on constructed Motors, each of which checked its PWM
+    // then, so they are driven and stepped without checking them per wheel
+    //
+    motorDriveSpeeds(pCar->pMotors, mmps, CAR_NUM_WHEELS);
+
+    // All four wheels pick up their new duty cycles on the same PWM period
+    pwmCommit(pCar->pPwms, CAR_NUM_WHEELS);
+
+    return STATUS_OK;
+}
+
+/*!
+ * @ref car.h for function documentation
+ */
+void
+carProfileSet
+(
+    Car               *pCar,
+    const CAR_PROFILE *pProfile
+)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        pCar->profile = *pProfile;
+    }
+}
+
+/*!
+ * @ref car.h for function documentation
+ */
+void
+carTurnScaleSet
+(
+    Car      *pCar,
+    uint16_t  turnScale
+)
+{
+    if (turnScale > CAR_SPEED_FULL)
+    {
+        turnScale = CAR_SPEED_FULL;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        pCar->turnScale = turnScale;
+        pCar->bPending  = true;
+    }
+}
+
+/*!
+ * @ref car.h for function documentation
+ */
+STATUS
+carCalibrate(Car *pCar)
+{
+    Motor     *pMotor;
+    MOTOR_CAL  cal;
+    uint16_t   slowest = UINT16_MAX;
+    STATUS     status;
+    uint8_t    i;
+
+    if (pCar == NULL)
+    {
+        return STATUS_ERR_INVALID_PTR;
+    }
+
+    // Hold the car at rest, so only the wheel being measured turns
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        pCar->bPending = false;
+        carDriveHolonomic(pCar, 0, 0, 0);
+    }
+
+    // Measure each wheel untrimmed
+    for (i = 0; i < CAR_NUM_WHEELS; ++i)
+    {
+        pMotor = pCar->pMotors[i];
+        status = METHOD_AS(pMotor, calibrate, motorCalibrate)(pMotor);
+        if (status != STATUS_OK)
+        {
+            return status;
+        }
+
+        slowest = MIN(slowest, pMotor->cal.topSpeed);
+    }
+
+    for (i = 0; i < CAR_NUM_WHEELS; ++i)
+    {
+        pMotor   = pCar->pMotors[i];
+        cal      = pMotor->cal;
+        cal.trim = (uint16_t)(((uint32_t)slowest << MOTOR_CAL_TRIM_FRAC_BITS) /
+                              cal.topSpeed);
+
+        METHOD_AS(pMotor, calSet, motorCalSet)(pMotor, &cal);
+        METHOD_AS(pMotor, calSave, motorCalSave)(pMotor, i);
+    }
+
+    return STATUS_OK;
+}
+
+/*!
+ * @ref car.h for function documentation
+ */
+void
+carTractionSet
+(
+    Car  *pCar,
+    bool  bEnable
+)
+{
+    uint8_t i;
+
+    if (pCar == NULL)
+    {
+        return;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        pCar->bTraction     = bEnable;
+        pCar->slipMask      = 0;
+        pCar->tractionMask  = 0;
+
+        // Restore every cut, rather than leave wheels held back untended
+        for (i = 0; i < CAR_NUM_WHEELS; ++i)
+        {
+            pCar->demandMax[i] = PWM_PERMILLE_FULL;
+            motorDemandMaxSet(pCar->pMotors[i], PWM_PERMILLE_FULL);
+        }
+    }
+}
+
+/*!
+ * @ref car.h for function documentation
+ */
+uint8_t
+carSlipGet(Car *pCar)
+{
+    if (pCar == NULL)
+    {
+        return 0;
+    }
+
+    // A single byte, so read whole without disabling interrupts
+    return pCar->slipMask;
+}
+
+/*!
+ * @ref car.h for function documentation
+ */
+void
+carFailsafeSet
+(
+    Car      *pCar,
+    uint16_t  ms
+)
+{
+    uint16_t ticks = MOTOR_MS_TO_TICKS(ms);
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        pCar->failsafeTicks = ticks;
     }
 }
@@ -101,3 +101,75 @@ string2int(const char *str)
 
     return result;
 }
+
+/*!
+ * @ref utils.h for function documentation
+ */
+int16_t
+string2sint(const char *str)
+{
+    int16_t result = 0;
+    bool    bNeg   = false;
+
+    if (*str == '-')
+    {
+        bNeg = true;
+        ++str;
+    }
+
+    while (*str >= '0' && *str <= '9')
+    {
+        result = result*10 + (int16_t)(*str - '0');
+        ++str;
+    }
+
+    return bNeg ? -result : result;
+}
+
+/*!
+ * @ref utils.h for function documentation
+ */
+char *
+int2string
+(
+    char    *dst,
+    int16_t  val
+)
+{
+    if (val < 0)
+    {
+        *dst = '-';
+        ++dst;
+        return uint2string(dst, (uint32_t)(-(int32_t)val));
+    }
+
+    return uint2string(dst, (uint32_t)val);
+}
+
+/*!
+ * @ref utils.h for function documentation
+ */
+char *
+uint2string
+(
+    char     *dst,
+    uint32_t  val
+)
+{
+    char    digits[10];
+    uint8_t n = 0;
+
+    do {
+        digits[n++] = (char)('0' + val % 10);
+        val /= 10;
+    } while (val != 0);
+
+    while (n > 0)
+    {
+        *dst = digits[--n];
+        ++dst;
+    }
+    *dst = '\0';
+
+    return dst;
+}
@@ -0,0 +1,119 @@
+/* Implementation file for the cycle-by-cycle motor current limit */
+
+/* ------------------------- SYSTEM INCLUDES -------------------------------- */
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <util/delay.h>
+#include <stdlib.h>
+
+/* ------------------------- APPLICATION INCLUDES --------------------------- */
+#include "current/current.h"
+#include "common/utils.h"
+
+/* ------------------------- MACROS AND DEFINES ----------------------------- */
+
+/*!
+ * Settling time of the bandgap reference once selected
+ */
+#define CURRENT_LIMIT_BANDGAP_US    (70)
+
+/* ------------------------- STATIC VARIABLES ------------------------------- */
+
+/*!
+ * PWMs chopped on a trip, and the number of trips
+ */
+static PWM              *currentLimitPwms[CURRENT_LIMIT_MAX];
+static uint8_t           currentLimitNum = 0;
+static volatile uint32_t currentLimitEvents = 0;
+
+/* ------------------------- FUNCTION DEFINITIONS --------------------------- */
+
+/*!
+ * @ref current.h for function documentation
+ */
+STATUS
+currentLimitInit
+(
+    PWM     *const pPwms[],
+    uint8_t        numPwms
+)
+{
+    uint8_t i;
+
+    if (pPwms == NULL)
+    {
+        return STATUS_ERR_INVALID_PTR;
+    }
+
+    if (numPwms == 0 || numPwms > CURRENT_LIMIT_MAX)
+    {
+        return STATUS_ERR_GENERAL;
+    }
+
+    // The shunt is an analog input only
+    SET_PORT_BIT_INPUT(DDRE, PE3);
+    CLEAR_BIT(PORTE, PE3);
+    SET_BIT(DIDR1, AIN1D);
+
+    //
+    // Bandgap on the positive input and AIN1 on the negative, as ACME is
+    // left clear by the ADC. The edge may only be chosen with the
+    // interrupt disabled.
+    //
+    ACSR = (1 << ACBG);
+    _delay_us(CURRENT_LIMIT_BANDGAP_US);
+    ACSR = (1 << ACBG) | (1 << ACIS1);
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        for (i = 0; i < numPwms; ++i)
+        {
+            currentLimitPwms[i] = pPwms[i];
+        }
+        currentLimitNum    = numPwms;
+        currentLimitEvents = 0;
+
+        // The output falls as the shunt voltage rises past the bandgap
+        ACSR = (1 << ACBG) | (1 << ACI) | (1 << ACIE) | (1 << ACIS1);
+    }
+
+    return STATUS_OK;
+}
+
+/*!
+ * @ref current.h for function documentation
+ */
+uint32_t
+currentLimitEventsGet(void)
+{
+    uint32_t events;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        events = currentLimitEvents;
+    }
+
+    return events;
+}
+
+/* ------------------------ ISR DEFS ---------------------------------------- */
+
+/*!
+ * Chops every limited PWM for the rest of its carrier period
+ */
+ISR(ANALOG_COMP_vect, ISR_BLOCK)
+{
+    bool    bChopped = false;
+    uint8_t i;
+
+    for (i = 0; i < currentLimitNum; ++i)
+    {
+        bChopped |= pwmChop(currentLimitPwms[i]);
+    }
+
+    if (bChopped)
+    {
+        ++currentLimitEvents;
+    }
+}
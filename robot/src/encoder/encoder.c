@@ -0,0 +1,265 @@
+/* Implementation file for the wheel encoders */
+
+/* ------------------------- SYSTEM INCLUDES -------------------------------- */
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+/* ------------------------- APPLICATION INCLUDES --------------------------- */
+#include "encoder/encoder.h"
+#include "tick/tick.h"
+#include "common/utils.h"
+
+/* ------------------------- MACROS AND DEFINES ----------------------------- */
+
+/*!
+ * Counts an A edge of encoder n, if there was one, and timestamps it. A and
+ * B differ after an A edge when A leads B, which is counted as forward.
+ */
+#define _ENCODER_EDGE(n, pins, changed, stamp) \
+        do { \
+            if ((changed) & (1 << (2*(n)))) \
+            { \
+                if (((pins) ^ ((pins) >> 1)) & (1 << (2*(n)))) \
+                { \
+                    ++encoderCount[n]; \
+                } \
+                else \
+                { \
+                    --encoderCount[n]; \
+                } \
+                encoderStamp[n] = (stamp); \
+            } \
+        } while (0)
+
+/* ------------------------- TYPEDEFS --------------------------------------- */
+
+/*!
+ * Speed estimator state of an encoder
+ */
+typedef struct ENCODER_STATE
+{
+    // Edge count and timestamp of the last edge, as of the last estimate
+    int16_t  countLast;
+    uint16_t stampLast;
+
+    // Whether stampLast is recent enough to time the next edges from
+    bool     bStampValid;
+
+    // Position (edges) and speed estimate
+    int32_t  position;
+    int32_t  speed;
+} ENCODER_STATE;
+
+/* ------------------------- STATIC VARIABLES ------------------------------- */
+
+/*!
+ * Edge counts and the timestamp of each encoder's last edge, kept by the ISR
+ */
+static volatile int16_t  encoderCount[ENCODER_NUM];
+static volatile uint16_t encoderStamp[ENCODER_NUM];
+
+/*!
+ * Encoder pin levels at the last pin change
+ */
+static volatile uint8_t  encoderPinsLast;
+
+/*!
+ * Speed estimator state, and the encoder to estimate on the next update
+ */
+static ENCODER_STATE     encoders[ENCODER_NUM];
+static uint8_t           encoderNext;
+
+/*!
+ * Timestamp counts per second scaled by 2^ENCODER_SPEED_FRAC_BITS, and
+ * ENCODER_STOP_MS in timestamp counts
+ */
+static int32_t           encoderSpeedScale;
+static uint16_t          encoderStopCounts;
+
+/* ------------------------- FUNCTION DEFINITIONS --------------------------- */
+
+/*!
+ * @ref encoder.h for function documentation
+ */
+STATUS
+encoderInit(void)
+{
+    TICK_STATS stats;
+    uint32_t   stampHz;
+    uint32_t   stopCounts;
+    uint8_t    i;
+
+    tickStatsGet(&stats);
+    if (stats.countsPerTick == 0)
+    {
+        return STATUS_ERR_GENERAL;
+    }
+
+    //
+    // Stop detection must fit well within the 2^16 count wrap of the
+    // timestamps, or a stopped wheel's last edge could look recent
+    //
+    stampHz    = F_CPU / stats.cyclesPerCount;
+    stopCounts = (stampHz * ENCODER_STOP_MS) / 1000;
+
+    encoderSpeedScale = (int32_t)(stampHz << ENCODER_SPEED_FRAC_BITS);
+    encoderStopCounts = (uint16_t)MIN(stopCounts, 0x8000);
+
+    // All of PORTK are inputs, with pull-ups for open-collector encoders
+    SET_PORT_MODE(DDRK, INPUT_PORT);
+    PORTK = 0xFF;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        for (i = 0; i < ENCODER_NUM; ++i)
+        {
+            encoderCount[i]         = 0;
+            encoderStamp[i]         = 0;
+            encoders[i].countLast   = 0;
+            encoders[i].stampLast   = 0;
+            encoders[i].bStampValid = false;
+            encoders[i].position    = 0;
+            encoders[i].speed       = 0;
+        }
+        encoderNext     = 0;
+        encoderPinsLast = PINK;
+
+        // Interrupt on the A channels only
+        PCMSK2 = ENCODER_A_MASK;
+        SET_BIT(PCIFR, PCIF2);
+        SET_BIT(PCICR, PCIE2);
+    }
+
+    return STATUS_OK;
+}
+
+/*!
+ * @ref encoder.h for function documentation
+ */
+void
+encoderUpdate(void)
+{
+    ENCODER_STATE *pEnc = &encoders[encoderNext];
+    int16_t        count;
+    int16_t        edges;
+    uint16_t       stamp;
+    uint16_t       now;
+    uint16_t       dt;
+    int32_t        bound;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        count = encoderCount[encoderNext];
+        stamp = encoderStamp[encoderNext];
+        now   = tickTimestampGet();
+    }
+
+    edges           = (int16_t)(count - pEnc->countLast);
+    pEnc->countLast = count;
+    pEnc->position += edges;
+
+    if (edges != 0)
+    {
+        //
+        // Time the edges from the last edge of the previous estimate to the
+        // last edge of this one, rather than over the estimate's window
+        //
+        dt = stamp - pEnc->stampLast;
+        if (pEnc->bStampValid && dt != 0)
+        {
+            pEnc->speed = ((int32_t)edges * encoderSpeedScale) / dt;
+        }
+        pEnc->stampLast   = stamp;
+        pEnc->bStampValid = true;
+    }
+    else if (pEnc->bStampValid)
+    {
+        dt = now - pEnc->stampLast;
+        if (dt >= encoderStopCounts)
+        {
+            pEnc->speed       = 0;
+            pEnc->bStampValid = false;
+        }
+        else
+        {
+            // The wheel is going no faster than one edge in dt
+            bound = encoderSpeedScale / dt;
+            pEnc->speed = CLAMP(pEnc->speed, -bound, bound);
+        }
+    }
+
+    encoderNext = (encoderNext + 1) % ENCODER_NUM;
+}
+
+/*!
+ * @ref encoder.h for function documentation
+ */
+int32_t
+encoderSpeedGet(uint8_t idx)
+{
+    int32_t speed;
+
+    if (idx >= ENCODER_NUM)
+    {
+        return 0;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        speed = encoders[idx].speed;
+    }
+
+    return speed;
+}
+
+/*!
+ * @ref encoder.h for function documentation
+ */
+int32_t
+encoderPositionGet(uint8_t idx)
+{
+    int32_t position;
+
+    if (idx >= ENCODER_NUM)
+    {
+        return 0;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        position = encoders[idx].position;
+    }
+
+    return position;
+}
+
+/*!
+ * @ref encoder.h for function documentation
+ */
+uint8_t
+encoderFreshGet(void)
+{
+    return (encoderNext + ENCODER_NUM - 1) % ENCODER_NUM;
+}
+
+/* ------------------------ ISR DEFS ---------------------------------------- */
+
+/*!
+ * Counts and timestamps the A edges of all encoders. One timestamp serves
+ * every edge of an interrupt, and the counting is unrolled, so each further
+ * edge adds only a handful of cycles.
+ */
+ISR(PCINT2_vect, ISR_BLOCK)
+{
+    uint8_t  pins    = PINK;
+    uint8_t  changed = (pins ^ encoderPinsLast) & ENCODER_A_MASK;
+    uint16_t stamp   = tickTimestampGet();
+
+    encoderPinsLast = pins;
+
+    _ENCODER_EDGE(0, pins, changed, stamp);
+    _ENCODER_EDGE(1, pins, changed, stamp);
+    _ENCODER_EDGE(2, pins, changed, stamp);
+    _ENCODER_EDGE(3, pins, changed, stamp);
+}
@@ -0,0 +1,164 @@
+/* Implementation file for the emergency stop */
+
+/* ------------------------- SYSTEM INCLUDES -------------------------------- */
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <stdlib.h>
+
+/* ------------------------- APPLICATION INCLUDES --------------------------- */
+#include "estop/estop.h"
+#include "common/utils.h"
+
+/* ------------------------- STATIC VARIABLES ------------------------------- */
+
+/*!
+ * PWMs halted on a trip, whether the switch is sensed, and whether the
+ * e-stop has tripped
+ */
+static PWM           *estopPwms[ESTOP_MAX];
+static uint8_t        estopNum = 0;
+static bool           estopSwitch = false;
+static volatile bool  estopActive = false;
+
+/* ------------------------- STATIC FUNCTIONS ------------------------------- */
+
+/*!
+ * Halts every PWM under the e-stop
+ *
+ * @note Must be called with interrupts disabled
+ */
+static inline void
+_estopHalt(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < estopNum; ++i)
+    {
+        pwmHalt(estopPwms[i]);
+    }
+
+    estopActive = true;
+}
+
+/* ------------------------- FUNCTION DEFINITIONS --------------------------- */
+
+/*!
+ * @ref estop.h for function documentation
+ */
+STATUS
+estopInit
+(
+    PWM     *const pPwms[],
+    uint8_t        numPwms,
+    bool           bSwitch
+)
+{
+    uint8_t i;
+
+    if (pPwms == NULL)
+    {
+        return STATUS_ERR_INVALID_PTR;
+    }
+
+    if (numPwms == 0 || numPwms > ESTOP_MAX)
+    {
+        return STATUS_ERR_GENERAL;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        for (i = 0; i < numPwms; ++i)
+        {
+            estopPwms[i] = pPwms[i];
+        }
+        estopNum    = numPwms;
+        estopSwitch = bSwitch;
+    }
+
+    if (!bSwitch)
+    {
+        return STATUS_OK;
+    }
+
+    // Input, pulled up against the normally closed switch
+    SET_PORT_BIT_INPUT(ESTOP_DDR, ESTOP_BIT);
+    SET_BIT(ESTOP_PORT, ESTOP_BIT);
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        // Sense the rising edge, with the interrupt masked while changed
+        CLEAR_BIT(EIMSK, INT0);
+        SET_BIT(EICRA, ISC00);
+        SET_BIT(EICRA, ISC01);
+        SET_BIT(EIFR, INTF0);
+        SET_BIT(EIMSK, INT0);
+
+        // An edge already passed would go unseen
+        if (ESTOP_PIN & (1 << ESTOP_BIT))
+        {
+            _estopHalt();
+        }
+    }
+
+    return STATUS_OK;
+}
+
+/*!
+ * @ref estop.h for function documentation
+ */
+void
+estopTrigger(void)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        _estopHalt();
+    }
+}
+
+/*!
+ * @ref estop.h for function documentation
+ */
+bool
+estopActiveGet(void)
+{
+    return estopActive;
+}
+
+/*!
+ * @ref estop.h for function documentation
+ */
+STATUS
+estopClear(void)
+{
+    STATUS  status = STATUS_OK;
+    uint8_t i;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (estopSwitch && (ESTOP_PIN & (1 << ESTOP_BIT)))
+        {
+            status = STATUS_ERR_GENERAL;
+        }
+        else if (estopActive)
+        {
+            for (i = 0; i < estopNum; ++i)
+            {
+                pwmResume(estopPwms[i]);
+            }
+            estopActive = false;
+        }
+    }
+
+    return status;
+}
+
+/* ------------------------ ISR DEFS ---------------------------------------- */
+
+/*!
+ * Halts every motor PWM as the e-stop switch opens
+ */
+ISR(INT0_vect, ISR_BLOCK)
+{
+    _estopHalt();
+}
@@ -21,6 +21,7 @@ lcdConstruct(LCD *lcd, UART *uart)
 
     lcd->uart = uart;
 
+#if METHOD_POINTERS
     lcd->lcdCursorCmdSend    = lcdCursorCmdSend;
     lcd->lcdBacklightCmdSend = lcdBacklightCmdSend;
     lcd->lcdDisplayCmdSend   = lcdDisplayCmdSend;
@@ -28,6 +29,7 @@ lcdConstruct(LCD *lcd, UART *uart)
     lcd->lcdWrite            = lcdWrite;
     lcd->lcdPrintln          = lcdPrintln;
     lcd->lcdClear            = lcdClear;
+#endif
 }
 
 /*!
@@ -89,7 +91,7 @@ lcdWrite(LCD *lcd, const char *str)
 
     while (*str != '\0')
     {
-        lcd->lcdCharacterSend(lcd, *str);
+        METHOD(lcd, lcdCharacterSend)(lcd, *str);
         str++;
     }
 }
@@ -103,8 +105,8 @@ lcdPrintln(LCD *lcd, const char *str)
     if (lcd == NULL || str == NULL)
         return;
 
-    lcd->lcdWrite(lcd, str);
-    lcd->lcdCursorCmdSend(lcd, LCD_CURSOR_CMD_CR);
+    METHOD(lcd, lcdWrite)(lcd, str);
+    METHOD(lcd, lcdCursorCmdSend)(lcd, LCD_CURSOR_CMD_CR);
 }
 
 /*!
@@ -116,6 +118,6 @@ lcdClear(LCD *lcd)
     if (lcd == NULL)
         return;
 
-    lcd->lcdCursorCmdSend(lcd, LCD_CURSOR_CMD_FF);
+    METHOD(lcd, lcdCursorCmdSend)(lcd, LCD_CURSOR_CMD_FF);
     _delay_ms(10); // Time for LCD to clear display
 }
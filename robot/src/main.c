@@ -7,10 +7,43 @@
 
 /* ------------------------ APPLICATION INCLUDES ---------------------------- */
 #include "car/car.h"
+#include "encoder/encoder.h"
+#include "bemf/bemf.h"
+#include "current/current.h"
+#include "battery/battery.h"
+#include "estop/estop.h"
+#include "ble/ble.h"
+#include "spi/spi.h"
 #include "motor/motor.h"
 #include "pwm/pfcpwm.h"
+#include "tick/tick.h"
 #include "common/utils.h"
 
+/* ------------------------ MACROS AND DEFINES ------------------------------ */
+
+/*!
+ * Set to 0 to run the built-in drive demo instead of taking drive commands
+ * over BLE
+ */
+#ifndef MAIN_BLE_CONTROL
+#define MAIN_BLE_CONTROL    (1)
+#endif
+
+/*!
+ * Set to 1 when the e-stop switch is wired (@ref estop.h). Without it the
+ * e-stop is tripped and cleared only over BLE, since an unwired pin reads
+ * as an open switch and would hold the motors off.
+ */
+#ifndef MAIN_ESTOP_SWITCH
+#define MAIN_ESTOP_SWITCH   (0)
+#endif
+
+/*!
+ * Interval at which the demo repeats its drive command, well within the
+ * Car's failsafe window
+ */
+#define DEMO_REPEAT_MS      (100)
+
 /* ------------------------ MAIN -------------------------------------------- */
 PWM leftFront;
 PWM leftBack;
@@ -24,83 +57,219 @@ Motor rb;
 
 Car car;
 
+#if MAIN_BLE_CONTROL
+BLE ble;
+
+// Defined in ble.c
+extern BLE_GATT_CHAR RobotDriveCharSpeed;
+extern BLE_GATT_CHAR RobotDriveCharDirection;
+extern BLE_GATT_CHAR RobotDriveCharCommand;
+#endif
+
 void test_initialize()
 {
+    PWM *const pwms[] = {&leftFront, &leftBack, &rightFront, &rightBack};
+
     // Construct/Initialize PWM
     pwmConstruct(&leftFront, &DDRE, 4, 5, &PRR1, 3, &TCCR3A, &TCCR3B,
-                 CLK_SEL_NO_PRESCALE, &OCR3A, &OCR3B, &OCR3C);
+                 PWM_CARRIER_HZ, &OCR3A, &OCR3B, &OCR3C);
     pwmConstruct(&leftBack, &DDRH, 4, 5, &PRR1, 4, &TCCR4A, &TCCR4B,
-                 CLK_SEL_NO_PRESCALE, &OCR4A, &OCR4B, &OCR4C);
+                 PWM_CARRIER_HZ, &OCR4A, &OCR4B, &OCR4C);
     pwmConstruct(&rightFront, &DDRB, 6, 7, &PRR0, 3, &TCCR1A, &TCCR1B,
-                 CLK_SEL_NO_PRESCALE, &OCR1A, &OCR1B, &OCR1C);
+                 PWM_CARRIER_HZ, &OCR1A, &OCR1B, &OCR1C);
     pwmConstruct(&rightBack, &DDRL, 4, 5, &PRR1, 5, &TCCR5A, &TCCR5B,
-                 CLK_SEL_NO_PRESCALE, &OCR5A, &OCR5B, &OCR5C);
+                 PWM_CARRIER_HZ, &OCR5A, &OCR5B, &OCR5C);
+
+#if PWM_INTERLEAVE
+    // Interleave the motors' on times, a quarter period apart
+    pwmSetPhase(&leftFront,  PWM_PHASE_0);
+    pwmSetPhase(&rightFront, PWM_PHASE_90);
+    pwmSetPhase(&leftBack,   PWM_PHASE_180);
+    pwmSetPhase(&rightBack,  PWM_PHASE_270);
+#endif
 
     pwmInit(&leftFront);
     pwmInit(&leftBack);
     pwmInit(&rightFront);
     pwmInit(&rightBack);
 
+    // Start all four wheels' timers together, at their chosen phases
+    pwmSyncStart(pwms, sizeof(pwms)/sizeof(pwms[0]));
+
+#if PWM_DITHER
+    // Spread fractional duty cycles over successive carrier periods
+    pwmDitherStart(pwms, sizeof(pwms)/sizeof(pwms[0]));
+#endif
+
     // Construct motors...
     motorConstruct(&lf, &leftFront);
     motorConstruct(&lb, &leftBack);
     motorConstruct(&rf, &rightFront);
     motorConstruct(&rb, &rightBack);
-}
 
-void test_driveForwardFullSpeed()
-{
-    // Do the driving...
-    lf.driveForward(&lf, 100);
-    lb.driveForward(&lb, 25);
-    rf.driveForward(&rf, 100);
-    rb.driveForward(&rb, 25);
+    // Construct the car...
+    carConstruct(&car, &lf, &rf, &lb, &rb);
 }
 
-void test_changeSpeed(uint8_t speed)
+/*!
+ * Control tick handler running the wheel speed estimates and the Car's
+ * control loop
+ */
+static void
+carTickHandler(void *pArg)
 {
-    // Change speed of each motor
-    lf.changeSpeed(&lf, speed);
-    lb.changeSpeed(&lb, speed);
-    rf.changeSpeed(&rf, speed);
-    rb.changeSpeed(&rb, speed);
+    Car     *pCar = (Car *)pArg;
+    uint8_t  ble  = EIMSK & (1 << BLE_IRQ);
+
+    //
+    // The loop takes a good part of the tick, so let the e-stop, PWM, ADC
+    // and encoder interrupts preempt it. The BLE interrupt stays masked
+    // until it is done, since its handler drives the Car; it is already
+    // masked if the tick preempted that handler, and is left so.
+    //
+    CLEAR_BIT(EIMSK, BLE_IRQ);
+    sei();
+
+    // Compensate the motors for the battery as it discharges
+    batteryUpdate();
+    METHOD(pCar, carSupplyDerate)(pCar, batteryVoltageGet());
+
+#if CAR_SENSORLESS
+    METHOD(pCar, carControlStep)(pCar);
+
+    // Sample the next motor once its new duty cycle is committed
+    bemfUpdate();
+#else
+    encoderUpdate();
+    METHOD(pCar, carControlStep)(pCar);
+#endif
+
+    cli();
+    EIMSK |= ble;
 }
 
-void test_driveReverseFullSpeed()
+#if MAIN_BLE_CONTROL
+/*!
+ * Takes drive commands over BLE for ever. The drive characteristics are
+ * polled back to back, and the link monitor, which adapts the TX power and
+ * derates the Car's top speed on a weak link, runs every
+ * BLE_LINK_MONITOR_PERIOD_MS as a low-rate background task.
+ */
+static void
+bleControlRun(BLE *pBLE)
 {
-    // Reverse each motor and drive full speed
-    lf.driveReverse(&lf, 25);
-    lb.driveReverse(&lb, 100);
-    rf.driveReverse(&rf, 25);
-    rb.driveReverse(&rb, 100);
-}
+    const uint16_t period  =
+        (uint16_t)(((uint32_t)BLE_LINK_MONITOR_PERIOD_MS * TICK_HZ) / 1000);
+    uint32_t       monitor = tickCountGet();
+
+    METHOD(pBLE, bleServicesConfigure)(pBLE);
+    METHOD(pBLE, bleConnect)(pBLE);
+
+    while (true)
+    {
+        METHOD(pBLE, bleCharacteristicUpdate)(pBLE, &RobotDriveCharCommand);
+        METHOD(pBLE, bleCharacteristicUpdate)(pBLE, &RobotDriveCharSpeed);
+        METHOD(pBLE, bleCharacteristicUpdate)(pBLE, &RobotDriveCharDirection);
 
-void test_stop()
+        if ((tickCountGet() - monitor) >= period)
+        {
+            monitor += period;
+            METHOD(pBLE, bleLinkMonitor)(pBLE);
+        }
+    }
+}
+#else
+/*!
+ * Drives the car with one command for a while, repeating it as a controller
+ * would so that the Car's failsafe does not stop it
+ */
+static void
+demoCommandHold(uint8_t *pSeq, uint8_t speed, uint8_t direction, uint16_t ms)
 {
-    // Stop each motor
-    lf.stop(&lf);
-    lb.stop(&lb);
-    rf.stop(&rf);
-    rb.stop(&rb);
+    for (; ms >= DEMO_REPEAT_MS; ms -= DEMO_REPEAT_MS)
+    {
+        METHOD(&car, carCommand)(&car, ++*pSeq, speed, direction);
+        _delay_ms(DEMO_REPEAT_MS);
+    }
 }
+#endif
 
 int main(void)
 {
+#if !MAIN_BLE_CONTROL
+    uint8_t seq = CAR_CMD_SEQ_INITIAL;
+#endif
+    uint8_t i;
+
+    // Initialize PWM, Motors and Car
+    test_initialize();
+
+    // Chop all four wheels' PWMs whenever the shared shunt trips
+    currentLimitInit(car.pPwms, CAR_NUM_WHEELS);
+
+    // Halt all four wheels' PWMs on an e-stop, from the switch if wired
+    estopInit(car.pPwms, CAR_NUM_WHEELS, MAIN_ESTOP_SWITCH);
+
+    // Motors are only ever updated from the fixed-rate control tick
+    tickHandlerSet(carTickHandler, &car);
+    tickInit(TICK_HZ);
+
+    // The battery is sampled from the tick
+    batteryInit();
+
+#if CAR_SENSORLESS
+    // Wheel CAR_WHEEL_* n is sampled on back-EMF input n
+    bemfInit(car.pPwms, CAR_NUM_WHEELS);
+
+    // Close each wheel's speed loop on its motor's back-EMF
+    for (i = 0; i < CAR_NUM_WHEELS; ++i)
+    {
+        motorFeedbackSet(car.pMotors[i], MOTOR_FEEDBACK_BEMF, i,
+                         CAR_WHEEL_MMPS_PER_VOLT);
+    }
+#else
+    // Encoder n is wired to wheel CAR_WHEEL_* n, timed from the tick
+    encoderInit();
+
+    // Close each wheel's speed loop on its encoder
+    for (i = 0; i < CAR_NUM_WHEELS; ++i)
+    {
+        motorFeedbackSet(car.pMotors[i], MOTOR_FEEDBACK_ENCODER, i,
+                         CAR_WHEEL_UM_PER_EDGE);
+    }
+#endif
+
+    // Apply each wheel's calibration from EEPROM, where it has one
+    for (i = 0; i < CAR_NUM_WHEELS; ++i)
+    {
+        motorCalLoad(car.pMotors[i], i);
+    }
+
+#if MAIN_BLE_CONTROL
+    // SPI and BLE init; BLE_IRQ is serviced by interrupt once enabled
+    spiMasterInit();
+    bleConstruct(&ble);
+    METHOD(&ble, bleInitialize)(&ble);
+#endif
+
     // Enable global interrupts
     sei();
 
-    // Initialize PWM and Motors
-    test_initialize();
+#if CAR_CALIBRATE
+    // Measure and save the calibrations, which needs the control tick
+    METHOD(&car, carCalibrate)(&car);
+#endif
 
+#if MAIN_BLE_CONTROL
+    bleControlRun(&ble);
+#else
     while (true)
     {
-        test_driveForwardFullSpeed();
-        _delay_ms(2000);
-        test_driveReverseFullSpeed();
-        _delay_ms(2000);
-        test_stop();
-        _delay_ms(2000);
+        demoCommandHold(&seq, 100, DRIVE_FORWARD, 2000);
+        demoCommandHold(&seq, 100, DRIVE_REVERSE, 2000);
+        demoCommandHold(&seq, 0, DRIVE_FORWARD, 2000);
     }
+#endif
 
     return 0;
 }
@@ -2,12 +2,753 @@
 
 /* ------------------------- SYSTEM INCLUDES -------------------------------- */
 #include <avr/io.h>
+#include <avr/eeprom.h>
+#include <util/atomic.h>
 #include <stdlib.h>
 
 /* ------------------------- APPLICATION INCLUDES --------------------------- */
 #include "motor/motor.h"
 #include "common/utils.h"
 
+/* ------------------------- MACROS AND DEFINES ----------------------------- */
+
+/*!
+ * Bound of the speed loop's integral term: full duty, scaled as the gains
+ */
+#define MOTOR_PID_INTEG_MAX \
+        ((int32_t)PWM_PERMILLE_FULL << MOTOR_PID_FRAC_BITS)
+
+/*!
+ * Fractional bits carried below the permille through the output, as the
+ * speed loop computes them, so that the dithered PWM can drive them
+ */
+#define MOTOR_DUTY_FRAC_BITS    MOTOR_PID_FRAC_BITS
+#define MOTOR_DUTY_FULL \
+        ((uint32_t)PWM_PERMILLE_FULL << MOTOR_DUTY_FRAC_BITS)
+
+/*!
+ * Q16 scale from a duty cycle carrying MOTOR_DUTY_FRAC_BITS to a 16-bit
+ * duty cycle, rounded up so that full duty reaches PWM_DUTY_FULL
+ */
+#define MOTOR_DUTY_16_SCALE \
+        ((((uint32_t)PWM_DUTY_FULL << 16) + MOTOR_DUTY_FULL - 1) / \
+         MOTOR_DUTY_FULL)
+
+/*!
+ * Q16 scale from a permille demand to its position along the calibration
+ * curve, in 1/256ths of a segment, rounded up so that full demand lands
+ * exactly on the last point
+ */
+#define MOTOR_CAL_POS_SCALE \
+        (((((uint32_t)MOTOR_CAL_POINTS << 8) << 16) + PWM_PERMILLE_FULL - 1) / \
+         PWM_PERMILLE_FULL)
+
+/*!
+ * Marks an EEPROM slot holding a calibration
+ */
+#define MOTOR_CAL_MAGIC     (0xCA)
+
+/*!
+ * Heat (permille^2) at which the thermal derating starts, and at which it
+ * reaches the rated duty; and the Q16 scale from the heat past the start to
+ * the duty cycle shed, rounded up so the limit reaches the rated duty
+ */
+#define MOTOR_THERMAL_HEAT_RATED \
+        ((uint32_t)MOTOR_THERMAL_RATED_DUTY * MOTOR_THERMAL_RATED_DUTY)
+#define MOTOR_THERMAL_HEAT_START \
+        ((MOTOR_THERMAL_HEAT_RATED * MOTOR_THERMAL_START_PCT) / 100)
+#define MOTOR_THERMAL_HEAT_SPAN \
+        (MOTOR_THERMAL_HEAT_RATED - MOTOR_THERMAL_HEAT_START)
+#define MOTOR_THERMAL_DERATE_SCALE \
+        ((((uint32_t)(PWM_PERMILLE_FULL - MOTOR_THERMAL_RATED_DUTY) << 16) + \
+          MOTOR_THERMAL_HEAT_SPAN - 1) / MOTOR_THERMAL_HEAT_SPAN)
+
+/* ------------------------- TYPEDEFS --------------------------------------- */
+
+/*!
+ * A calibration as kept in EEPROM
+ */
+typedef struct MOTOR_CAL_RECORD
+{
+    uint8_t   magic;
+    MOTOR_CAL cal;
+    uint8_t   checksum;
+} MOTOR_CAL_RECORD;
+
+/* ------------------------- STATIC VARIABLES ------------------------------- */
+
+/*!
+ * EEPROM slots for the Motors' calibrations
+ */
+static MOTOR_CAL_RECORD EEMEM motorCalRecords[MOTOR_CAL_SLOTS];
+
+/*!
+ * State of the calibration routine, which measures one Motor at a time: the
+ * Motor (NULL when none), its result, the curve point being measured (0
+ * while searching for the minimum duty), the duty driven and the ticks left
+ * until its speed is measured, and the speed measured at each point
+ */
+static Motor * volatile motorCalMotor = NULL;
+static volatile STATUS  motorCalStatus;
+static uint8_t          motorCalPoint;
+static uint16_t         motorCalDuty;
+static uint16_t         motorCalMinDuty;
+static uint16_t         motorCalTicks;
+static int16_t          motorCalSpeeds[MOTOR_CAL_POINTS + 1];
+
+/*!
+ * Supply voltage compensation of every Motor's driven duty cycles, scaled
+ * by 2^MOTOR_SUPPLY_COMP_FRAC_BITS
+ */
+static uint16_t         motorSupplyComp = (1 << MOTOR_SUPPLY_COMP_FRAC_BITS);
+
+/* ------------------------- STATIC FUNCTIONS ------------------------------- */
+
+/*!
+ * Records a requested H-bridge state and duty cycle for the next call to
+ * motorStep
+ *
+ * @param[in/out] pMotor    pointer to the Motor object
+ * @param[in]     state     requested state
+ * @param[in]     duty      duty cycle of the requested state (permille)
+ */
+static void
+_motorDutySet
+(
+    Motor    *pMotor,
+    uint8_t   state,
+    uint16_t  duty
+)
+{
+    if (duty > PWM_PERMILLE_FULL)
+    {
+        duty = PWM_PERMILLE_FULL;
+    }
+
+    // Driving at zero duty is coasting
+    if (duty == 0 && state != MOTOR_STATE_BRAKE)
+    {
+        state = MOTOR_STATE_COAST;
+    }
+
+    pMotor->cmdState    = state;
+    pMotor->cmdDuty     = duty;
+    pMotor->cmdDutyFrac = 0;
+
+    // Keep the legacy speed and direction fields in step
+    pMotor->speed = (uint8_t)((duty + 5) / 10);
+    if (state == MOTOR_STATE_FORWARD)
+    {
+        pMotor->bDirection = FORWARD_DIR;
+    }
+    else if (state == MOTOR_STATE_REVERSE)
+    {
+        pMotor->bDirection = REVERSE_DIR;
+    }
+}
+
+/*!
+ * Records an open-loop request, taking the Motor out of speed control
+ *
+ * @param[in/out] pMotor    pointer to the Motor object
+ * @param[in]     state     requested state
+ * @param[in]     duty      duty cycle of the requested state (permille)
+ */
+static void
+_motorRequest
+(
+    Motor    *pMotor,
+    uint8_t   state,
+    uint16_t  duty
+)
+{
+    pMotor->bSpeedCmd = false;
+    _motorDutySet(pMotor, state, duty);
+}
+
+/*!
+ * Records a speed request, putting the Motor under speed control
+ *
+ * @param[in/out] pMotor    pointer to the Motor object
+ * @param[in]     mmps      requested speed (mm/s, + forward)
+ */
+static void
+_motorSpeedRequest
+(
+    Motor   *pMotor,
+    int16_t  mmps
+)
+{
+    //
+    // Restart the integral on entering speed control or changing direction,
+    // and run the loop on the next step
+    //
+    if (!pMotor->bSpeedCmd || (mmps < 0) != (pMotor->cmdSpeed < 0))
+    {
+        pMotor->pidInteg = 0;
+        pMotor->pidTicks = 1;
+    }
+
+    pMotor->cmdSpeed  = mmps;
+    pMotor->bSpeedCmd = true;
+}
+
+/*!
+ * Measures the speed of the Motor's wheel
+ *
+ * @param[in] pMotor    pointer to the Motor object
+ *
+ * @return the signed speed (mm/s)
+ */
+static int16_t
+_motorSpeedMeasure
+(
+    Motor *pMotor
+)
+{
+    int32_t mmps;
+
+    switch (pMotor->feedback)
+    {
+        case MOTOR_FEEDBACK_ENCODER:
+            mmps = (encoderSpeedGet(pMotor->feedbackIdx) *
+                    pMotor->feedbackScale) /
+                   (1000L << ENCODER_SPEED_FRAC_BITS);
+            break;
+        case MOTOR_FEEDBACK_BEMF:
+            mmps = ((int32_t)bemfGet(pMotor->feedbackIdx) *
+                    pMotor->feedbackScale) / 1000;
+            break;
+        default:
+            return 0;
+    }
+
+    return (int16_t)CLAMP(mmps, -INT16_MAX, INT16_MAX);
+}
+
+/*!
+ * Runs the Motor's speed loop: measures the wheel's speed and, under speed
+ * control, requests the resulting duty cycle
+ *
+ * The loop works on speeds in the requested direction, and its output is
+ * clamped to 0..PWM_PERMILLE_FULL, so it only ever eases off rather than
+ * reversing. The integral term stops growing while the output is clamped
+ * in the direction it would push (anti-windup), and the derivative term
+ * acts on the measured speed so that setpoint changes cause no kick.
+ *
+ * @param[in/out] pMotor    pointer to the Motor object
+ */
+static void
+_motorSpeedControl
+(
+    Motor *pMotor
+)
+{
+    const MOTOR_PID *pPid   = &pMotor->pid;
+    int16_t          target = pMotor->cmdSpeed;
+    int16_t          mag    = ABS(target);
+    int16_t          speed;
+    int32_t          delta;
+    int32_t          err;
+    int32_t          integ;
+    int32_t          duty;
+    int32_t          max;
+
+    speed = _motorSpeedMeasure(pMotor);
+    delta = (int32_t)speed - pMotor->pidSpeedLast;
+    pMotor->pidSpeedLast = speed;
+
+    if (!pMotor->bSpeedCmd)
+    {
+        return;
+    }
+
+    if (target == 0)
+    {
+        pMotor->pidInteg = 0;
+        _motorDutySet(pMotor, MOTOR_STATE_COAST, 0);
+        return;
+    }
+
+    //
+    // Feed-forward from the duty map. The output is kept scaled as the
+    // gains, so that its fraction of a permille reaches the PWM.
+    //
+    max  = (int32_t)pMotor->demandMax << MOTOR_PID_FRAC_BITS;
+    duty = ((int32_t)pPid->ffOffset << MOTOR_PID_FRAC_BITS) +
+           (int32_t)pPid->ffGain * mag;
+
+    if (pMotor->feedback != MOTOR_FEEDBACK_NONE)
+    {
+        if (target < 0)
+        {
+            speed = -speed;
+            delta = -delta;
+        }
+
+        err   = (int32_t)mag - speed;
+        integ = pMotor->pidInteg + (int32_t)pPid->ki * err;
+
+        duty += (int32_t)pPid->kp * err + integ -
+                (int32_t)pPid->kd * delta;
+
+        //
+        // Anti-windup: hold the integral while it would push the output
+        // further past the clamp
+        //
+        if (duty > max)
+        {
+            duty = max;
+            if (err > 0)
+            {
+                integ = pMotor->pidInteg;
+            }
+        }
+        else if (duty < 0)
+        {
+            duty = 0;
+            if (err < 0)
+            {
+                integ = pMotor->pidInteg;
+            }
+        }
+
+        pMotor->pidInteg = CLAMP(integ, -MOTOR_PID_INTEG_MAX,
+                                 MOTOR_PID_INTEG_MAX);
+    }
+
+    duty = CLAMP(duty, 0, max);
+    _motorDutySet(pMotor,
+                  (target < 0) ? MOTOR_STATE_REVERSE : MOTOR_STATE_FORWARD,
+                  (uint16_t)(duty >> MOTOR_PID_FRAC_BITS));
+    pMotor->cmdDutyFrac = (uint8_t)duty;
+}
+
+/*!
+ * Fills in the calibration of an uncalibrated Motor, which drives every
+ * demand as it is
+ *
+ * @param[out] pCal     pointer to the calibration
+ */
+static void
+_motorCalDefault
+(
+    MOTOR_CAL *pCal
+)
+{
+    uint8_t k;
+
+    pCal->minDuty = 0;
+    for (k = 0; k < MOTOR_CAL_POINTS; ++k)
+    {
+        pCal->curve[k] = (uint16_t)(((uint32_t)(k + 1) * PWM_PERMILLE_FULL) /
+                                    MOTOR_CAL_POINTS);
+    }
+    pCal->trim     = MOTOR_CAL_TRIM_UNITY;
+    pCal->topSpeed = MOTOR_SPEED_MAX_MMPS;
+}
+
+/*!
+ * Computes the checksum of a calibration kept in EEPROM
+ *
+ * @param[in] pCal      pointer to the calibration
+ *
+ * @return the complement of the sum of the calibration's bytes
+ */
+static uint8_t
+_motorCalChecksum
+(
+    const MOTOR_CAL *pCal
+)
+{
+    const uint8_t *pByte = (const uint8_t *)pCal;
+    uint8_t        sum   = 0;
+    uint8_t        i;
+
+    for (i = 0; i < sizeof(*pCal); ++i)
+    {
+        sum += pByte[i];
+    }
+
+    return (uint8_t)~sum;
+}
+
+/*!
+ * Maps a demand through a calibration, with multiplies and shifts only
+ *
+ * @param[in] pCal      pointer to the calibration
+ * @param[in] demand    duty cycle demanded (permille, carrying
+ *                      MOTOR_DUTY_FRAC_BITS)
+ *
+ * @return the duty cycle to drive (permille, carrying MOTOR_DUTY_FRAC_BITS)
+ */
+static uint32_t
+_motorCalApply
+(
+    const MOTOR_CAL *pCal,
+    uint32_t         demand
+)
+{
+    uint32_t pos;
+    uint16_t lo;
+    uint16_t hi;
+    uint8_t  seg;
+
+    // No demand still coasts, rather than driving at the minimum duty
+    if (demand == 0)
+    {
+        return 0;
+    }
+
+    // Two fractional bits are dropped first, so that any trim fits 32 bits
+    demand = MIN(((demand >> 2) * pCal->trim) >>
+                 (MOTOR_CAL_TRIM_FRAC_BITS - 2), MOTOR_DUTY_FULL);
+
+    // Position in 1/65536ths of a segment, scaling whole and fraction apart
+    pos = (((demand >> MOTOR_DUTY_FRAC_BITS) * MOTOR_CAL_POS_SCALE) +
+           (((demand & ((1 << MOTOR_DUTY_FRAC_BITS) - 1)) *
+             MOTOR_CAL_POS_SCALE) >> MOTOR_DUTY_FRAC_BITS)) >> 8;
+    seg = (uint8_t)(pos >> 16);
+    if (seg >= MOTOR_CAL_POINTS)
+    {
+        return (uint32_t)pCal->curve[MOTOR_CAL_POINTS - 1] <<
+               MOTOR_DUTY_FRAC_BITS;
+    }
+
+    lo = (seg == 0) ? pCal->minDuty : pCal->curve[seg - 1];
+    hi = pCal->curve[seg];
+
+    return ((uint32_t)lo << MOTOR_DUTY_FRAC_BITS) +
+           ((((uint32_t)(hi - lo) * (uint16_t)pos) >>
+             (16 - MOTOR_DUTY_FRAC_BITS)));
+}
+
+/*!
+ * Fits the calibration curve to the speeds measured by the calibration
+ * routine. Each point of the curve is the duty at which the wheel reached
+ * its share of the top speed, interpolated between the duties measured.
+ *
+ * @param[out] pCal     pointer to the calibration to fill in, but for trim
+ */
+static void
+_motorCalFit
+(
+    MOTOR_CAL *pCal
+)
+{
+    int16_t  *pSpeeds = &motorCalSpeeds[0];
+    uint16_t  span    = PWM_PERMILLE_FULL - motorCalMinDuty;
+    uint16_t  prev    = motorCalMinDuty;
+    uint16_t  duty;
+    int32_t   target;
+    int32_t   rise;
+    uint8_t   j = 0;
+    uint8_t   k;
+
+    // Speed should never fall as the duty rises; hold any dip level
+    for (k = 1; k <= MOTOR_CAL_POINTS; ++k)
+    {
+        pSpeeds[k] = MAX(pSpeeds[k], pSpeeds[k - 1]);
+    }
+
+    for (k = 0; k < MOTOR_CAL_POINTS; ++k)
+    {
+        target = ((int32_t)pSpeeds[MOTOR_CAL_POINTS] * (k + 1)) /
+                 MOTOR_CAL_POINTS;
+
+        // Find the measured duties j and j + 1 whose speeds span the target
+        while (j < MOTOR_CAL_POINTS - 1 && pSpeeds[j + 1] < target)
+        {
+            ++j;
+        }
+
+        rise = pSpeeds[j + 1] - pSpeeds[j];
+        if (target <= pSpeeds[j] || rise == 0)
+        {
+            duty = motorCalMinDuty +
+                   (uint16_t)(((uint32_t)span * j) / MOTOR_CAL_POINTS);
+        }
+        else
+        {
+            duty = motorCalMinDuty +
+                   (uint16_t)(((int32_t)span *
+                               (j * rise + (target - pSpeeds[j]))) /
+                              (MOTOR_CAL_POINTS * rise));
+        }
+
+        pCal->curve[k] = prev = MAX(duty, prev);
+    }
+
+    // Full demand always drives at full duty, to carry the heaviest load
+    pCal->curve[MOTOR_CAL_POINTS - 1] = PWM_PERMILLE_FULL;
+
+    pCal->minDuty  = motorCalMinDuty;
+    pCal->topSpeed = (uint16_t)pSpeeds[MOTOR_CAL_POINTS];
+}
+
+/*!
+ * Runs one tick of the calibration routine on the Motor being calibrated,
+ * overriding whatever it was requested to do
+ *
+ * @param[in/out] pMotor    pointer to the Motor object
+ */
+static void
+_motorCalStep
+(
+    Motor *pMotor
+)
+{
+    int16_t speed;
+
+    if (--motorCalTicks == 0)
+    {
+        motorCalTicks = MOTOR_MS_TO_TICKS(MOTOR_CAL_SETTLE_MS);
+        speed         = _motorSpeedMeasure(pMotor);
+
+        if (motorCalPoint == 0)
+        {
+            // Searching for the duty at which the wheel starts
+            if (speed >= MOTOR_CAL_START_MMPS)
+            {
+                motorCalMinDuty   = motorCalDuty;
+                motorCalSpeeds[0] = speed;
+                motorCalPoint     = 1;
+            }
+            else if (motorCalDuty >= PWM_PERMILLE_FULL)
+            {
+                motorCalStatus = STATUS_ERR_GENERAL;
+                motorCalMotor  = NULL;
+            }
+            else
+            {
+                motorCalDuty = MIN(motorCalDuty + MOTOR_CAL_RAMP_STEP,
+                                   PWM_PERMILLE_FULL);
+            }
+        }
+        else
+        {
+            motorCalSpeeds[motorCalPoint] = speed;
+            if (motorCalPoint == MOTOR_CAL_POINTS)
+            {
+                _motorCalFit(&pMotor->cal);
+                motorCalStatus = STATUS_OK;
+                motorCalMotor  = NULL;
+            }
+            else
+            {
+                ++motorCalPoint;
+            }
+        }
+
+        if (motorCalPoint != 0)
+        {
+            motorCalDuty = motorCalMinDuty +
+                           (uint16_t)(((uint32_t)(PWM_PERMILLE_FULL -
+                                                  motorCalMinDuty) *
+                                       motorCalPoint) / MOTOR_CAL_POINTS);
+        }
+    }
+
+    if (motorCalMotor == pMotor)
+    {
+        _motorDutySet(pMotor, MOTOR_STATE_FORWARD, motorCalDuty);
+    }
+    else
+    {
+        _motorDutySet(pMotor, MOTOR_STATE_COAST, 0);
+    }
+}
+
+/*!
+ * Integrates the duty cycle driven this tick into the Motor's thermal model,
+ * and derives the duty cycle limit for the next tick. Costs a multiply or
+ * two and no divide, for the control tick.
+ *
+ * @param[in/out] pMotor    pointer to the Motor object
+ * @param[in]     duty      duty cycle driven (permille)
+ */
+static void
+_motorThermalUpdate
+(
+    Motor    *pMotor,
+    uint16_t  duty
+)
+{
+    uint32_t sq = ((uint32_t)duty * duty) << MOTOR_THERMAL_FRAC_BITS;
+    uint32_t heat;
+    uint16_t shed;
+
+    // First-order lag towards the square of the duty cycle
+    pMotor->thermalHeat += (int32_t)(sq - pMotor->thermalHeat) >>
+                           MOTOR_THERMAL_TAU_SHIFT;
+
+    heat = pMotor->thermalHeat >> MOTOR_THERMAL_FRAC_BITS;
+    if (heat <= MOTOR_THERMAL_HEAT_START)
+    {
+        pMotor->dutyLimit = PWM_PERMILLE_FULL;
+        return;
+    }
+
+    heat = MIN(heat - MOTOR_THERMAL_HEAT_START, MOTOR_THERMAL_HEAT_SPAN);
+    shed = (uint16_t)((heat * MOTOR_THERMAL_DERATE_SCALE) >> 16);
+
+    pMotor->dutyLimit = MAX(PWM_PERMILLE_FULL - shed,
+                            MOTOR_THERMAL_RATED_DUTY);
+}
+
+/*!
+ * Drives the H-bridge outputs for the Motor's current state
+ *
+ * @param[in/out] pMotor    pointer to the Motor object
+ */
+static void
+_motorOutputApply
+(
+    Motor *pMotor
+)
+{
+    PWM      *pPwm = pMotor->pPwm;
+    uint32_t  duty;
+
+    //
+    // Driven duties pass through the calibration, unless being measured,
+    // are then compensated for the supply voltage, and are held within the
+    // thermal limit, all carrying the speed loop's fraction of a permille
+    //
+    duty = ((uint32_t)pMotor->cmdDuty << MOTOR_DUTY_FRAC_BITS) +
+           pMotor->cmdDutyFrac;
+    if ((pMotor->state == MOTOR_STATE_FORWARD ||
+         pMotor->state == MOTOR_STATE_REVERSE) && pMotor != motorCalMotor)
+    {
+        duty = _motorCalApply(&pMotor->cal, duty);
+        duty = MIN((duty * motorSupplyComp) >> MOTOR_SUPPLY_COMP_FRAC_BITS,
+                   MOTOR_DUTY_FULL);
+        duty = MIN(duty,
+                   (uint32_t)pMotor->dutyLimit << MOTOR_DUTY_FRAC_BITS);
+    }
+
+    switch (pMotor->state)
+    {
+        case MOTOR_STATE_FORWARD:
+            pPwm->dir = PWM_FORWARD;
+            break;
+        case MOTOR_STATE_REVERSE:
+            pPwm->dir = PWM_REVERSE;
+            break;
+        case MOTOR_STATE_BRAKE:
+            pPwm->dir = PWM_BRAKE;
+            break;
+        case MOTOR_STATE_REVERSAL_BRAKE:
+            pPwm->dir = PWM_BRAKE;
+            duty      = MOTOR_DUTY_FULL;
+            break;
+        default:
+            // Coasting: both sides released, whichever direction is set
+            if (pPwm->dir == PWM_BRAKE)
+            {
+                pPwm->dir = PWM_FORWARD;
+            }
+            duty = 0;
+            break;
+    }
+
+    _motorThermalUpdate(pMotor, (uint16_t)(duty >> MOTOR_DUTY_FRAC_BITS));
+
+    // The PWM was checked when the Motor was constructed
+    pwmSetDutyCycle16Unchecked(pPwm,
+                               (uint16_t)((duty * MOTOR_DUTY_16_SCALE) >> 16));
+}
+
+/*!
+ * Advances the Motor's H-bridge state machine and applies its outputs, as
+ * motorStep, without checking the pointer
+ *
+ * @param[in/out] pMotor    pointer to the Motor object
+ */
+static void
+_motorStep
+(
+    Motor *pMotor
+)
+{
+    uint8_t cmd;
+    bool    bDrive;
+
+    // The speed loop runs at the rate its speed estimates are refreshed
+    if (pMotor->pidTicks > 1)
+    {
+        --pMotor->pidTicks;
+    }
+    else
+    {
+        pMotor->pidTicks = MOTOR_PID_TICKS;
+        _motorSpeedControl(pMotor);
+    }
+
+    if (pMotor == motorCalMotor)
+    {
+        _motorCalStep(pMotor);
+    }
+
+    cmd    = pMotor->cmdState;
+    bDrive = (cmd == MOTOR_STATE_FORWARD || cmd == MOTOR_STATE_REVERSE);
+
+    switch (pMotor->state)
+    {
+        case MOTOR_STATE_REVERSAL_BRAKE:
+        case MOTOR_STATE_REVERSAL_DEADTIME:
+            //
+            // Coasting and braking never need to wait out a reversal, nor
+            // does driving on in the direction the rotor is still turning.
+            // Either way driveState is kept, so driving the other way
+            // later starts the reversal over.
+            //
+            if (!bDrive || cmd == pMotor->driveState)
+            {
+                pMotor->state = cmd;
+            }
+            else if (pMotor->stateTicks > 1)
+            {
+                --pMotor->stateTicks;
+            }
+            else if (pMotor->state == MOTOR_STATE_REVERSAL_BRAKE)
+            {
+                pMotor->state      = MOTOR_STATE_REVERSAL_DEADTIME;
+                pMotor->stateTicks = MOTOR_MS_TO_TICKS(MOTOR_DEADTIME_MS);
+            }
+            else
+            {
+                pMotor->state = cmd;
+            }
+            break;
+
+        default:
+            //
+            // Never drive against the direction last driven, even after
+            // coasting or braking, which need not have stopped the rotor
+            //
+            if (bDrive && pMotor->driveState != MOTOR_STATE_COAST &&
+                cmd != pMotor->driveState)
+            {
+                pMotor->state      = MOTOR_STATE_REVERSAL_BRAKE;
+                pMotor->stateTicks = MOTOR_MS_TO_TICKS(MOTOR_REVERSE_BRAKE_MS);
+            }
+            else
+            {
+                pMotor->state = cmd;
+            }
+            break;
+    }
+
+    if (pMotor->state == MOTOR_STATE_FORWARD ||
+        pMotor->state == MOTOR_STATE_REVERSE)
+    {
+        pMotor->driveState = pMotor->state;
+    }
+
+    _motorOutputApply(pMotor);
+}
+
 /* ------------------------- FUNCTION DEFINITIONS  -------------------------- */
 
 /*!
@@ -28,11 +769,58 @@ motorConstruct(Motor *pMotor, PWM *pPwm)
     pMotor->speed      = DEFAULT_SPEED;
     pMotor->bDirection = DEFAULT_DIR;
 
+    // The H-bridge starts released
+    pMotor->state       = MOTOR_STATE_COAST;
+    pMotor->stateTicks  = 0;
+    pMotor->driveState  = MOTOR_STATE_COAST;
+    pMotor->cmdState    = MOTOR_STATE_COAST;
+    pMotor->cmdDuty     = 0;
+    pMotor->cmdDutyFrac = 0;
+
+    // The speed loop starts open loop, with the default gains
+    pMotor->bSpeedCmd     = false;
+    pMotor->cmdSpeed      = 0;
+    pMotor->feedback      = MOTOR_FEEDBACK_NONE;
+    pMotor->feedbackIdx   = 0;
+    pMotor->feedbackScale = 0;
+    pMotor->pid.kp        = MOTOR_PID_KP_DEFAULT;
+    pMotor->pid.ki        = MOTOR_PID_KI_DEFAULT;
+    pMotor->pid.kd        = MOTOR_PID_KD_DEFAULT;
+    pMotor->pid.ffGain    = MOTOR_PID_FF_GAIN_DEFAULT;
+    pMotor->pid.ffOffset  = MOTOR_PID_FF_OFFSET_DEFAULT;
+    pMotor->pidInteg      = 0;
+    pMotor->pidSpeedLast  = 0;
+    pMotor->pidTicks      = 1;
+    pMotor->demandMax     = PWM_PERMILLE_FULL;
+
+    // Uncalibrated until a calibration is set, loaded or measured
+    _motorCalDefault(&pMotor->cal);
+
+    // Starts cold
+    pMotor->thermalHeat = 0;
+    pMotor->dutyLimit   = PWM_PERMILLE_FULL;
+
+#if METHOD_POINTERS
     // Initialize motor's methods
     pMotor->driveForward = motorDriveForward;
     pMotor->driveReverse = motorDriveReverse;
     pMotor->stop         = motorStop;
     pMotor->changeSpeed  = motorChangeSpeed;
+    pMotor->drive        = motorDrive;
+    pMotor->brake        = motorBrake;
+    pMotor->coast        = motorCoast;
+    pMotor->step         = motorStep;
+    pMotor->driveSpeed   = motorDriveSpeed;
+    pMotor->feedbackSet  = motorFeedbackSet;
+    pMotor->pidSet       = motorPidSet;
+    pMotor->speedGet     = motorSpeedGet;
+    pMotor->calSet       = motorCalSet;
+    pMotor->calLoad      = motorCalLoad;
+    pMotor->calSave      = motorCalSave;
+    pMotor->calibrate    = motorCalibrate;
+    pMotor->dutyLimitGet = motorDutyLimitGet;
+    pMotor->demandMaxSet = motorDemandMaxSet;
+#endif
 
     return STATUS_OK;
 }
@@ -55,16 +843,7 @@ motorDriveForward(Motor *pMotor, uint8_t speed)
         speed = 100;
     }
 
-    // Set the motor's speed and direction
-    pMotor->speed = speed;
-
-    if (pMotor->bDirection == REVERSE_DIR)
-    {
-        pMotor->pPwm->dir  = PWM_FORWARD;
-        pMotor->bDirection = FORWARD_DIR;
-    }
-
-    pMotor->pPwm->pwmSetDutyCycle(pMotor->pPwm, speed);
+    _motorRequest(pMotor, MOTOR_STATE_FORWARD, (uint16_t)speed * 10);
 
     return STATUS_OK;
 }
@@ -87,16 +866,7 @@ motorDriveReverse(Motor *pMotor, uint8_t speed)
         speed = 100;
     }
 
-    // Set the motor's speed and direction
-    pMotor->speed = speed;
-
-    if (pMotor->bDirection == FORWARD_DIR)
-    {
-        pMotor->pPwm->dir  = PWM_REVERSE;
-        pMotor->bDirection = REVERSE_DIR;
-    }
-
-    pMotor->pPwm->pwmSetDutyCycle(pMotor->pPwm, speed);
+    _motorRequest(pMotor, MOTOR_STATE_REVERSE, (uint16_t)speed * 10);
 
     return STATUS_OK;
 }
@@ -113,9 +883,9 @@ motorStop(Motor *pMotor)
         return STATUS_ERR_INVALID_PTR;
     }
 
-    // Set the motor's speed and direction
+    // Brake rather than coast, so that the motor stops quickly
+    _motorRequest(pMotor, MOTOR_STATE_BRAKE, PWM_PERMILLE_FULL);
     pMotor->speed = DEFAULT_SPEED;
-    pMotor->pPwm->pwmSetDutyCycle(pMotor->pPwm, 0);
 
     return STATUS_OK;
 }
@@ -139,8 +909,442 @@ motorChangeSpeed(Motor *pMotor, uint8_t speed)
     }
 
     // Set the motor's speed
-    pMotor->speed = speed;
-    pMotor->pPwm->pwmSetDutyCycle(pMotor->pPwm, speed);
+    _motorRequest(pMotor,
+                  (pMotor->bDirection == REVERSE_DIR) ? MOTOR_STATE_REVERSE :
+                                                        MOTOR_STATE_FORWARD,
+                  (uint16_t)speed * 10);
+
+    return STATUS_OK;
+}
+
+/*!
+ * @ref motor.h for function documentation
+ */
+STATUS
+motorDrive(Motor *pMotor, int16_t speed)
+{
+    // Ensure the input pointer is not NULL
+    if (pMotor == NULL)
+    {
+        return STATUS_ERR_INVALID_PTR;
+    }
+
+    if (speed < 0)
+    {
+        _motorRequest(pMotor, MOTOR_STATE_REVERSE, (uint16_t)(-speed));
+    }
+    else
+    {
+        _motorRequest(pMotor, MOTOR_STATE_FORWARD, (uint16_t)speed);
+    }
+
+    return STATUS_OK;
+}
+
+/*!
+ * @ref motor.h for function documentation
+ */
+STATUS
+motorBrake(Motor *pMotor, uint16_t strength)
+{
+    // Ensure the input pointer is not NULL
+    if (pMotor == NULL)
+    {
+        return STATUS_ERR_INVALID_PTR;
+    }
+
+    _motorRequest(pMotor, MOTOR_STATE_BRAKE, strength);
+
+    return STATUS_OK;
+}
+
+/*!
+ * @ref motor.h for function documentation
+ */
+STATUS
+motorCoast(Motor *pMotor)
+{
+    // Ensure the input pointer is not NULL
+    if (pMotor == NULL)
+    {
+        return STATUS_ERR_INVALID_PTR;
+    }
+
+    _motorRequest(pMotor, MOTOR_STATE_COAST, 0);
+
+    return STATUS_OK;
+}
+
+/*!
+ * @ref motor.h for function documentation
+ */
+void
+motorStep(Motor *pMotor)
+{
+    // Ensure the input pointer is not NULL
+    if (pMotor == NULL)
+    {
+        return;
+    }
+
+    _motorStep(pMotor);
+}
+
+/*!
+ * @ref motor.h for function documentation
+ */
+STATUS
+motorDriveSpeed(Motor *pMotor, int16_t mmps)
+{
+    // Ensure the input pointer is not NULL
+    if (pMotor == NULL)
+    {
+        return STATUS_ERR_INVALID_PTR;
+    }
+
+    _motorSpeedRequest(pMotor, mmps);
+
+    return STATUS_OK;
+}
+
+/*!
+ * @ref motor.h for function documentation
+ */
+void
+motorDriveSpeeds
+(
+    Motor   *const pMotors[],
+    const int16_t  mmps[],
+    uint8_t        numMotors
+)
+{
+    uint8_t i;
+
+    for (i = 0; i < numMotors; ++i)
+    {
+        _motorSpeedRequest(pMotors[i], mmps[i]);
+        _motorStep(pMotors[i]);
+    }
+}
+
+/*!
+ * @ref motor.h for function documentation
+ */
+STATUS
+motorFeedbackSet(Motor *pMotor, uint8_t source, uint8_t idx, uint16_t scale)
+{
+    // Ensure the input pointer is not NULL
+    if (pMotor == NULL)
+    {
+        return STATUS_ERR_INVALID_PTR;
+    }
+
+    if ((source == MOTOR_FEEDBACK_ENCODER && idx >= ENCODER_NUM) ||
+        (source == MOTOR_FEEDBACK_BEMF && idx >= BEMF_NUM) ||
+        source > MOTOR_FEEDBACK_BEMF)
+    {
+        return STATUS_ERR_GENERAL;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        pMotor->feedback      = source;
+        pMotor->feedbackIdx   = idx;
+        pMotor->feedbackScale = scale;
+        pMotor->pidInteg      = 0;
+    }
+
+    return STATUS_OK;
+}
+
+/*!
+ * @ref motor.h for function documentation
+ */
+STATUS
+motorPidSet(Motor *pMotor, const MOTOR_PID *pPid)
+{
+    // Ensure the input pointers are not NULL
+    if (pMotor == NULL || pPid == NULL)
+    {
+        return STATUS_ERR_INVALID_PTR;
+    }
+
+    // The loop runs from the control tick, so never sees half the gains
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        pMotor->pid = *pPid;
+    }
+
+    return STATUS_OK;
+}
+
+/*!
+ * @ref motor.h for function documentation
+ */
+int16_t
+motorSpeedGet(Motor *pMotor)
+{
+    int16_t speed;
+
+    if (pMotor == NULL || pMotor->feedback == MOTOR_FEEDBACK_NONE)
+    {
+        return 0;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        speed = pMotor->pidSpeedLast;
+    }
+
+    return speed;
+}
+
+/*!
+ * @ref motor.h for function documentation
+ */
+bool
+motorSpeedFresh(Motor *pMotor, int16_t *pSpeed)
+{
+    if (pMotor == NULL || pSpeed == NULL)
+    {
+        return false;
+    }
+
+    switch (pMotor->feedback)
+    {
+        case MOTOR_FEEDBACK_ENCODER:
+            if (pMotor->feedbackIdx != encoderFreshGet())
+            {
+                return false;
+            }
+            break;
+        case MOTOR_FEEDBACK_BEMF:
+            if (pMotor->feedbackIdx != bemfFreshGet())
+            {
+                return false;
+            }
+            break;
+        default:
+            return false;
+    }
+
+    *pSpeed = _motorSpeedMeasure(pMotor);
+    return true;
+}
+
+/*!
+ * @ref motor.h for function documentation
+ */
+STATUS
+motorCalSet(Motor *pMotor, const MOTOR_CAL *pCal)
+{
+    uint16_t prev;
+    uint8_t  k;
+
+    // Ensure the input pointers are not NULL
+    if (pMotor == NULL || pCal == NULL)
+    {
+        return STATUS_ERR_INVALID_PTR;
+    }
+
+    prev = pCal->minDuty;
+    for (k = 0; k < MOTOR_CAL_POINTS; ++k)
+    {
+        if (pCal->curve[k] < prev || pCal->curve[k] > PWM_PERMILLE_FULL)
+        {
+            return STATUS_ERR_GENERAL;
+        }
+        prev = pCal->curve[k];
+    }
+
+    if (pCal->trim == 0)
+    {
+        return STATUS_ERR_GENERAL;
+    }
+
+    // The calibration is applied from the control tick
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        pMotor->cal = *pCal;
+    }
+
+    return STATUS_OK;
+}
+
+/*!
+ * @ref motor.h for function documentation
+ */
+STATUS
+motorCalLoad(Motor *pMotor, uint8_t slot)
+{
+    MOTOR_CAL_RECORD record;
+
+    // Ensure the input pointer is not NULL
+    if (pMotor == NULL)
+    {
+        return STATUS_ERR_INVALID_PTR;
+    }
+
+    if (slot >= MOTOR_CAL_SLOTS)
+    {
+        return STATUS_ERR_GENERAL;
+    }
+
+    eeprom_read_block(&record, &motorCalRecords[slot], sizeof(record));
+
+    // Erased EEPROM reads 0xFF, which is never the magic
+    if (record.magic != MOTOR_CAL_MAGIC ||
+        record.checksum != _motorCalChecksum(&record.cal))
+    {
+        return STATUS_ERR_GENERAL;
+    }
+
+    return motorCalSet(pMotor, &record.cal);
+}
+
+/*!
+ * @ref motor.h for function documentation
+ */
+STATUS
+motorCalSave(Motor *pMotor, uint8_t slot)
+{
+    MOTOR_CAL_RECORD record;
+
+    // Ensure the input pointer is not NULL
+    if (pMotor == NULL)
+    {
+        return STATUS_ERR_INVALID_PTR;
+    }
+
+    if (slot >= MOTOR_CAL_SLOTS)
+    {
+        return STATUS_ERR_GENERAL;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        record.cal = pMotor->cal;
+    }
+    record.magic    = MOTOR_CAL_MAGIC;
+    record.checksum = _motorCalChecksum(&record.cal);
+
+    eeprom_update_block(&record, &motorCalRecords[slot], sizeof(record));
+
+    return STATUS_OK;
+}
+
+/*!
+ * @ref motor.h for function documentation
+ */
+STATUS
+motorCalibrate(Motor *pMotor)
+{
+    STATUS status = STATUS_OK;
+
+    // Ensure the input pointer is not NULL
+    if (pMotor == NULL)
+    {
+        return STATUS_ERR_INVALID_PTR;
+    }
+
+    // The routine runs from the control tick, so cannot be waited on here
+    if (pMotor->feedback == MOTOR_FEEDBACK_NONE || !(SREG & (1 << SREG_I)))
+    {
+        return STATUS_ERR_GENERAL;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (motorCalMotor != NULL)
+        {
+            status = STATUS_ERR_GENERAL;
+        }
+        else
+        {
+            motorCalPoint  = 0;
+            motorCalDuty   = MOTOR_CAL_RAMP_STEP;
+            motorCalTicks  = MOTOR_MS_TO_TICKS(MOTOR_CAL_SETTLE_MS);
+            motorCalStatus = STATUS_ERR_GENERAL;
+            motorCalMotor  = pMotor;
+        }
+    }
+
+    if (status != STATUS_OK)
+    {
+        return status;
+    }
+
+    while (motorCalMotor == pMotor);
+
+    return motorCalStatus;
+}
+
+/*!
+ * @ref motor.h for function documentation
+ */
+void
+motorSupplySet(uint16_t millivolts)
+{
+    uint32_t comp = (1 << MOTOR_SUPPLY_COMP_FRAC_BITS);
+
+    if (millivolts != 0)
+    {
+        comp = ((uint32_t)MOTOR_SUPPLY_NOMINAL_MV <<
+                MOTOR_SUPPLY_COMP_FRAC_BITS) / millivolts;
+        comp = MIN(comp, MOTOR_SUPPLY_COMP_MAX);
+    }
+
+    // Applied from the control tick
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        motorSupplyComp = (uint16_t)comp;
+    }
+}
+
+/*!
+ * @ref motor.h for function documentation
+ */
+uint16_t
+motorDutyLimitGet(Motor *pMotor)
+{
+    uint16_t limit;
+
+    if (pMotor == NULL)
+    {
+        return 0;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        limit = pMotor->dutyLimit;
+    }
+
+    return limit;
+}
+
+/*!
+ * @ref motor.h for function documentation
+ */
+STATUS
+motorDemandMaxSet(Motor *pMotor, uint16_t demandMax)
+{
+    if (pMotor == NULL)
+    {
+        return STATUS_ERR_INVALID_PTR;
+    }
+
+    demandMax = MIN(demandMax, PWM_PERMILLE_FULL);
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        pMotor->demandMax = demandMax;
+
+        // Cut a running demand now, rather than on the loop's next run
+        if (pMotor->bSpeedCmd && pMotor->cmdDuty > demandMax)
+        {
+            _motorDutySet(pMotor, pMotor->cmdState, demandMax);
+        }
+    }
 
     return STATUS_OK;
 }
@@ -2,12 +2,547 @@
 
 /* ------------------------- SYSTEM INCLUDES -------------------------------- */
 #include <avr/io.h>
+#include <avr/interrupt.h>
 #include <stdlib.h>
+#include <util/atomic.h>
 
 /* ------------------------- APPLICATION INCLUDES --------------------------- */
 #include "pwm/pfcpwm.h"
 #include "common/utils.h"
 
+/* ------------------------- STATIC VARIABLES ------------------------------- */
+
+/*!
+ * 16-bit timer prescaler taps and their clock source encodings
+ */
+static const uint16_t pwmPrescales[] = {1, 8, 64, 256, 1024};
+static const uint8_t  pwmClkSrcs[]   = {CLK_SEL_NO_PRESCALE,
+                                        CLK_SEL_PRESCALE_8,
+                                        CLK_SEL_PRESCALE_64,
+                                        CLK_SEL_PRESCALE_256,
+                                        CLK_SEL_PRESCALE_1024};
+
+#define PWM_NUM_PRESCALES (sizeof(pwmPrescales)/sizeof(pwmPrescales[0]))
+
+/*!
+ * PWMs dithered from the overflow interrupt
+ */
+static PWM     *pwmDitherPwms[PWM_DITHER_MAX];
+static uint8_t  pwmDitherNum = 0;
+
+/*!
+ * PWMs chopped until their timers' next BOTTOM
+ */
+static PWM     *pwmChopPwms[PWM_CHOP_MAX];
+static uint8_t  pwmChopNum = 0;
+
+/*!
+ * The open coast window: its PWM (NULL when none is open), the carrier
+ * periods left to coast, its handler, and the compare values to restore
+ */
+static PWM             *pwmCoastPwm = NULL;
+static uint8_t          pwmCoastPeriods;
+static PWMCoastHandler *pwmCoastHandler;
+static void            *pwmCoastArg;
+static uint16_t         pwmCoastOcrB;
+static uint16_t         pwmCoastOcrC;
+
+/*!
+ * PWMs whose staged compare values are left to the compare A (TOP)
+ * interrupt of the first one's timer
+ */
+static PWM     *pwmCommitPwms[PWM_COMMIT_MAX];
+static uint8_t  pwmCommitNum = 0;
+
+/* ------------------------- STATIC FUNCTIONS ------------------------------- */
+
+/*!
+ * Caches the PWM's TOP value and precomputes the permille duty cycle scale
+ *
+ * @param[in/out] pPwm  pointer to PWM object
+ * @param[in]     top   TOP value written to OCRnA
+ */
+static void
+_pwmTopCache
+(
+    PWM      *pPwm,
+    uint16_t  top
+)
+{
+    pPwm->top = top;
+
+    //
+    // Round the scale up so that PWM_PERMILLE_FULL maps exactly onto TOP;
+    // every other duty cycle then lands within one count below exact
+    //
+    pPwm->permilleScale = (((uint32_t)top << 16) + PWM_PERMILLE_FULL - 1) /
+                          PWM_PERMILLE_FULL;
+}
+
+/*!
+ * Chooses the clock source and TOP giving the finest resolution at a carrier
+ * frequency. In phase and frequency correct mode the timer counts up to TOP
+ * and back down every period, so f = F_CPU / (2 * prescale * TOP).
+ *
+ * @param[in/out] pPwm      pointer to PWM object
+ * @param[in]     carrierHz desired carrier frequency (Hz)
+ *
+ * @return STATUS_OK if the carrier frequency can be generated
+ * @return STATUS_ERR_GENERAL if carrierHz is out of range
+ */
+static STATUS
+_pwmCarrierSet
+(
+    PWM      *pPwm,
+    uint16_t  carrierHz
+)
+{
+    uint32_t top = 0;
+    uint8_t  bits;
+    uint8_t  i;
+
+    if (carrierHz == 0)
+    {
+        return STATUS_ERR_GENERAL;
+    }
+
+    // Pick the smallest prescaler whose TOP fits in 16 bits
+    for (i = 0; i < PWM_NUM_PRESCALES; ++i)
+    {
+        top = F_CPU / (2UL * pwmPrescales[i] * carrierHz);
+        if (top <= COUNTER_MAX)
+        {
+            break;
+        }
+    }
+
+    if (i == PWM_NUM_PRESCALES || top < PWM_TOP_MIN)
+    {
+        return STATUS_ERR_GENERAL;
+    }
+
+    pPwm->clkSrc    = pwmClkSrcs[i];
+    pPwm->carrierHz = (uint16_t)(F_CPU / (2UL * pwmPrescales[i] * top));
+
+    // floor(log2(TOP + 1))
+    for (bits = 0; (top + 1) >> (bits + 1) != 0; ++bits);
+    pPwm->resolutionBits = bits;
+
+    _pwmTopCache(pPwm, (uint16_t)top);
+
+    return STATUS_OK;
+}
+
+/*!
+ * Loads the dither state for the compare values just written to a PWM. Must
+ * be called with interrupts disabled.
+ *
+ * @param[in/out] pPwm  pointer to PWM object
+ * @param[in]     ocrB  compare value written to OCRnB
+ * @param[in]     ocrC  compare value written to OCRnC
+ * @param[in]     frac  fractional part of the active compare value (Q16)
+ */
+static inline void
+_pwmDitherLoad
+(
+    PWM      *pPwm,
+    uint16_t  ocrB,
+    uint16_t  ocrC,
+    uint16_t  frac
+)
+{
+    REG16    *ditherOcr;
+    uint16_t  base;
+
+    if (!pPwm->bDither)
+    {
+        return;
+    }
+
+    // Dithering one side of a brake would drive the motor
+    if (pPwm->dir == PWM_BRAKE)
+    {
+        frac = 0;
+    }
+
+    if (pPwm->dir == PWM_FORWARD)
+    {
+        ditherOcr = pPwm->ocrB;
+        base      = ocrB;
+    }
+    else
+    {
+        ditherOcr = pPwm->ocrC;
+        base      = ocrC;
+    }
+
+    //
+    // The fraction accumulated on one channel or direction means nothing
+    // on another; start afresh
+    //
+    if (ditherOcr != pPwm->ditherOcr || pPwm->dir != pPwm->ditherDir)
+    {
+        pPwm->ditherOcr = ditherOcr;
+        pPwm->ditherDir = pPwm->dir;
+        pPwm->ditherAcc = 0x0000;
+    }
+
+    // The caller has just written the base value to both channels
+    pPwm->ditherBase = base;
+    pPwm->ditherLast = base;
+
+    // A carry lengthens the pulse: one count lower when inverted
+    if (pPwm->phase & PWM_PHASE_INVERTED)
+    {
+        pPwm->ditherStep = -1;
+        if (pPwm->ditherBase == 0)
+        {
+            frac = 0;
+        }
+    }
+    else
+    {
+        pPwm->ditherStep = 1;
+        if (pPwm->ditherBase >= pPwm->top)
+        {
+            frac = 0;
+        }
+    }
+
+    pPwm->ditherFrac = frac;
+}
+
+/*!
+ * Runs one step of the sigma-delta modulator of every dithered PWM. The
+ * compare values written here latch at the timers' next BOTTOM.
+ */
+static inline void
+_pwmDitherStep(void)
+{
+    PWM      *pPwm;
+    uint16_t  acc;
+    uint16_t  ocr;
+    uint8_t   i;
+
+    for (i = 0; i < pwmDitherNum; ++i)
+    {
+        pPwm = pwmDitherPwms[i];
+
+        // A coast window holds the outputs released
+        if (pPwm->bCoast)
+        {
+            continue;
+        }
+
+        acc = pPwm->ditherAcc + pPwm->ditherFrac;
+        ocr = pPwm->ditherBase;
+        if (acc < pPwm->ditherAcc)
+        {
+            ocr += pPwm->ditherStep;
+        }
+
+        pPwm->ditherAcc = acc;
+
+        // Most periods repeat the last value; skip the 16-bit write
+        if (ocr != pPwm->ditherLast)
+        {
+            *pPwm->ditherOcr = ocr;
+            pPwm->ditherLast = ocr;
+        }
+    }
+}
+
+/*!
+ * Runs one TOP of the open coast window. Compare values written here latch
+ * at the timer's next BOTTOM; in the PWM modes, reading a compare register
+ * reads the value waiting to latch.
+ */
+static inline void
+_pwmCoastStep(void)
+{
+    PWM      *pPwm = pwmCoastPwm;
+    uint16_t  off  = 0x0000;
+
+    if (pPwm == NULL)
+    {
+        return;
+    }
+
+    // First TOP: release both outputs from the next BOTTOM
+    if (!pPwm->bCoast)
+    {
+        if (pPwm->phase & PWM_PHASE_INVERTED)
+        {
+            off = pPwm->top;
+        }
+
+        pwmCoastOcrB = *pPwm->ocrB;
+        pwmCoastOcrC = *pPwm->ocrC;
+        *pPwm->ocrB  = off;
+        *pPwm->ocrC  = off;
+        pPwm->bCoast = true;
+        return;
+    }
+
+    if (--pwmCoastPeriods != 0)
+    {
+        return;
+    }
+
+    // TOP of the last coasted period
+    pwmCoastHandler(pwmCoastArg);
+
+    // Drive again from the next BOTTOM
+    *pPwm->ocrB  = pwmCoastOcrB;
+    *pPwm->ocrC  = pwmCoastOcrC;
+    pPwm->bCoast = false;
+    pwmCoastPwm  = NULL;
+}
+
+/*!
+ * Checks whether every timer of a group of PWMs is far enough from BOTTOM
+ * for compare values written now to latch there together. Must be called
+ * with interrupts disabled.
+ *
+ * @param[in] pPwms     array of pointers to PWM objects
+ * @param[in] numPwms   number of PWM objects in pPwms
+ *
+ * @return true if the staged compare values may be written
+ */
+static inline bool
+_pwmCommitReady
+(
+    PWM     *const pPwms[],
+    uint8_t        numPwms
+)
+{
+    uint8_t i;
+
+    //
+    // The direction of counting cannot be read back, so a small count may
+    // mean BOTTOM is only a few counts away; a count of at least
+    // PWM_COMMIT_GUARD leaves that many counts before the next latch. Timers
+    // out of phase reach BOTTOM at different times, so every one is checked.
+    //
+    for (i = 0; i < numPwms; ++i)
+    {
+        if (pPwms[i]->top > 2 * PWM_COMMIT_GUARD &&
+            *pPwms[i]->tcnt < PWM_COMMIT_GUARD)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*!
+ * Writes the staged compare values of a group of PWMs. Must be called with
+ * interrupts disabled.
+ *
+ * @param[in/out] pPwms     array of pointers to staged PWM objects
+ * @param[in]     numPwms   number of PWM objects in pPwms
+ */
+static void
+_pwmCommitWrite
+(
+    PWM     *const pPwms[],
+    uint8_t        numPwms
+)
+{
+    uint8_t i;
+
+    for (i = 0; i < numPwms; ++i)
+    {
+        // A coast window restores its PWM's values when it closes
+        if (pPwms[i]->bCoast)
+        {
+            pwmCoastOcrB = pPwms[i]->ocrBStaged;
+            pwmCoastOcrC = pPwms[i]->ocrCStaged;
+            continue;
+        }
+
+        *pPwms[i]->ocrB = pPwms[i]->ocrBStaged;
+        *pPwms[i]->ocrC = pPwms[i]->ocrCStaged;
+    }
+
+    // Only needed by the next overflow, so outside the guard
+    for (i = 0; i < numPwms; ++i)
+    {
+        _pwmDitherLoad(pPwms[i], pPwms[i]->ocrBStaged, pPwms[i]->ocrCStaged,
+                       pPwms[i]->ditherFracStaged);
+    }
+}
+
+/*!
+ * Runs the compare A (TOP) interrupt of a motor PWM timer: makes a deferred
+ * commit if it waits on this timer, and steps the coast window if it is open
+ * on this timer
+ *
+ * @param[in] tccrA     Timer control register A of the timer at TOP
+ * @param[in] timsk     Interrupt mask register of the timer at TOP
+ */
+static inline void
+_pwmTop
+(
+    REG8 *tccrA,
+    REG8 *timsk
+)
+{
+    if (pwmCommitNum != 0 && pwmCommitPwms[0]->tccrA == tccrA)
+    {
+        // Normally far from BOTTOM here, unless this interrupt ran late
+        if (_pwmCommitReady(pwmCommitPwms, pwmCommitNum))
+        {
+            _pwmCommitWrite(pwmCommitPwms, pwmCommitNum);
+            pwmCommitNum = 0;
+        }
+    }
+
+    if (pwmCoastPwm != NULL && pwmCoastPwm->tccrA == tccrA)
+    {
+        _pwmCoastStep();
+    }
+
+    //
+    // Leave the interrupt enabled only while either still needs it; a
+    // deferred commit superseded in the meantime no longer does
+    //
+    if (!(pwmCommitNum != 0 && pwmCommitPwms[0]->tccrA == tccrA) &&
+        !(pwmCoastPwm != NULL && pwmCoastPwm->tccrA == tccrA))
+    {
+        CLEAR_BIT(*timsk, TIMER16_INT_COMPA);
+    }
+}
+
+/*!
+ * Runs the overflow (BOTTOM) interrupt of a motor PWM timer: steps the
+ * dither engine if it runs from this timer, and reconnects the outputs of
+ * any PWM chopped on it
+ *
+ * @param[in] tccrA     Timer control register A of the overflowing timer
+ */
+static inline void
+_pwmOverflow
+(
+    REG8 *tccrA
+)
+{
+    PWM     *pPwm;
+    bool     bDitherTimer = false;
+    uint8_t  i = 0;
+
+#if PWM_DITHER
+    if (pwmDitherNum != 0 && pwmDitherPwms[0]->tccrA == tccrA)
+    {
+        bDitherTimer = true;
+        _pwmDitherStep();
+    }
+#endif
+
+    while (i < pwmChopNum)
+    {
+        pPwm = pwmChopPwms[i];
+        if (pPwm->tccrA != tccrA)
+        {
+            ++i;
+            continue;
+        }
+
+        // A PWM halted while chopped stays off until resumed
+        if (!pPwm->bHalt)
+        {
+            *pPwm->tccrA |= pPwm->chopCom;
+        }
+        pPwm->bChop = false;
+
+        // The dither engine still needs this timer's overflows
+        if (!bDitherTimer)
+        {
+            CLEAR_BIT(*pPwm->timsk, TIMER16_INT_OVF);
+        }
+
+        pwmChopPwms[i] = pwmChopPwms[--pwmChopNum];
+    }
+}
+
+/*!
+ * Writes an output compare value to the channel of the PWM's direction and
+ * clears the other channel (or, when braking, writes it to both), or records
+ * both for pwmCommit if staged
+ *
+ * @param[in/out] pPwm  pointer to PWM object
+ * @param[in]     ocr   output compare value (0 to TOP)
+ * @param[in]     frac  fractional part of the compare value (Q16), used
+ *                      only when dithering
+ *
+ * @return STATUS_OK if the output compare value was written
+ * @return STATUS_ERR_GENERAL if the PWM's direction is invalid
+ */
+static inline STATUS
+_pwmOcrWrite
+(
+    PWM      *pPwm,
+    uint16_t  ocr,
+    uint16_t  frac
+)
+{
+    uint16_t ocrB;
+    uint16_t ocrC;
+    uint16_t off = 0x0000;
+
+    // Inverted outputs are high above the compare value, not below it
+    if (pPwm->phase & PWM_PHASE_INVERTED)
+    {
+        ocr = pPwm->top - ocr;
+        off = pPwm->top;
+    }
+
+    if (pPwm->dir == PWM_FORWARD)
+    {
+        ocrB = ocr;
+        ocrC = off;
+    }
+    else if (pPwm->dir == PWM_REVERSE)
+    {
+        ocrB = off;
+        ocrC = ocr;
+    }
+    else if (pPwm->dir == PWM_BRAKE)
+    {
+        // Both sides driven together
+        ocrB = ocr;
+        ocrC = ocr;
+    }
+    else
+    {
+        return STATUS_ERR_GENERAL;
+    }
+
+    if (pPwm->bStaged)
+    {
+        // A deferred commit may read these from its interrupt
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            pPwm->ocrBStaged       = ocrB;
+            pPwm->ocrCStaged       = ocrC;
+            pPwm->ditherFracStaged = frac;
+        }
+    }
+    else
+    {
+        // 16-bit register writes share the TEMP register with any ISR
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            *pPwm->ocrB = ocrB;
+            *pPwm->ocrC = ocrC;
+            _pwmDitherLoad(pPwm, ocrB, ocrC, frac);
+        }
+    }
+
+    return STATUS_OK;
+}
+
 /* ------------------------- FUNCTION DEFINITIONS --------------------------- */
 
 /*!
@@ -24,7 +559,7 @@ pwmConstruct
     uint8_t  prrBit,
     REG8    *tccrA,
     REG8    *tccrB,
-    uint8_t  clkSrc,
+    uint16_t carrierHz,
     REG16   *ocrA,
     REG16   *ocrB,
     REG16   *ocrC
@@ -46,15 +581,54 @@ pwmConstruct
 
     pPwm->tccrA  = tccrA;
     pPwm->tccrB  = tccrB;
-    pPwm->clkSrc = clkSrc;
 
     pPwm->ocrA   = ocrA;
     pPwm->ocrB   = ocrB;
     pPwm->ocrC   = ocrC;
 
+    pPwm->tcnt   = timer16CounterGet(tccrA);
+    pPwm->timsk  = timer16InterruptMaskGet(tccrA);
+    pPwm->tifr   = timer16InterruptFlagGet(tccrA);
+
+    pPwm->bStaged    = false;
+    pPwm->ocrBStaged = 0x0000;
+    pPwm->ocrCStaged = 0x0000;
+
+    pPwm->phase      = PWM_PHASE_0;
+
+    pPwm->bDither          = false;
+    pPwm->ditherOcr        = ocrB;
+    pPwm->ditherDir        = PWM_FORWARD;
+    pPwm->ditherBase       = 0x0000;
+    pPwm->ditherLast       = 0x0000;
+    pPwm->ditherStep       = 1;
+    pPwm->ditherFrac       = 0x0000;
+    pPwm->ditherAcc        = 0x0000;
+    pPwm->ditherFracStaged = 0x0000;
+
+    pPwm->bCoast           = false;
+
+    pPwm->bChop            = false;
+    pPwm->chopCom          = 0x00;
+
+    pPwm->bHalt            = false;
+    pPwm->haltCom          = 0x00;
+
+    // Choose the clock source and TOP for the carrier frequency
+    if (_pwmCarrierSet(pPwm, carrierHz) != STATUS_OK)
+    {
+        return STATUS_ERR_GENERAL;
+    }
+
+#if METHOD_POINTERS
     // Populate the pwm object's methods
-    pPwm->pwmInit         = pwmInit;
-    pPwm->pwmSetDutyCycle = pwmSetDutyCycle;
+    pPwm->pwmInit                 = pwmInit;
+    pPwm->pwmSetDutyCycle         = pwmSetDutyCycle;
+    pPwm->pwmSetDutyCycle16       = pwmSetDutyCycle16;
+    pPwm->pwmSetDutyCyclePermille = pwmSetDutyCyclePermille;
+    pPwm->pwmSetStaged            = pwmSetStaged;
+    pPwm->pwmSetPhase             = pwmSetPhase;
+#endif
 
     return STATUS_OK;
 }
@@ -69,21 +643,29 @@ pwmInit
     PWM *pPwm
 )
 {
+    uint8_t  comMode = TIMER_MODE_COM_PFC_PWM_CLEAR_UP;
+    uint16_t off     = 0x0000;
+
     // Sanity check the input pointer
     if (pPwm == NULL)
     {
         return STATUS_ERR_INVALID_PTR;
     }
 
+    if (pPwm->phase & PWM_PHASE_INVERTED)
+    {
+        comMode = TIMER_MODE_COM_PFC_PWM_SET_UP;
+        off     = pPwm->top;
+    }
+
     // Initialize 16-bit timer
     timer16Init(pPwm->prr, pPwm->prrBit, pPwm->tccrA, pPwm->tccrB,
-        TIMER_MODE_WGM_PFC_PWM_TOP_OCRnA,
-        TIMER_MODE_COM_PFC_PWM_CLEAR_UP, pPwm->clkSrc);
+        TIMER_MODE_WGM_PFC_PWM_TOP_OCRnA, comMode, pPwm->clkSrc);
 
     // Initialize output compare registers
-    SET_OUTPUT_COMPARE_REG(*(pPwm->ocrA), 0xFFFF);
-    SET_OUTPUT_COMPARE_REG(*(pPwm->ocrB), 0x0000);
-    SET_OUTPUT_COMPARE_REG(*(pPwm->ocrC), 0x0000);
+    SET_OUTPUT_COMPARE_REG(*(pPwm->ocrA), pPwm->top);
+    SET_OUTPUT_COMPARE_REG(*(pPwm->ocrB), off);
+    SET_OUTPUT_COMPARE_REG(*(pPwm->ocrC), off);
 
     // Set OCnx pin to output to enable PWM waveform generation
     SET_PORT_BIT_OUTPUT(*(pPwm->ddr), pPwm->bit1);
@@ -108,22 +690,458 @@ pwmSetDutyCycle
         return STATUS_ERR_INVALID_PTR;
     }
 
-    // Set PWM duty cycle
-    if (pPwm->dir == PWM_FORWARD)
+    if (pct > 100)
     {
-        *pPwm->ocrB = (*pPwm->ocrA/100)*pct;
-        *pPwm->ocrC = 0x0000;
+        pct = 100;
     }
-    else if (pPwm->dir == PWM_REVERSE)
+
+    return pwmSetDutyCyclePermille(pPwm, (uint16_t)pct * 10);
+}
+
+/*!
+ * @ref pfcpwm.h for function documentation
+ */
+STATUS
+pwmSetDutyCycle16
+(
+    PWM      *pPwm,
+    uint16_t  duty
+)
+{
+    // Sanity check the input pointer
+    if (pPwm == NULL)
     {
-        *pPwm->ocrC = (*pPwm->ocrA/100)*pct;
-        *pPwm->ocrB = 0x0000;
+        return STATUS_ERR_INVALID_PTR;
     }
-    else
+
+    return pwmSetDutyCycle16Unchecked(pPwm, duty);
+}
+
+/*!
+ * @ref pfcpwm.h for function documentation
+ */
+STATUS
+pwmSetDutyCycle16Unchecked
+(
+    PWM      *pPwm,
+    uint16_t  duty
+)
+{
+    uint32_t ocr;
+
+    // duty * (TOP + 1) / 2^16, so PWM_DUTY_FULL maps onto TOP
+    ocr = (uint32_t)duty * ((uint32_t)pPwm->top + 1);
+
+    return _pwmOcrWrite(pPwm, (uint16_t)(ocr >> 16), (uint16_t)ocr);
+}
+
+/*!
+ * @ref pfcpwm.h for function documentation
+ */
+STATUS
+pwmSetDutyCyclePermille
+(
+    PWM      *pPwm,
+    uint16_t  permille
+)
+{
+    uint32_t ocr;
+
+    // Sanity check the input pointer
+    if (pPwm == NULL)
+    {
+        return STATUS_ERR_INVALID_PTR;
+    }
+
+    if (permille > PWM_PERMILLE_FULL)
+    {
+        permille = PWM_PERMILLE_FULL;
+    }
+
+    ocr = (uint32_t)permille * pPwm->permilleScale;
+
+    return _pwmOcrWrite(pPwm, (uint16_t)(ocr >> 16), (uint16_t)ocr);
+}
+
+/*!
+ * @ref pfcpwm.h for function documentation
+ */
+STATUS
+pwmSetStaged
+(
+    PWM  *pPwm,
+    bool  bStaged
+)
+{
+    // Sanity check the input pointer
+    if (pPwm == NULL)
+    {
+        return STATUS_ERR_INVALID_PTR;
+    }
+
+    pPwm->bStaged = bStaged;
+
+    return STATUS_OK;
+}
+
+/*!
+ * @ref pfcpwm.h for function documentation
+ */
+void
+pwmSyncStart
+(
+    PWM     *const pPwms[],
+    uint8_t        numPwms
+)
+{
+    PWM     *pRef = NULL;
+    uint8_t  i;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        TIMER16_SYNC_HALT();
+
+        // Stop every timer and rewind it to BOTTOM, counting up
+        for (i = 0; i < numPwms; ++i)
+        {
+            *pPwms[i]->tccrB &= ~CLK_SEL_MASK;
+            *pPwms[i]->tcnt   = COUNTER_BOTTOM;
+        }
+
+        // Prescaled timers stay held here until the prescaler is released
+        for (i = 0; i < numPwms; ++i)
+        {
+            if (pPwms[i]->phase & PWM_PHASE_QUARTER)
+            {
+                continue;
+            }
+
+            SET_CLK_SOURCE(*pPwms[i]->tccrB, pPwms[i]->clkSrc);
+            if (pRef == NULL)
+            {
+                pRef = pPwms[i];
+            }
+        }
+
+        TIMER16_SYNC_RELEASE();
+
+        //
+        // A running timer's direction cannot be set, so rather than preload
+        // a count, the quarter period timers are started from BOTTOM once
+        // the others have counted half way up to TOP
+        //
+        if (pRef != NULL)
+        {
+            while (*pRef->tcnt < pRef->top / 2);
+        }
+
+        for (i = 0; i < numPwms; ++i)
+        {
+            if (pPwms[i]->phase & PWM_PHASE_QUARTER)
+            {
+                SET_CLK_SOURCE(*pPwms[i]->tccrB, pPwms[i]->clkSrc);
+            }
+        }
+    }
+}
+
+/*!
+ * @ref pfcpwm.h for function documentation
+ */
+void
+pwmCommit
+(
+    PWM     *const pPwms[],
+    uint8_t        numPwms
+)
+{
+    uint8_t i;
+
+    if (numPwms == 0)
+    {
+        return;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        //
+        // Written now if it is safe, or if it cannot be deferred; either way
+        // this supersedes any commit still deferred
+        //
+        if (numPwms > PWM_COMMIT_MAX || pPwms[0]->timsk == NULL ||
+            _pwmCommitReady(pPwms, numPwms))
+        {
+            _pwmCommitWrite(pPwms, numPwms);
+            pwmCommitNum = 0;
+        }
+        else
+        {
+            // Leave it to the first timer's next TOP
+            for (i = 0; i < numPwms; ++i)
+            {
+                pwmCommitPwms[i] = pPwms[i];
+            }
+            pwmCommitNum = numPwms;
+            SET_BIT(*pPwms[0]->timsk, TIMER16_INT_COMPA);
+        }
+    }
+}
+
+/*!
+ * @ref pfcpwm.h for function documentation
+ */
+STATUS
+pwmSetPhase
+(
+    PWM     *pPwm,
+    uint8_t  phase
+)
+{
+    // Sanity check the input pointer
+    if (pPwm == NULL)
+    {
+        return STATUS_ERR_INVALID_PTR;
+    }
+
+    if (phase > PWM_PHASE_270)
+    {
+        return STATUS_ERR_GENERAL;
+    }
+
+    //
+    // Inverting the outputs inverts the dithered compare value and its
+    // step; drop any fraction carried under the old phase until the next
+    // duty cycle reloads the dither state
+    //
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        pPwm->phase      = phase;
+        pPwm->ditherFrac = 0x0000;
+        pPwm->ditherAcc  = 0x0000;
+    }
+
+    return STATUS_OK;
+}
+
+/*!
+ * @ref pfcpwm.h for function documentation
+ */
+STATUS
+pwmDitherStart
+(
+    PWM     *const pPwms[],
+    uint8_t        numPwms
+)
+{
+#if PWM_DITHER
+    REG8    *timsk;
+    uint8_t  i;
+
+    if (numPwms == 0 || numPwms > PWM_DITHER_MAX)
     {
         return STATUS_ERR_GENERAL;
     }
 
+    timsk = timer16InterruptMaskGet(pPwms[0]->tccrA);
+    if (timsk == NULL)
+    {
+        return STATUS_ERR_GENERAL;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        for (i = 0; i < numPwms; ++i)
+        {
+            pwmDitherPwms[i]      = pPwms[i];
+            pPwms[i]->bDither     = true;
+            pPwms[i]->ditherAcc   = 0x0000;
+            _pwmDitherLoad(pPwms[i], *pPwms[i]->ocrB, *pPwms[i]->ocrC, 0);
+        }
+        pwmDitherNum = numPwms;
+
+        SET_BIT(*timsk, TIMER16_INT_OVF);
+    }
+
     return STATUS_OK;
+#else
+    return STATUS_ERR_GENERAL;
+#endif
+}
+
+/*!
+ * @ref pfcpwm.h for function documentation
+ */
+STATUS
+pwmCoastWindow
+(
+    PWM             *pPwm,
+    uint8_t          periods,
+    PWMCoastHandler *pHandler,
+    void            *pArg
+)
+{
+    STATUS status = STATUS_OK;
+
+    // Sanity check the input pointers
+    if (pPwm == NULL || pHandler == NULL)
+    {
+        return STATUS_ERR_INVALID_PTR;
+    }
+
+    if (periods == 0 || periods > PWM_COAST_MAX ||
+        pPwm->timsk == NULL || pPwm->tifr == NULL)
+    {
+        return STATUS_ERR_GENERAL;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (pwmCoastPwm != NULL)
+        {
+            status = STATUS_ERR_GENERAL;
+        }
+        else
+        {
+            pwmCoastPwm     = pPwm;
+            pwmCoastPeriods = periods;
+            pwmCoastHandler = pHandler;
+            pwmCoastArg     = pArg;
+
+            // Count only the TOPs from now on (flags clear on writing 1)
+            *pPwm->tifr = (1 << TIMER16_INT_COMPA);
+            SET_BIT(*pPwm->timsk, TIMER16_INT_COMPA);
+        }
+    }
+
+    return status;
+}
+
+/*!
+ * @ref pfcpwm.h for function documentation
+ */
+bool
+pwmChop
+(
+    PWM *pPwm
+)
+{
+    uint8_t com;
+
+    if (pPwm->bChop || pPwm->bHalt || pwmChopNum == PWM_CHOP_MAX)
+    {
+        return false;
+    }
+
+    // Outputs first; the bookkeeping can wait
+    com           = *pPwm->tccrA & (TIMER16_COM_B_MASK | TIMER16_COM_C_MASK);
+    *pPwm->tccrA &= ~com;
+
+    pPwm->chopCom = com;
+    pPwm->bChop   = true;
+    pwmChopPwms[pwmChopNum++] = pPwm;
+
+    // Reconnect at the next BOTTOM, not at one already passed
+    *pPwm->tifr = (1 << TIMER16_INT_OVF);
+    SET_BIT(*pPwm->timsk, TIMER16_INT_OVF);
+
+    return true;
 }
 
+/*!
+ * @ref pfcpwm.h for function documentation
+ */
+void
+pwmHalt
+(
+    PWM *pPwm
+)
+{
+    uint8_t com;
+
+    if (pPwm->bHalt)
+    {
+        return;
+    }
+
+    // Outputs first; the bookkeeping can wait
+    com           = *pPwm->tccrA & (TIMER16_COM_B_MASK | TIMER16_COM_C_MASK);
+    *pPwm->tccrA &= ~com;
+
+    // Outputs chopped already are restored on resuming, not at BOTTOM
+    if (pPwm->bChop)
+    {
+        com |= pPwm->chopCom;
+    }
+
+    pPwm->haltCom = com;
+    pPwm->bHalt   = true;
+}
+
+/*!
+ * @ref pfcpwm.h for function documentation
+ */
+void
+pwmResume
+(
+    PWM *pPwm
+)
+{
+    if (!pPwm->bHalt)
+    {
+        return;
+    }
+
+    *pPwm->tccrA |= pPwm->haltCom;
+    pPwm->bHalt   = false;
+}
+
+/* ------------------------- ISR DEFS --------------------------------------- */
+
+/*!
+ * Overflow (BOTTOM) interrupts of the motor PWM timers. A timer's overflow
+ * interrupt is enabled while it runs the dither engine or has a PWM chopped.
+ */
+ISR(TIMER1_OVF_vect, ISR_BLOCK)
+{
+    _pwmOverflow(&TCCR1A);
+}
+
+ISR(TIMER3_OVF_vect, ISR_BLOCK)
+{
+    _pwmOverflow(&TCCR3A);
+}
+
+ISR(TIMER4_OVF_vect, ISR_BLOCK)
+{
+    _pwmOverflow(&TCCR4A);
+}
+
+ISR(TIMER5_OVF_vect, ISR_BLOCK)
+{
+    _pwmOverflow(&TCCR5A);
+}
+
+/*!
+ * Compare A (TOP) interrupts of the motor PWM timers. A timer's compare A
+ * interrupt is enabled while a deferred commit waits on it or a coast window
+ * is open on it.
+ */
+ISR(TIMER1_COMPA_vect, ISR_BLOCK)
+{
+    _pwmTop(&TCCR1A, &TIMSK1);
+}
+
+ISR(TIMER3_COMPA_vect, ISR_BLOCK)
+{
+    _pwmTop(&TCCR3A, &TIMSK3);
+}
+
+ISR(TIMER4_COMPA_vect, ISR_BLOCK)
+{
+    _pwmTop(&TCCR4A, &TIMSK4);
+}
+
+ISR(TIMER5_COMPA_vect, ISR_BLOCK)
+{
+    _pwmTop(&TCCR5A, &TIMSK5);
+}
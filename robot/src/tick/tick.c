@@ -0,0 +1,242 @@
+/* Implementation file for the fixed-rate control tick */
+
+/* ------------------------- SYSTEM INCLUDES -------------------------------- */
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <stdlib.h>
+
+/* ------------------------- APPLICATION INCLUDES --------------------------- */
+#include "tick/tick.h"
+#include "timer/timer8/timer8.h"
+#include "common/utils.h"
+
+/* ------------------------- STATIC VARIABLES ------------------------------- */
+
+/*!
+ * Timer/Counter2 prescaler taps and their clock source encodings
+ */
+static const uint16_t tickPrescales[] = {1, 8, 32, 64, 128, 256, 1024};
+static const uint8_t  tickClkSrcs[]   = {TIMER2_CLK_SEL_NO_PRESCALE,
+                                         TIMER2_CLK_SEL_PRESCALE_8,
+                                         TIMER2_CLK_SEL_PRESCALE_32,
+                                         TIMER2_CLK_SEL_PRESCALE_64,
+                                         TIMER2_CLK_SEL_PRESCALE_128,
+                                         TIMER2_CLK_SEL_PRESCALE_256,
+                                         TIMER2_CLK_SEL_PRESCALE_1024};
+
+#define TICK_NUM_PRESCALES (sizeof(tickPrescales)/sizeof(tickPrescales[0]))
+
+/*!
+ * Handler run on every tick and its argument
+ */
+static TickHandler * volatile tickHandler = NULL;
+static void        * volatile tickHandlerArg = NULL;
+
+/*!
+ * Prescaler and timer counts per period of the running tick
+ */
+static uint16_t tickPrescale = 1;
+static uint16_t tickTop      = 0;
+
+/*!
+ * Tick count and timing statistics
+ */
+static volatile uint32_t   tickCount = 0;
+static volatile TICK_STATS tickStats;
+
+/*!
+ * Timer counts elapsed at the start of the current tick (wraps)
+ */
+static volatile uint16_t   tickStampBase = 0;
+
+/* ------------------------- FUNCTION DEFINITIONS --------------------------- */
+
+/*!
+ * @ref tick.h for function documentation
+ */
+STATUS
+tickInit(uint16_t hz)
+{
+    uint32_t top = 0;
+    uint8_t  i;
+
+    if (hz < TICK_MIN_HZ)
+    {
+        return STATUS_ERR_GENERAL;
+    }
+
+    // Pick the smallest prescaler whose compare value fits in 8 bits
+    for (i = 0; i < TICK_NUM_PRESCALES; ++i)
+    {
+        top = F_CPU / ((uint32_t)tickPrescales[i] * hz);
+        if (top <= 256)
+        {
+            break;
+        }
+    }
+
+    if (i == TICK_NUM_PRESCALES || top < 2)
+    {
+        return STATUS_ERR_GENERAL;
+    }
+
+    tickPrescale = tickPrescales[i];
+    tickTop      = (uint16_t)top;
+    tickStatsReset();
+
+    // CTC mode with TOP = OCR2A gives one compare match per tick
+    timer8Init(&PRR0, PRTIM2, &TCCR2A, &TCCR2B, TIMER8_MODE_WGM_CTC,
+               TIMER2_CLK_SEL_NO_SOURCE);
+    TCNT2 = 0;
+    OCR2A = (uint8_t)(top - 1);
+
+    // Clear any stale compare flag, enable the interrupt, then start
+    SET_BIT(TIFR2, OCF2A);
+    SET_BIT(TIMSK2, OCIE2A);
+    SET_CLK_SOURCE(TCCR2B, tickClkSrcs[i]);
+
+    return STATUS_OK;
+}
+
+/*!
+ * @ref tick.h for function documentation
+ */
+void
+tickHandlerSet
+(
+    TickHandler *pHandler,
+    void        *pArg
+)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        tickHandler    = pHandler;
+        tickHandlerArg = pArg;
+    }
+}
+
+/*!
+ * @ref tick.h for function documentation
+ */
+void
+tickStatsGet(TICK_STATS *pStats)
+{
+    if (pStats == NULL)
+    {
+        return;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        pStats->ticks       = tickStats.ticks;
+        pStats->overruns    = tickStats.overruns;
+        pStats->latencyMin  = tickStats.latencyMin;
+        pStats->latencyMax  = tickStats.latencyMax;
+        pStats->durationMax = tickStats.durationMax;
+    }
+
+    pStats->countsPerTick  = tickTop;
+    pStats->cyclesPerCount = tickPrescale;
+}
+
+/*!
+ * @ref tick.h for function documentation
+ */
+void
+tickStatsReset(void)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        tickStats.ticks       = 0;
+        tickStats.overruns    = 0;
+        tickStats.latencyMin  = 0xFF;
+        tickStats.latencyMax  = 0;
+        tickStats.durationMax = 0;
+    }
+}
+
+/*!
+ * @ref tick.h for function documentation
+ */
+uint32_t
+tickCountGet(void)
+{
+    uint32_t count;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        count = tickCount;
+    }
+
+    return count;
+}
+
+/*!
+ * @ref tick.h for function documentation
+ */
+uint16_t
+tickTimestampGet(void)
+{
+    uint8_t  count = TCNT2;
+    uint16_t base  = tickStampBase;
+
+    //
+    // A compare match not yet serviced has restarted TCNT2 without
+    // advancing the base
+    //
+    if ((TIFR2 & (1 << OCF2A)) && count < (tickTop >> 1))
+    {
+        base += tickTop;
+    }
+
+    return base + count;
+}
+
+/* ------------------------ ISR DEFS ---------------------------------------- */
+
+/*!
+ * Control tick handler, run on every Timer/Counter2 compare match
+ */
+ISR(TIMER2_COMPA_vect, ISR_BLOCK)
+{
+    // In CTC mode TCNT2 restarted from 0 at the compare match
+    uint8_t entry = TCNT2;
+    uint8_t exit;
+
+    ++tickCount;
+    ++tickStats.ticks;
+    tickStampBase += tickTop;
+
+    if (entry < tickStats.latencyMin)
+    {
+        tickStats.latencyMin = entry;
+    }
+    if (entry > tickStats.latencyMax)
+    {
+        tickStats.latencyMax = entry;
+    }
+
+    if (tickHandler != NULL)
+    {
+        // The handler may re-enable interrupts, so the tick must not re-enter
+        CLEAR_BIT(TIMSK2, OCIE2A);
+        tickHandler(tickHandlerArg);
+        cli();
+        SET_BIT(TIMSK2, OCIE2A);
+    }
+
+    //
+    // If the next compare match already happened, this tick overran and the
+    // next one will run late
+    //
+    exit = TCNT2;
+    if (TIFR2 & (1 << OCF2A))
+    {
+        ++tickStats.overruns;
+    }
+    else if ((uint8_t)(exit - entry) > tickStats.durationMax)
+    {
+        tickStats.durationMax = exit - entry;
+    }
+}
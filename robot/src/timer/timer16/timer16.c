@@ -2,11 +2,63 @@
 
 /* ------------------------- SYSTEM INCLUDES -------------------------------- */
 #include <avr/io.h>
+#include <stdlib.h>
 
 /* ------------------------- APPLICATION INCLUDES --------------------------- */
 #include "timer/timer16/timer16.h"
 #include "common/utils.h"
 
+/* ------------------------- TYPEDEFS --------------------------------------- */
+
+/*!
+ * Registers of a 16-bit timer that are not passed to timer16Init
+ */
+typedef struct TIMER16_REGS
+{
+    REG8  *tccrA;
+    REG16 *tcnt;
+    REG8  *timsk;
+    REG8  *tifr;
+} TIMER16_REGS;
+
+/* ------------------------- STATIC VARIABLES ------------------------------- */
+
+static TIMER16_REGS timer16Regs[] =
+{
+    { &TCCR1A, &TCNT1, &TIMSK1, &TIFR1 },
+    { &TCCR3A, &TCNT3, &TIMSK3, &TIFR3 },
+    { &TCCR4A, &TCNT4, &TIMSK4, &TIFR4 },
+    { &TCCR5A, &TCNT5, &TIMSK5, &TIFR5 },
+};
+
+/* ------------------------- STATIC FUNCTIONS ------------------------------- */
+
+/*!
+ * Looks up the registers of a 16-bit timer
+ *
+ * @param[in] tccrA     Timer control register A for chosen timer
+ *
+ * @return Pointer to the timer's registers, or NULL if there are none
+ */
+static const TIMER16_REGS *
+_timer16RegsGet
+(
+    REG8 *tccrA
+)
+{
+    uint8_t i;
+
+    for (i = 0; i < sizeof(timer16Regs)/sizeof(timer16Regs[0]); ++i)
+    {
+        if (timer16Regs[i].tccrA == tccrA)
+        {
+            return &timer16Regs[i];
+        }
+    }
+
+    return NULL;
+}
+
 /* ------------------------- FUNCTION DEFINITIONS --------------------------- */
 
 /*!
@@ -33,3 +85,45 @@ timer16Init
     // Set the timer's clock source
     SET_CLK_SOURCE(*tccrB, clkSrc);
 }
+
+/*!
+ * @ref timer16.h for function documentation
+ */
+REG16 *
+timer16CounterGet
+(
+    REG8 *tccrA
+)
+{
+    const TIMER16_REGS *pRegs = _timer16RegsGet(tccrA);
+
+    return (pRegs != NULL) ? pRegs->tcnt : NULL;
+}
+
+/*!
+ * @ref timer16.h for function documentation
+ */
+REG8 *
+timer16InterruptMaskGet
+(
+    REG8 *tccrA
+)
+{
+    const TIMER16_REGS *pRegs = _timer16RegsGet(tccrA);
+
+    return (pRegs != NULL) ? pRegs->timsk : NULL;
+}
+
+/*!
+ * @ref timer16.h for function documentation
+ */
+REG8 *
+timer16InterruptFlagGet
+(
+    REG8 *tccrA
+)
+{
+    const TIMER16_REGS *pRegs = _timer16RegsGet(tccrA);
+
+    return (pRegs != NULL) ? pRegs->tifr : NULL;
+}
@@ -0,0 +1,36 @@
+/* Implementation file for 8-bit timer */
+
+/* ------------------------- SYSTEM INCLUDES -------------------------------- */
+#include <avr/io.h>
+
+/* ------------------------- APPLICATION INCLUDES --------------------------- */
+#include "timer/timer8/timer8.h"
+#include "common/utils.h"
+
+/* ------------------------- FUNCTION DEFINITIONS --------------------------- */
+
+/*!
+ * @ref timer8.h for function documentation
+ */
+void
+timer8Init
+(
+    REG8 *prr,
+    uint8_t prrBit,
+    REG8 *tccrA,
+    REG8 *tccrB,
+    uint8_t wgmMode,
+    uint8_t clkSrc
+)
+{
+    // Clear appropriate power/reduction timer bit to 0
+    CLEAR_BIT(*prr, prrBit);
+
+    // Set timer mode, with the compare outputs disconnected
+    *tccrA = 0x00;
+    *tccrB = 0x00;
+    SET_TIMER8_MODE_WGM(*tccrA, *tccrB, wgmMode);
+
+    // Set the timer's clock source
+    SET_CLK_SOURCE(*tccrB, clkSrc);
+}
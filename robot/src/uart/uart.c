@@ -114,3 +114,19 @@ uartTX(UART *uart, uint8_t data)
     // Transmit the byte
     *(uart->UDRn) = data;
 }
+
+/*!
+ * @ref uart.h for function documentation
+ */
+void
+uartTXString(UART *uart, const char *str)
+{
+    if (uart == NULL || str == NULL)
+        return;
+
+    while (*str != '\0')
+    {
+        uartTX(uart, (uint8_t)*str);
+        ++str;
+    }
+}
@@ -1,21 +1,48 @@
 /*! Tests for BLE */
 
+#include <avr/io.h>
+#include <avr/interrupt.h>
 #include <util/delay.h>
 #include "car/car.h"
 #include "ble/ble.h"
 #include "lcd/lcd.h"
+#include "spi/spi.h"
+#include "timer/timer16/timer16.h"
+#include "common/utils.h"
+
+/*!
+ * Set to 0 to only run the pass/fail tests. Otherwise, after the tests, the
+ * latency and throughput of BLE_BENCH_ITERATIONS pings, characteristic reads
+ * and characteristic writes are measured and reported on the LCD and on
+ * UART1 (9600 8N1) as "name,min,median,p99,max,cmds/s" lines in us.
+ */
+#ifndef BLE_TEST_BENCHMARK
+#define BLE_TEST_BENCHMARK      (1)
+#endif
+
+#define BLE_BENCH_ITERATIONS    (100)
+
+/*! Timer0 runs at F_CPU/64, so each timer tick is 4 us */
+#define BLE_BENCH_US_PER_TICK   (4)
 
 // This build dependency is flawed.
 Car car;
 
+// Defined in ble.c
+extern BLE_GATT_CHAR RobotDriveCharSpeed;
+
 // Tests
 uint8_t blePingTest(BLE *pBLE);
 uint8_t bleInfoTest(BLE *pBLE);
 
+// Benchmarks
+void bleBenchmark(BLE *pBLE, LCD *pLcd, UART *pHost);
+
 int main(void)
 {
     uint8_t res1, res2;
     UART    uart;
+    UART    host;
     LCD     lcd;
     BLE     ble;
 
@@ -35,40 +62,65 @@ int main(void)
 
     // LCD init
     lcdConstruct(&lcd, &uart);
-    lcd.lcdClear(&lcd);
-    lcd.lcdDisplayCmdSend(&lcd, LCD_DISPLAY_CMD_ON_CURSOR_BLINK);
-    lcd.lcdBacklightCmdSend(&lcd, LCD_BACKLIGHT_CMD_ON);
+    METHOD(&lcd, lcdClear)(&lcd);
+    METHOD(&lcd, lcdDisplayCmdSend)(&lcd, LCD_DISPLAY_CMD_ON_CURSOR_BLINK);
+    METHOD(&lcd, lcdBacklightCmdSend)(&lcd, LCD_BACKLIGHT_CMD_ON);
 
     // SPI init
     spiMasterInit();
 
     // BLE init
     bleConstruct(&ble);
-    ble.bleInitialize(&ble);
+    METHOD(&ble, bleInitialize)(&ble);
+
+    // BLE_IRQ is serviced by interrupt
+    sei();
 
     // BLE tests
     res1 = blePingTest(&ble);
     if (res1) {
-        lcd.lcdPrintln(&lcd, "PING TEST: FAIL");
+        METHOD(&lcd, lcdPrintln)(&lcd, "PING TEST: FAIL");
     } else {
-        lcd.lcdPrintln(&lcd, "PING TEST: PASS");
+        METHOD(&lcd, lcdPrintln)(&lcd, "PING TEST: PASS");
     }
 
     _delay_ms(1000);
 
     res2 = bleInfoTest(&ble);
     if (res2) {
-        lcd.lcdPrintln(&lcd, "INFO TEST: FAIL");
+        METHOD(&lcd, lcdPrintln)(&lcd, "INFO TEST: FAIL");
     } else {
-        lcd.lcdPrintln(&lcd, "INFO TEST: PASS");
+        METHOD(&lcd, lcdPrintln)(&lcd, "INFO TEST: PASS");
     }
 
+#if BLE_TEST_BENCHMARK
+    _delay_ms(1000);
+
+    // Host UART init for the benchmark report
+    uartConstruct(&host,
+                  &UDR1,
+                  &UCSR1A,
+                  &UCSR1B,
+                  &UCSR1C,
+                  &UBRR1H,
+                  &UBRR1L,
+                  UART_PARITY_MODE_DISABLED,
+                  UART_CHAR_SIZE_8,
+                  UART_BAUD_9600);
+
+    uartInit(&host, &PRR1, UART_PR_PRUSART1);
+
+    bleBenchmark(&ble, &lcd, &host);
+#endif
+
+    while(1);
+
     return 0;
 }
 
 uint8_t blePingTest(BLE *pBLE)
 {
-    return (uint8_t)(pBLE->blePing(pBLE));
+    return (uint8_t)(METHOD(pBLE, blePing)(pBLE));
 }
 
 uint8_t bleInfoTest(BLE *pBLE)
@@ -76,7 +128,213 @@ uint8_t bleInfoTest(BLE *pBLE)
     char response[3];
     response[0] = 0; response[1] = 0; response[2] = 0;
 
-    pBLE->bleInfo(pBLE, response, 3);
+    METHOD(pBLE, bleInfo)(pBLE, response, 3);
 
     return !(response[0] == 'B' && response[1] == 'L' && response[2] == 'E');
 }
+
+/* ------------------------ BENCHMARK --------------------------------------- */
+
+/*!
+ * Operations measured by the benchmark
+ */
+#define BLE_BENCH_OP_PING   (0)
+#define BLE_BENCH_OP_READ   (1)
+#define BLE_BENCH_OP_WRITE  (2)
+
+/*!
+ * Number of Timer0 overflows, extending TCNT0 to 32 bits
+ */
+static volatile uint32_t benchOverflows;
+
+/*!
+ * Latency of each iteration of the operation being measured (us)
+ */
+static uint32_t benchLatency[BLE_BENCH_ITERATIONS];
+
+ISR(TIMER0_OVF_vect)
+{
+    ++benchOverflows;
+}
+
+/*!
+ * Starts Timer0 as a free-running 4 us timebase. Timer1 is a motor PWM, and
+ * the PWM driver owns its overflow and compare interrupts.
+ */
+static void
+_benchTimerStart(void)
+{
+    CLEAR_BIT(PRR0, PRTIM0);
+    TCCR0A = 0;
+    TCCR0B = 0;
+    TCNT0  = 0;
+    benchOverflows = 0;
+
+    SET_BIT(TIFR0, TOV0);
+    SET_BIT(TIMSK0, TOIE0);
+    SET_CLK_SOURCE(TCCR0B, CLK_SEL_PRESCALE_64);
+}
+
+/*!
+ * Returns the time since _benchTimerStart in us
+ */
+static uint32_t
+_benchTimeUs(void)
+{
+    uint32_t hi;
+    uint8_t  lo;
+    uint8_t  sreg = SREG;
+
+    cli();
+    lo = TCNT0;
+    hi = benchOverflows;
+
+    // Account for an overflow that happened but has not yet been serviced
+    if ((TIFR0 & (1 << TOV0)) && lo < 0x80)
+    {
+        ++hi;
+    }
+    SREG = sreg;
+
+    return ((hi << 8) | lo) * BLE_BENCH_US_PER_TICK;
+}
+
+/*!
+ * Runs BLE_BENCH_ITERATIONS of op, recording each latency in benchLatency
+ *
+ * @return total elapsed time in us
+ */
+static uint32_t
+_benchRun(BLE *pBLE, uint8_t op)
+{
+    ble_char_value value;
+    uint32_t       start;
+    uint32_t       first;
+    uint8_t        i;
+
+    first = _benchTimeUs();
+    for (i = 0; i < BLE_BENCH_ITERATIONS; ++i)
+    {
+        start = _benchTimeUs();
+
+        switch (op)
+        {
+            case BLE_BENCH_OP_PING:
+                METHOD(pBLE, blePing)(pBLE);
+                break;
+            case BLE_BENCH_OP_READ:
+                METHOD(pBLE, bleCharacteristicRead)(pBLE,
+                                                    &RobotDriveCharSpeed,
+                                                    &value[0]);
+                break;
+            case BLE_BENCH_OP_WRITE:
+                value[0] = '0';
+                value[1] = '\0';
+                METHOD(pBLE, bleCharacteristicWrite)(pBLE,
+                                                     &RobotDriveCharSpeed,
+                                                     &value[0]);
+                break;
+        }
+
+        benchLatency[i] = _benchTimeUs() - start;
+    }
+
+    return _benchTimeUs() - first;
+}
+
+/*!
+ * Sorts benchLatency in ascending order (insertion sort; N is small)
+ */
+static void
+_benchSort(void)
+{
+    uint8_t i;
+    for (i = 1; i < BLE_BENCH_ITERATIONS; ++i)
+    {
+        uint32_t v = benchLatency[i];
+        uint8_t  j = i;
+        while (j > 0 && benchLatency[j-1] > v)
+        {
+            benchLatency[j] = benchLatency[j-1];
+            --j;
+        }
+        benchLatency[j] = v;
+    }
+}
+
+/*!
+ * Reports the statistics of the sorted benchLatency on the LCD and host UART
+ */
+static void
+_benchReport
+(
+    LCD        *pLcd,
+    UART       *pHost,
+    const char *name,
+    uint32_t    totalUs
+)
+{
+    // Nearest-rank percentiles
+    uint32_t stats[5];
+    char     line[48];
+    char    *p;
+    uint8_t  i;
+
+    stats[0] = benchLatency[0];
+    stats[1] = benchLatency[(BLE_BENCH_ITERATIONS - 1) / 2];
+    stats[2] = benchLatency[(BLE_BENCH_ITERATIONS * 99 + 99) / 100 - 1];
+    stats[3] = benchLatency[BLE_BENCH_ITERATIONS - 1];
+    stats[4] = totalUs ? (BLE_BENCH_ITERATIONS * 1000000UL) / totalUs : 0;
+
+    // Host: name,min,median,p99,max,cmds/s
+    p = stringcat(&line[0], name, "");
+    for (i = 0; i < 5; ++i)
+    {
+        *p++ = ',';
+        p = uint2string(p, stats[i]);
+    }
+    stringcat(p, "\r\n", "");
+    uartTXString(pHost, &line[0]);
+
+    // LCD: one screen per operation
+    METHOD(pLcd, lcdClear)(pLcd);
+    p = stringcat(&line[0], name, " MIN ");
+    uint2string(p, stats[0]);
+    METHOD(pLcd, lcdPrintln)(pLcd, &line[0]);
+
+    p = stringcat(&line[0], "MED ", "");
+    uint2string(p, stats[1]);
+    METHOD(pLcd, lcdPrintln)(pLcd, &line[0]);
+
+    p = stringcat(&line[0], "P99 ", "");
+    p = uint2string(p, stats[2]);
+    p = stringcat(p, " MAX ", "");
+    uint2string(p, stats[3]);
+    METHOD(pLcd, lcdPrintln)(pLcd, &line[0]);
+
+    p = stringcat(&line[0], "CMD/S ", "");
+    uint2string(p, stats[4]);
+    METHOD(pLcd, lcdPrintln)(pLcd, &line[0]);
+}
+
+void bleBenchmark(BLE *pBLE, LCD *pLcd, UART *pHost)
+{
+    static const char *names[] = {"PING", "READ", "WRITE"};
+    uint32_t totalUs;
+    uint8_t  op;
+
+    // The characteristics used for reads and writes must exist on the module
+    METHOD(pBLE, bleServicesConfigure)(pBLE);
+    _delay_ms(1000);
+
+    _benchTimerStart();
+    uartTXString(pHost, "op,min_us,med_us,p99_us,max_us,cmds_per_s\r\n");
+
+    for (op = BLE_BENCH_OP_PING; op <= BLE_BENCH_OP_WRITE; ++op)
+    {
+        totalUs = _benchRun(pBLE, op);
+        _benchSort();
+        _benchReport(pLcd, pHost, names[op], totalUs);
+        _delay_ms(3000);
+    }
+}
@@ -0,0 +1,445 @@
+/*! Tests and benchmarks for Car */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <stdlib.h>
+#include "car/car.h"
+#include "lcd/lcd.h"
+#include "timer/timer16/timer16.h"
+#include "common/utils.h"
+
+/*!
+ * Number of wheel speed updates timed per path
+ */
+#define CAR_BENCH_ITERATIONS    (100)
+
+/*!
+ * Update paths measured by the benchmark
+ */
+#define CAR_BENCH_OP_BASELINE   (0)
+#define CAR_BENCH_OP_VECTOR     (1)
+
+/*!
+ * Longest a full-speed reversal may take along any built-in profile (ticks)
+ */
+#define CAR_TEST_REVERSAL_TICKS (4000)
+
+PWM leftFront;
+PWM leftBack;
+PWM rightFront;
+PWM rightBack;
+
+Motor lf;
+Motor lb;
+Motor rf;
+Motor rb;
+
+Car car;
+
+// Tests
+void carReversalTest(Car *pCar, LCD *pLcd, UART *pHost);
+
+// Benchmarks
+void carBenchmark(Car *pCar, LCD *pLcd, UART *pHost);
+
+int main(void)
+{
+    PWM *const pwms[] = {&leftFront, &leftBack, &rightFront, &rightBack};
+    UART       uart;
+    UART       host;
+    LCD        lcd;
+
+    // UART init
+    uartConstruct(&uart,
+                  &UDR0,
+                  &UCSR0A,
+                  &UCSR0B,
+                  &UCSR0C,
+                  &UBRR0H,
+                  &UBRR0L,
+                  UART_PARITY_MODE_DISABLED,
+                  UART_CHAR_SIZE_8,
+                  UART_BAUD_9600);
+
+    uartInit(&uart, &PRR0, UART_PR_PRUSART0);
+
+    // Host UART init for the benchmark report
+    uartConstruct(&host,
+                  &UDR1,
+                  &UCSR1A,
+                  &UCSR1B,
+                  &UCSR1C,
+                  &UBRR1H,
+                  &UBRR1L,
+                  UART_PARITY_MODE_DISABLED,
+                  UART_CHAR_SIZE_8,
+                  UART_BAUD_9600);
+
+    uartInit(&host, &PRR1, UART_PR_PRUSART1);
+
+    // LCD init
+    lcdConstruct(&lcd, &uart);
+    METHOD(&lcd, lcdClear)(&lcd);
+    METHOD(&lcd, lcdDisplayCmdSend)(&lcd, LCD_DISPLAY_CMD_ON_CURSOR_BLINK);
+    METHOD(&lcd, lcdBacklightCmdSend)(&lcd, LCD_BACKLIGHT_CMD_ON);
+
+    // PWM, Motor and Car init, as in main.c but without the control tick
+    pwmConstruct(&leftFront, &DDRE, 4, 5, &PRR1, 3, &TCCR3A, &TCCR3B,
+                 PWM_CARRIER_HZ, &OCR3A, &OCR3B, &OCR3C);
+    pwmConstruct(&leftBack, &DDRH, 4, 5, &PRR1, 4, &TCCR4A, &TCCR4B,
+                 PWM_CARRIER_HZ, &OCR4A, &OCR4B, &OCR4C);
+    pwmConstruct(&rightFront, &DDRB, 6, 7, &PRR0, 3, &TCCR1A, &TCCR1B,
+                 PWM_CARRIER_HZ, &OCR1A, &OCR1B, &OCR1C);
+    pwmConstruct(&rightBack, &DDRL, 4, 5, &PRR1, 5, &TCCR5A, &TCCR5B,
+                 PWM_CARRIER_HZ, &OCR5A, &OCR5B, &OCR5C);
+
+    pwmInit(&leftFront);
+    pwmInit(&leftBack);
+    pwmInit(&rightFront);
+    pwmInit(&rightBack);
+    pwmSyncStart(pwms, sizeof(pwms)/sizeof(pwms[0]));
+
+    motorConstruct(&lf, &leftFront);
+    motorConstruct(&lb, &leftBack);
+    motorConstruct(&rf, &rightFront);
+    motorConstruct(&rb, &rightBack);
+
+    carConstruct(&car, &lf, &rf, &lb, &rb);
+
+    // Timer0 overflows extend the cycle counter
+    sei();
+
+    carReversalTest(&car, &lcd, &host);
+    carBenchmark(&car, &lcd, &host);
+
+    while(1);
+
+    return 0;
+}
+
+/* ------------------------ TESTS ------------------------------------------- */
+
+/*!
+ * Steps the control tick until every wheel reaches target, failing if any
+ * wheel's speed moves away from it on the way
+ *
+ * @return ticks taken, or 0 if the wheels did not reach target in time
+ */
+static uint16_t
+_carProfileRun(Car *pCar, int16_t target)
+{
+    int16_t  last[CAR_NUM_WHEELS];
+    uint16_t ticks;
+    uint8_t  done;
+    uint8_t  i;
+
+    for (i = 0; i < CAR_NUM_WHEELS; ++i)
+    {
+        last[i] = pCar->wheelSpeed[i];
+    }
+
+    for (ticks = 1; ticks <= CAR_TEST_REVERSAL_TICKS; ++ticks)
+    {
+        METHOD(pCar, carControlStep)(pCar);
+
+        done = 0;
+        for (i = 0; i < CAR_NUM_WHEELS; ++i)
+        {
+            if (ABS((int32_t)target - pCar->wheelSpeed[i]) >
+                ABS((int32_t)target - last[i]))
+            {
+                return 0;
+            }
+            last[i] = pCar->wheelSpeed[i];
+            done   += (last[i] == target);
+        }
+
+        if (done == CAR_NUM_WHEELS)
+        {
+            return ticks;
+        }
+    }
+
+    return 0;
+}
+
+/*!
+ * Reverses the car from full speed forward to full speed in reverse along
+ * each built-in profile. The error between the two is twice full speed, so
+ * this covers the profile's widest steps.
+ */
+void carReversalTest(Car *pCar, LCD *pLcd, UART *pHost)
+{
+    static const CAR_PROFILE *profiles[] = {&carProfileSoft,
+                                            &carProfileAggressive};
+    static const char        *names[]    = {"SOFT", "AGGRESSIVE"};
+    const int16_t full = CAR_SPEED_FIXED(CAR_SPEED_FULL);
+    char          line[32];
+    char         *p;
+    uint16_t      ticks;
+    uint8_t       i;
+
+    // Stepped by hand, with no commands to hold off the failsafe
+    METHOD(pCar, carFailsafeSet)(pCar, 0);
+
+    uartTXString(pHost, "result,profile,ticks\r\n");
+    METHOD(pLcd, lcdClear)(pLcd);
+
+    for (i = 0; i < sizeof(profiles)/sizeof(profiles[0]); ++i)
+    {
+        METHOD(pCar, carProfileSet)(pCar, profiles[i]);
+
+        METHOD(pCar, carDriveArc)(pCar, CAR_SPEED_FULL, 0);
+        ticks = _carProfileRun(pCar, full);
+        if (ticks != 0)
+        {
+            METHOD(pCar, carDriveArc)(pCar, -CAR_SPEED_FULL, 0);
+            ticks = _carProfileRun(pCar, -full);
+        }
+
+        // Host: PASS/FAIL,name,ticks
+        p = stringcat(&line[0], (ticks != 0) ? "PASS," : "FAIL,", names[i]);
+        p = stringcat(p, ",", "");
+        p = uint2string(p, ticks);
+        stringcat(p, "\r\n", "");
+        uartTXString(pHost, &line[0]);
+
+        // LCD
+        p = stringcat(&line[0], (ticks != 0) ? "PASS " : "FAIL ", names[i]);
+        METHOD(pLcd, lcdPrintln)(pLcd, &line[0]);
+    }
+
+    // Back to rest along the default profile
+    METHOD(pCar, carProfileSet)(pCar, &carProfileSoft);
+    METHOD(pCar, carDriveArc)(pCar, 0, 0);
+    _carProfileRun(pCar, 0);
+}
+
+/* ------------------------ BENCHMARK --------------------------------------- */
+
+/*!
+ * Number of Timer0 overflows, extending TCNT0 to 32 bits
+ */
+static volatile uint32_t benchOverflows;
+
+ISR(TIMER0_OVF_vect)
+{
+    ++benchOverflows;
+}
+
+/*!
+ * Starts Timer0 as a free-running cycle counter. Timer0 is the only timer
+ * free while the PWMs and the control tick are running.
+ */
+static void
+_benchTimerStart(void)
+{
+    CLEAR_BIT(PRR0, PRTIM0);
+    TCCR0A = 0;
+    TCCR0B = 0;
+    TCNT0  = 0;
+    benchOverflows = 0;
+
+    SET_BIT(TIFR0, TOV0);
+    SET_BIT(TIMSK0, TOIE0);
+    SET_CLK_SOURCE(TCCR0B, CLK_SEL_NO_PRESCALE);
+}
+
+/*!
+ * Returns the number of cycles since _benchTimerStart
+ */
+static uint32_t
+_benchCycles(void)
+{
+    uint32_t hi;
+    uint8_t  lo;
+    uint8_t  sreg = SREG;
+
+    cli();
+    lo = TCNT0;
+    hi = benchOverflows;
+
+    // Account for an overflow that happened but has not yet been serviced
+    if ((TIFR0 & (1 << TOV0)) && lo < 0x80)
+    {
+        ++hi;
+    }
+    SREG = sreg;
+
+    return (hi << 8) | lo;
+}
+
+/*!
+ * The duty cycle path pwmSetDutyCycle used before the Car drove its wheels
+ * together, kept here as the benchmark's baseline
+ */
+static STATUS __attribute__((noinline))
+_legacySetDutyCycle(PWM *pPwm, uint8_t pct)
+{
+    if (pPwm == NULL)
+    {
+        return STATUS_ERR_INVALID_PTR;
+    }
+
+    if (pPwm->dir == PWM_FORWARD)
+    {
+        *pPwm->ocrB = (*pPwm->ocrA/100)*pct;
+        *pPwm->ocrC = 0x0000;
+    }
+    else if (pPwm->dir == PWM_REVERSE)
+    {
+        *pPwm->ocrC = (*pPwm->ocrA/100)*pct;
+        *pPwm->ocrB = 0x0000;
+    }
+    else
+    {
+        return STATUS_ERR_GENERAL;
+    }
+
+    return STATUS_OK;
+}
+
+/*!
+ * The Motor's driveForward and driveReverse as they were before the
+ * H-bridge state machine, driving the PWM at once through the copy above
+ */
+static STATUS __attribute__((noinline))
+_legacyMotorDrive(Motor *pMotor, bool bReverse, uint8_t speed)
+{
+    if (pMotor == NULL)
+    {
+        return STATUS_ERR_INVALID_PTR;
+    }
+
+    if (speed > 100)
+    {
+        speed = 100;
+    }
+
+    pMotor->speed = speed;
+
+    if (bReverse && pMotor->bDirection == FORWARD_DIR)
+    {
+        pMotor->pPwm->dir  = PWM_REVERSE;
+        pMotor->bDirection = REVERSE_DIR;
+    }
+    else if (!bReverse && pMotor->bDirection == REVERSE_DIR)
+    {
+        pMotor->pPwm->dir  = PWM_FORWARD;
+        pMotor->bDirection = FORWARD_DIR;
+    }
+
+    return _legacySetDutyCycle(pMotor->pPwm, speed);
+}
+
+/*!
+ * Applies one set of wheel speeds the way the original carDrive did: one
+ * drive call per wheel, each writing its PWM's compare values at once, open
+ * loop at a whole percent
+ */
+static void
+_benchBaselineApply(Car *pCar, const int16_t speeds[CAR_NUM_WHEELS])
+{
+    uint8_t i;
+
+    for (i = 0; i < CAR_NUM_WHEELS; ++i)
+    {
+        if (speeds[i] < 0)
+        {
+            _legacyMotorDrive(pCar->pMotors[i], true,
+                              (uint8_t)(-speeds[i] / 10));
+        }
+        else
+        {
+            _legacyMotorDrive(pCar->pMotors[i], false,
+                              (uint8_t)(speeds[i] / 10));
+        }
+    }
+}
+
+/*!
+ * Times CAR_BENCH_ITERATIONS wheel speed updates over a sweep of speeds
+ *
+ * @param[out] pMax     Longest single update (cycles)
+ *
+ * @return mean cycles per update
+ */
+static uint32_t
+_benchRun(Car *pCar, uint8_t op, uint32_t *pMax)
+{
+    int16_t  speeds[CAR_NUM_WHEELS];
+    uint32_t start;
+    uint32_t cycles;
+    uint32_t total = 0;
+    uint8_t  i;
+    uint8_t  w;
+
+    *pMax = 0;
+    for (i = 0; i < CAR_BENCH_ITERATIONS; ++i)
+    {
+        // Same direction throughout, so no reversal is ever started
+        for (w = 0; w < CAR_NUM_WHEELS; ++w)
+        {
+            speeds[w] = (int16_t)(i * 10 + w);
+        }
+
+        start = _benchCycles();
+        if (op == CAR_BENCH_OP_BASELINE)
+        {
+            _benchBaselineApply(pCar, speeds);
+        }
+        else
+        {
+            METHOD(pCar, carApplyWheelSpeeds)(pCar, speeds);
+        }
+        cycles = _benchCycles() - start;
+
+        total += cycles;
+        *pMax  = MAX(*pMax, cycles);
+    }
+
+    return total / CAR_BENCH_ITERATIONS;
+}
+
+void carBenchmark(Car *pCar, LCD *pLcd, UART *pHost)
+{
+    static const char *names[] = {"BASELINE", "VECTOR"};
+    int16_t  speeds[CAR_NUM_WHEELS];
+    char     line[32];
+    char    *p;
+    uint32_t mean;
+    uint32_t max;
+    uint8_t  op;
+
+    _benchTimerStart();
+    uartTXString(pHost, "op,mean_cycles,max_cycles\r\n");
+    METHOD(pLcd, lcdClear)(pLcd);
+
+    //
+    // The vector path includes pwmCommit. Near BOTTOM it defers the writes
+    // to a TOP interrupt, which can land inside a timed update and so shows
+    // up in the max rather than the mean
+    //
+    for (op = CAR_BENCH_OP_BASELINE; op <= CAR_BENCH_OP_VECTOR; ++op)
+    {
+        mean = _benchRun(pCar, op, &max);
+
+        // Host: name,mean,max
+        p = stringcat(&line[0], names[op], ",");
+        p = uint2string(p, mean);
+        p = stringcat(p, ",", "");
+        p = uint2string(p, max);
+        stringcat(p, "\r\n", "");
+        uartTXString(pHost, &line[0]);
+
+        // LCD
+        p = stringcat(&line[0], names[op], " ");
+        p = uint2string(p, mean);
+        p = stringcat(p, " ", "");
+        uint2string(p, max);
+        METHOD(pLcd, lcdPrintln)(pLcd, &line[0]);
+    }
+
+    speeds[0] = speeds[1] = speeds[2] = speeds[3] = 0;
+    METHOD(pCar, carApplyWheelSpeeds)(pCar, speeds);
+}
@@ -23,10 +23,10 @@ int main(void)
     uartInit(&uart, &PRR0, UART_PR_PRUSART0);
 
     lcdConstruct(&lcd, &uart);
-    lcd.lcdDisplayCmdSend(&lcd, LCD_DISPLAY_CMD_ON_CURSOR_BLINK);
-    lcd.lcdBacklightCmdSend(&lcd, LCD_BACKLIGHT_CMD_ON);
-    lcd.lcdClear(&lcd);
-    lcd.lcdPrintln(&lcd, "TEST!");
+    METHOD(&lcd, lcdDisplayCmdSend)(&lcd, LCD_DISPLAY_CMD_ON_CURSOR_BLINK);
+    METHOD(&lcd, lcdBacklightCmdSend)(&lcd, LCD_BACKLIGHT_CMD_ON);
+    METHOD(&lcd, lcdClear)(&lcd);
+    METHOD(&lcd, lcdPrintln)(&lcd, "TEST!");
 
     while(1);
 
@@ -0,0 +1,238 @@
+/*! Host model of one wheel's motor through the H-bridge, for the Motor's
+ *  stop and reversal sequences
+ *
+ *  Runs on the build machine rather than the car:
+ *
+ *      gcc -O2 -o motor_plant motor_plant.c -lm && ./motor_plant
+ *
+ *  The motor is a nominal small gearmotor (below), not one measured on the
+ *  car, so the figures compare sequences rather than predict the car's own
+ *  currents. The brake and dead-time durations mirror motor.h, and may be
+ *  overridden with -D to try others.
+ */
+
+#include <math.h>
+#include <stdio.h>
+
+/* ------------------------- MACROS AND DEFINES ----------------------------- */
+
+/*!
+ * Durations of a reversal's brake and dead-time phases, as in motor.h
+ */
+#ifndef MOTOR_REVERSE_BRAKE_MS
+#define MOTOR_REVERSE_BRAKE_MS  (10)
+#endif
+#ifndef MOTOR_DEADTIME_MS
+#define MOTOR_DEADTIME_MS       (2)
+#endif
+
+/*!
+ * The motor: supply (V), winding resistance (ohm) and inductance (H),
+ * torque and back-EMF constant (N.m/A, V.s/rad), rotor and wheel inertia
+ * (kg.m^2) and viscous friction (N.m.s/rad)
+ */
+#define PLANT_VBAT              (7.4)
+#define PLANT_R                 (2.0)
+#define PLANT_L                 (0.002)
+#define PLANT_K                 (0.01)
+#define PLANT_J                 (1.0e-6)
+#define PLANT_B                 (1.0e-6)
+
+/*!
+ * Integration step (s), steps per control tick, time run forward to reach
+ * full speed, and time each sequence is followed for (ticks)
+ */
+#define PLANT_DT                (1.0e-6)
+#define PLANT_STEPS_PER_TICK    (1000)
+#define PLANT_SETTLE_STEPS      (300000L)
+#define PLANT_RUN_TICKS         (5000)
+
+/*!
+ * Speed, as a share of full speed, below which a stopping wheel counts as
+ * stopped; it only ever approaches zero under a brake
+ */
+#define PLANT_STOPPED_SHARE     (0.05)
+
+/*!
+ * H-bridge states, as driven by the Motor
+ */
+#define PLANT_COAST             (0)
+#define PLANT_FORWARD           (1)
+#define PLANT_REVERSE           (2)
+#define PLANT_BRAKE             (3)
+
+/* ------------------------- TYPEDEFS --------------------------------------- */
+
+/*!
+ * State of the model: winding current (A) and rotor speed (rad/s)
+ */
+typedef struct PLANT
+{
+    double i;
+    double w;
+} PLANT;
+
+/*!
+ * H-bridge state to drive on a given control tick of a sequence
+ */
+typedef int PlantSequence(int tick);
+
+/* ------------------------- STATIC FUNCTIONS ------------------------------- */
+
+/*!
+ * Integrates the model over one step with the H-bridge in a given state
+ *
+ * @param[in/out] pPlant    pointer to the model
+ * @param[in]     state     H-bridge state
+ */
+static void
+_plantStep
+(
+    PLANT *pPlant,
+    int    state
+)
+{
+    double v;
+
+    switch (state)
+    {
+        case PLANT_FORWARD:
+            v = PLANT_VBAT;
+            break;
+        case PLANT_REVERSE:
+            v = -PLANT_VBAT;
+            break;
+        case PLANT_BRAKE:
+            v = 0.0;
+            break;
+        default:
+            //
+            // Released: the current freewheels through the diodes back into
+            // the supply until it dies, and then the winding is open
+            //
+            if (fabs(pPlant->i) < 1e-4)
+            {
+                pPlant->i = 0.0;
+                pPlant->w += PLANT_DT * (-PLANT_B * pPlant->w) / PLANT_J;
+                return;
+            }
+            v = (pPlant->i > 0) ? -PLANT_VBAT : PLANT_VBAT;
+            break;
+    }
+
+    pPlant->i += PLANT_DT * (v - PLANT_R * pPlant->i -
+                             PLANT_K * pPlant->w) / PLANT_L;
+    pPlant->w += PLANT_DT * (PLANT_K * pPlant->i -
+                             PLANT_B * pPlant->w) / PLANT_J;
+}
+
+/*!
+ * Drives the model forward to full speed, then follows a sequence, and
+ * reports its peak current and the time the wheel took to stop
+ *
+ * @param[in] name      name of the sequence
+ * @param[in] pSeq      the sequence
+ */
+static void
+_plantRun
+(
+    const char    *name,
+    PlantSequence *pSeq
+)
+{
+    PLANT  plant = {0.0, 0.0};
+    double peak  = 0.0;
+    double full;
+    long   step;
+    long   stop = -1;
+    int    tick;
+    int    state;
+    int    k;
+
+    for (step = 0; step < PLANT_SETTLE_STEPS; ++step)
+    {
+        _plantStep(&plant, PLANT_FORWARD);
+    }
+    full = plant.w;
+
+    for (tick = 0; tick < PLANT_RUN_TICKS; ++tick)
+    {
+        state = pSeq(tick);
+        for (k = 0; k < PLANT_STEPS_PER_TICK; ++k)
+        {
+            _plantStep(&plant, state);
+            peak = fmax(peak, fabs(plant.i));
+
+            if (stop < 0 && plant.w <= full * PLANT_STOPPED_SHARE)
+            {
+                stop = (long)tick * PLANT_STEPS_PER_TICK + k;
+            }
+        }
+    }
+
+    printf("%-32s peak %5.2f A, stopped after %7.1f ms\n", name, peak,
+           (stop < 0) ? -1.0 : (stop * PLANT_DT * 1000.0));
+}
+
+/*!
+ * Reversal before the state machine: the direction flipped at once
+ */
+static int
+_seqReverseDirect(int tick)
+{
+    (void)tick;
+    return PLANT_REVERSE;
+}
+
+/*!
+ * Reversal through the Motor's state machine: MOTOR_REVERSE_BRAKE_MS of
+ * brake, MOTOR_DEADTIME_MS released, then reverse
+ */
+static int
+_seqReverseBraked(int tick)
+{
+    if (tick < MOTOR_REVERSE_BRAKE_MS)
+    {
+        return PLANT_BRAKE;
+    }
+    if (tick < MOTOR_REVERSE_BRAKE_MS + MOTOR_DEADTIME_MS)
+    {
+        return PLANT_COAST;
+    }
+    return PLANT_REVERSE;
+}
+
+/*!
+ * Stop before the state machine: both sides released
+ */
+static int
+_seqStopCoast(int tick)
+{
+    (void)tick;
+    return PLANT_COAST;
+}
+
+/*!
+ * Stop through motorStop: both sides driven together
+ */
+static int
+_seqStopBrake(int tick)
+{
+    (void)tick;
+    return PLANT_BRAKE;
+}
+
+/* ------------------------- FUNCTION DEFINITIONS  -------------------------- */
+
+int main(void)
+{
+    printf("brake %d ms, dead time %d ms\n", MOTOR_REVERSE_BRAKE_MS,
+           MOTOR_DEADTIME_MS);
+
+    _plantRun("reversal, direct", _seqReverseDirect);
+    _plantRun("reversal, brake and dead time", _seqReverseBraked);
+    _plantRun("stop, coasting", _seqStopCoast);
+    _plantRun("stop, braking", _seqStopBrake);
+
+    return 0;
+}
@@ -0,0 +1,587 @@
+/*! Tests and benchmarks for PWM */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <stdlib.h>
+#include <util/delay.h>
+#include "lcd/lcd.h"
+#include "pwm/pfcpwm.h"
+#include "timer/timer16/timer16.h"
+#include "common/utils.h"
+
+/*!
+ * Number of calls timed per duty cycle path. Each call is timed with Timer3
+ * running at F_CPU, so results are in CPU cycles.
+ */
+#define PWM_BENCH_ITERATIONS    (100)
+
+/*!
+ * Duty cycle paths measured by the benchmark
+ */
+#define PWM_BENCH_OP_NONE       (0)
+#define PWM_BENCH_OP_LEGACY     (1)
+#define PWM_BENCH_OP_PCT        (2)
+#define PWM_BENCH_OP_DUTY16     (3)
+#define PWM_BENCH_OP_PERMILLE   (4)
+
+// PWM under test, on the right front motor's timer
+PWM pwm;
+
+// The other wheels' PWMs, for the skew measurement
+PWM pwm3;
+PWM pwm4;
+PWM pwm5;
+
+// Benchmarks
+void pwmBenchmark(PWM *pPwm, LCD *pLcd, UART *pHost);
+void pwmSkewMeasure(LCD *pLcd, UART *pHost);
+void pwmCarrierSweep(LCD *pLcd, UART *pHost);
+void pwmDitherCost(LCD *pLcd, UART *pHost);
+
+int main(void)
+{
+    UART uart;
+    UART host;
+    LCD  lcd;
+
+    // UART init
+    uartConstruct(&uart,
+                  &UDR0,
+                  &UCSR0A,
+                  &UCSR0B,
+                  &UCSR0C,
+                  &UBRR0H,
+                  &UBRR0L,
+                  UART_PARITY_MODE_DISABLED,
+                  UART_CHAR_SIZE_8,
+                  UART_BAUD_9600);
+
+    uartInit(&uart, &PRR0, UART_PR_PRUSART0);
+
+    // Host UART init for the benchmark report
+    uartConstruct(&host,
+                  &UDR1,
+                  &UCSR1A,
+                  &UCSR1B,
+                  &UCSR1C,
+                  &UBRR1H,
+                  &UBRR1L,
+                  UART_PARITY_MODE_DISABLED,
+                  UART_CHAR_SIZE_8,
+                  UART_BAUD_9600);
+
+    uartInit(&host, &PRR1, UART_PR_PRUSART1);
+
+    // LCD init
+    lcdConstruct(&lcd, &uart);
+    METHOD(&lcd, lcdClear)(&lcd);
+    METHOD(&lcd, lcdDisplayCmdSend)(&lcd, LCD_DISPLAY_CMD_ON_CURSOR_BLINK);
+    METHOD(&lcd, lcdBacklightCmdSend)(&lcd, LCD_BACKLIGHT_CMD_ON);
+
+    // PWM init
+    pwmConstruct(&pwm, &DDRB, 6, 7, &PRR0, 3, &TCCR1A, &TCCR1B,
+                 PWM_CARRIER_HZ, &OCR1A, &OCR1B, &OCR1C);
+    pwmInit(&pwm);
+    pwm.dir = PWM_FORWARD;
+
+    pwmBenchmark(&pwm, &lcd, &host);
+    pwmSkewMeasure(&lcd, &host);
+    pwmCarrierSweep(&lcd, &host);
+    pwmDitherCost(&lcd, &host);
+
+    while(1);
+
+    return 0;
+}
+
+/* ------------------------ BENCHMARK --------------------------------------- */
+
+/*!
+ * The duty cycle path pwmSetDutyCycle used before the high-resolution paths
+ * were added, kept here as the benchmark's baseline
+ */
+static STATUS __attribute__((noinline))
+_legacySetDutyCycle(PWM *pPwm, uint8_t pct)
+{
+    if (pPwm == NULL)
+    {
+        return STATUS_ERR_INVALID_PTR;
+    }
+
+    if (pPwm->dir == PWM_FORWARD)
+    {
+        *pPwm->ocrB = (*pPwm->ocrA/100)*pct;
+        *pPwm->ocrC = 0x0000;
+    }
+    else if (pPwm->dir == PWM_REVERSE)
+    {
+        *pPwm->ocrC = (*pPwm->ocrA/100)*pct;
+        *pPwm->ocrB = 0x0000;
+    }
+    else
+    {
+        return STATUS_ERR_GENERAL;
+    }
+
+    return STATUS_OK;
+}
+
+/*!
+ * Starts Timer3 as a free-running cycle counter
+ */
+static void
+_benchTimerStart(void)
+{
+    TCCR3A = 0;
+    TCCR3B = 0;
+    TCNT3  = 0;
+
+    timer16Init(&PRR1, PRTIM3, &TCCR3A, &TCCR3B, TIMER_MODE_WGM_NORMAL,
+                TIMER_MODE_COM_NON_PWM_NORMAL, CLK_SEL_NO_PRESCALE);
+}
+
+/*!
+ * Times PWM_BENCH_ITERATIONS calls of op over a sweep of duty cycles
+ *
+ * @return mean cycles per call, including the loop overhead
+ */
+static uint16_t
+_benchRun(PWM *pPwm, uint8_t op)
+{
+    uint32_t total = 0;
+    uint16_t start;
+    uint16_t end;
+    uint8_t  i;
+    uint8_t  sreg = SREG;
+
+    cli();
+    for (i = 0; i < PWM_BENCH_ITERATIONS; ++i)
+    {
+        start = TCNT3;
+
+        switch (op)
+        {
+            case PWM_BENCH_OP_NONE:
+                break;
+            case PWM_BENCH_OP_LEGACY:
+                _legacySetDutyCycle(pPwm, i);
+                break;
+            case PWM_BENCH_OP_PCT:
+                METHOD(pPwm, pwmSetDutyCycle)(pPwm, i);
+                break;
+            case PWM_BENCH_OP_DUTY16:
+                METHOD(pPwm, pwmSetDutyCycle16)(pPwm, (uint16_t)i * 655);
+                break;
+            case PWM_BENCH_OP_PERMILLE:
+                METHOD(pPwm, pwmSetDutyCyclePermille)(pPwm,
+                                                       (uint16_t)i * 10);
+                break;
+        }
+
+        end = TCNT3;
+        total += (uint16_t)(end - start);
+    }
+    SREG = sreg;
+
+    return (uint16_t)(total / PWM_BENCH_ITERATIONS);
+}
+
+/*!
+ * Reports one line of results on the LCD and the host UART
+ */
+static void
+_benchReport
+(
+    LCD        *pLcd,
+    UART       *pHost,
+    const char *name,
+    uint16_t    cycles,
+    uint16_t    ocrFull
+)
+{
+    char  line[32];
+    char *p;
+
+    // Host: name,cycles,ocr_at_100%
+    p = stringcat(&line[0], name, ",");
+    p = uint2string(p, cycles);
+    p = stringcat(p, ",", "");
+    p = uint2string(p, ocrFull);
+    stringcat(p, "\r\n", "");
+    uartTXString(pHost, &line[0]);
+
+    // LCD: name, cycles and the compare value at 100%
+    p = stringcat(&line[0], name, " ");
+    p = uint2string(p, cycles);
+    p = stringcat(p, " ", "");
+    uint2string(p, ocrFull);
+    METHOD(pLcd, lcdPrintln)(pLcd, &line[0]);
+}
+
+void pwmBenchmark(PWM *pPwm, LCD *pLcd, UART *pHost)
+{
+    static const char *names[] = {"LEGACY", "PCT", "DUTY16", "PERMILLE"};
+    uint16_t overhead;
+    uint16_t cycles;
+    uint8_t  op;
+
+    _benchTimerStart();
+    uartTXString(pHost, "op,cycles_per_call,ocr_at_full\r\n");
+    METHOD(pLcd, lcdClear)(pLcd);
+
+    // Loop and timer read overhead, subtracted from every path
+    overhead = _benchRun(pPwm, PWM_BENCH_OP_NONE);
+
+    for (op = PWM_BENCH_OP_LEGACY; op <= PWM_BENCH_OP_PERMILLE; ++op)
+    {
+        cycles = _benchRun(pPwm, op) - overhead;
+
+        // Resolution check: the compare value each path gives at 100%
+        switch (op)
+        {
+            case PWM_BENCH_OP_LEGACY:
+                _legacySetDutyCycle(pPwm, 100);
+                break;
+            case PWM_BENCH_OP_PCT:
+                METHOD(pPwm, pwmSetDutyCycle)(pPwm, 100);
+                break;
+            case PWM_BENCH_OP_DUTY16:
+                METHOD(pPwm, pwmSetDutyCycle16)(pPwm, PWM_DUTY_FULL);
+                break;
+            case PWM_BENCH_OP_PERMILLE:
+                METHOD(pPwm, pwmSetDutyCyclePermille)(pPwm,
+                                                       PWM_PERMILLE_FULL);
+                break;
+        }
+
+        _benchReport(pLcd, pHost, names[op - PWM_BENCH_OP_LEGACY], cycles,
+                     OCR1B);
+    }
+
+    METHOD(pPwm, pwmSetDutyCycle16)(pPwm, 0);
+}
+
+/* ------------------------ SKEW -------------------------------------------- */
+
+/*!
+ * Counts kept from TOP and BOTTOM when reading a counter's direction
+ */
+#define PWM_SKEW_MARGIN         (16)
+
+/*!
+ * Attempts at a sample clear of TOP and BOTTOM before giving up
+ */
+#define PWM_SKEW_ATTEMPTS       (255)
+
+/*!
+ * Gap between the timers' starts in the unsynchronised case, 0.6 of a 20 kHz
+ * carrier period, so that it does not fall on a whole number of periods
+ */
+#define PWM_SKEW_START_US       (30)
+
+/*!
+ * Gets a counter's position within its whole period, from two reads taken
+ * back to back. In phase and frequency correct mode the counter runs up to
+ * TOP and back down, so one count alone stands for two positions half a
+ * period apart.
+ *
+ * @param[in] first     First read of the counter
+ * @param[in] second    Second read of the counter
+ * @param[in] top       TOP of the counter
+ *
+ * @return the position (0 to 2 * TOP - 1, counted from BOTTOM)
+ */
+static uint16_t
+_skewPosition
+(
+    uint16_t first,
+    uint16_t second,
+    uint16_t top
+)
+{
+    return (second > first) ? first : (2 * top) - first;
+}
+
+/*!
+ * Returns the largest phase difference, in timer counts, between Timer1 and
+ * Timers 3, 4 and 5, or UINT16_MAX if no clean sample could be taken
+ *
+ * Each counter is read twice, back to back, to find which way it is
+ * counting; a sample with any counter too near TOP or BOTTOM for that is
+ * retaken. The reads are evenly spaced, so their spacing, measured on
+ * Timer1's pair, is taken out of each difference.
+ *
+ * @param[in] top       TOP of the counters, which must all be equal
+ */
+static uint16_t
+_skewSample(uint16_t top)
+{
+    uint16_t t[8];
+    uint16_t period = 2 * top;
+    uint16_t step;
+    uint16_t pos0;
+    uint16_t pos;
+    uint16_t d;
+    uint16_t skew;
+    uint8_t  attempt;
+    uint8_t  i;
+    uint8_t  sreg = SREG;
+
+    for (attempt = 0; attempt < PWM_SKEW_ATTEMPTS; ++attempt)
+    {
+        cli();
+        t[0] = TCNT1;
+        t[1] = TCNT1;
+        t[2] = TCNT3;
+        t[3] = TCNT3;
+        t[4] = TCNT4;
+        t[5] = TCNT4;
+        t[6] = TCNT5;
+        t[7] = TCNT5;
+        SREG = sreg;
+
+        for (i = 0; i < 8; i += 2)
+        {
+            if (t[i] < PWM_SKEW_MARGIN || t[i] > top - PWM_SKEW_MARGIN)
+            {
+                break;
+            }
+        }
+        if (i < 8)
+        {
+            continue;
+        }
+
+        step = (t[1] > t[0]) ? t[1] - t[0] : t[0] - t[1];
+        pos0 = _skewPosition(t[0], t[1], top);
+        skew = 0;
+
+        for (i = 2; i < 8; i += 2)
+        {
+            // Where this counter was at the first read, i reads earlier
+            pos  = _skewPosition(t[i], t[i + 1], top);
+            d    = (pos + (2 * period) - pos0 - (i * step)) % period;
+            d    = MIN(d, period - d);
+            skew = MAX(skew, d);
+        }
+
+        return skew;
+    }
+
+    return UINT16_MAX;
+}
+
+void pwmSkewMeasure(LCD *pLcd, UART *pHost)
+{
+    PWM *const pwms[] = {&pwm, &pwm3, &pwm4, &pwm5};
+    char       line[32];
+    char      *p;
+    uint16_t   skew[2];
+    uint8_t    i;
+
+    // Timer3 was the benchmark's cycle counter
+    TCCR3A = 0;
+    TCCR3B = 0;
+
+    pwmConstruct(&pwm3, &DDRE, 4, 5, &PRR1, 3, &TCCR3A, &TCCR3B,
+                 PWM_CARRIER_HZ, &OCR3A, &OCR3B, &OCR3C);
+    pwmConstruct(&pwm4, &DDRH, 4, 5, &PRR1, 4, &TCCR4A, &TCCR4B,
+                 PWM_CARRIER_HZ, &OCR4A, &OCR4B, &OCR4C);
+    pwmConstruct(&pwm5, &DDRL, 4, 5, &PRR1, 5, &TCCR5A, &TCCR5B,
+                 PWM_CARRIER_HZ, &OCR5A, &OCR5B, &OCR5C);
+
+    // Before: each timer starts when its own pwmInit runs
+    pwmInit(&pwm3);
+    _delay_us(PWM_SKEW_START_US);
+    pwmInit(&pwm4);
+    _delay_us(PWM_SKEW_START_US);
+    pwmInit(&pwm5);
+    skew[0] = _skewSample(pwm.top);
+
+    // After: restarted together
+    pwmSyncStart(pwms, sizeof(pwms)/sizeof(pwms[0]));
+    skew[1] = _skewSample(pwm.top);
+
+    for (i = 0; i < 4; ++i)
+    {
+        pwms[i]->dir = PWM_FORWARD;
+        METHOD(pwms[i], pwmSetStaged)(pwms[i], true);
+        METHOD(pwms[i], pwmSetDutyCyclePermille)(pwms[i], 500);
+    }
+    pwmCommit(pwms, sizeof(pwms)/sizeof(pwms[0]));
+
+    // Host: skew_before,skew_after in timer counts
+    uartTXString(pHost, "skew_before,skew_after\r\n");
+    p = uint2string(&line[0], skew[0]);
+    p = stringcat(p, ",", "");
+    p = uint2string(p, skew[1]);
+    stringcat(p, "\r\n", "");
+    uartTXString(pHost, &line[0]);
+
+    // LCD
+    p = stringcat(&line[0], "SKEW ", "");
+    p = uint2string(p, skew[0]);
+    p = stringcat(p, " -> ", "");
+    uint2string(p, skew[1]);
+    METHOD(pLcd, lcdPrintln)(pLcd, &line[0]);
+}
+
+/* ------------------------ CARRIER SWEEP ----------------------------------- */
+
+/*!
+ * Time each carrier is held, so that motor current, noise and ripple can be
+ * measured on the bench
+ */
+#define PWM_SWEEP_HOLD_S        (10)
+
+/*!
+ * Duty cycle each carrier is held at (permille)
+ */
+#define PWM_SWEEP_DUTY          (500)
+
+void pwmCarrierSweep(LCD *pLcd, UART *pHost)
+{
+    // 122 Hz is the carrier used before it became configurable
+    static const uint16_t carriers[] = {122, 1000, 4000, 10000, 20000, 40000};
+    char     line[32];
+    char    *p;
+    uint8_t  i;
+    uint8_t  s;
+
+    uartTXString(pHost, "carrier_hz,top,resolution_bits\r\n");
+
+    for (i = 0; i < sizeof(carriers)/sizeof(carriers[0]); ++i)
+    {
+        // Restart Timer1 from scratch at the new carrier
+        TCCR1A = 0;
+        TCCR1B = 0;
+        pwmConstruct(&pwm, &DDRB, 6, 7, &PRR0, 3, &TCCR1A, &TCCR1B,
+                     carriers[i], &OCR1A, &OCR1B, &OCR1C);
+        pwmInit(&pwm);
+        pwm.dir = PWM_FORWARD;
+        METHOD(&pwm, pwmSetDutyCyclePermille)(&pwm, PWM_SWEEP_DUTY);
+
+        // Host: carrier_hz,top,resolution_bits
+        p = uint2string(&line[0], pwm.carrierHz);
+        p = stringcat(p, ",", "");
+        p = uint2string(p, pwm.top);
+        p = stringcat(p, ",", "");
+        p = uint2string(p, pwm.resolutionBits);
+        stringcat(p, "\r\n", "");
+        uartTXString(pHost, &line[0]);
+
+        // LCD
+        METHOD(pLcd, lcdClear)(pLcd);
+        p = stringcat(&line[0], "HZ ", "");
+        p = uint2string(p, pwm.carrierHz);
+        p = stringcat(p, " BITS ", "");
+        uint2string(p, pwm.resolutionBits);
+        METHOD(pLcd, lcdPrintln)(pLcd, &line[0]);
+
+        for (s = 0; s < PWM_SWEEP_HOLD_S; ++s)
+        {
+            _delay_ms(1000);
+        }
+    }
+
+    METHOD(&pwm, pwmSetDutyCyclePermille)(&pwm, 0);
+}
+
+/* ------------------------ DITHER COST ------------------------------------- */
+
+/*!
+ * Duty cycle the dithered PWMs are held at while the cost is measured,
+ * with a fraction so that every step of the modulator does some work
+ */
+#define PWM_DITHER_COST_DUTY    (0x8000 + 0x0155)
+
+/*!
+ * Spins until Timer0, clocked at F_CPU / 1024, next overflows, a window of
+ * 262144 cycles with interrupts enabled
+ *
+ * @return the number of times the loop ran in the window
+ */
+static uint32_t __attribute__((noinline))
+_ditherSpin(void)
+{
+    uint32_t count = 0;
+
+    TCNT0 = 0;
+    SET_BIT(TIFR0, TOV0);
+    while (!(TIFR0 & (1 << TOV0)))
+    {
+        ++count;
+    }
+
+    return count;
+}
+
+void pwmDitherCost(LCD *pLcd, UART *pHost)
+{
+    PWM *const pwms[] = {&pwm, &pwm3, &pwm4, &pwm5};
+    char       line[32];
+    char      *p;
+    uint32_t   spins[2];
+    uint32_t   lost;
+    uint8_t    i;
+
+    //
+    // The carrier sweep left Timer1 at its last carrier; restart all four
+    // together at the motors' carrier
+    //
+    TCCR1A = 0;
+    TCCR1B = 0;
+    pwmConstruct(&pwm, &DDRB, 6, 7, &PRR0, 3, &TCCR1A, &TCCR1B,
+                 PWM_CARRIER_HZ, &OCR1A, &OCR1B, &OCR1C);
+    pwmInit(&pwm);
+    pwmSyncStart(pwms, sizeof(pwms)/sizeof(pwms[0]));
+
+    for (i = 0; i < 4; ++i)
+    {
+        pwms[i]->dir = PWM_FORWARD;
+        METHOD(pwms[i], pwmSetDutyCycle16)(pwms[i], PWM_DITHER_COST_DUTY);
+    }
+
+    // Timer0 polled as the window, with no interrupt of its own
+    CLEAR_BIT(PRR0, PRTIM0);
+    TCCR0A = 0;
+    TCCR0B = 0;
+    CLEAR_BIT(TIMSK0, TOIE0);
+    SET_CLK_SOURCE(TCCR0B, CLK_SEL_PRESCALE_1024);
+
+    sei();
+    spins[0] = _ditherSpin();
+    if (pwmDitherStart(pwms, sizeof(pwms)/sizeof(pwms[0])) != STATUS_OK)
+    {
+        uartTXString(pHost, "dither not built\r\n");
+        METHOD(pLcd, lcdPrintln)(pLcd, "DITHER OFF");
+        return;
+    }
+    spins[1] = _ditherSpin();
+
+    // The engine stays attached to Timer1, but stops interrupting
+    CLEAR_BIT(TIMSK1, TOIE1);
+
+    //
+    // The share of the window the interrupt took is the share of the loop
+    // it cost; per carrier period that is cycles = share * F_CPU / carrier
+    //
+    lost = (spins[0] > spins[1]) ? (spins[0] - spins[1]) : 0;
+
+    // Host: cycles_per_period,cpu_permille
+    uartTXString(pHost, "dither_cycles_per_period,cpu_permille\r\n");
+    p = uint2string(&line[0],
+                    (uint16_t)((lost * (F_CPU / PWM_CARRIER_HZ)) /
+                               spins[0]));
+    p = stringcat(p, ",", "");
+    p = uint2string(p, (uint16_t)((lost * 1000) / spins[0]));
+    stringcat(p, "\r\n", "");
+    uartTXString(pHost, &line[0]);
+
+    // LCD
+    METHOD(pLcd, lcdClear)(pLcd);
+    p = stringcat(&line[0], "DITHER ", "");
+    uint2string(p, (uint16_t)((lost * (F_CPU / PWM_CARRIER_HZ)) /
+                              spins[0]));
+    METHOD(pLcd, lcdPrintln)(pLcd, &line[0]);
+}